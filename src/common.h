@@ -35,32 +35,131 @@
 #include "hosts/rk3308.h"
 #endif
 
+#include <stdio.h>
+#include <pthread.h>
+
 #include "devices/device.h"
 
 using namespace std;
 
 #define VERSION "0.2"
 
+/* Gang programming: one PGC (and MCLR) shared by up to GANG_MAX targets,
+ * each one with its own PGD line. Needs whole-bank GPIO access. */
+#define GANG_MAX	16
+
+#ifdef GPIO_SET_MASK
+#define GANG_SUPPORTED
+#define PGD_SET()	do{ if(gang_count) GPIO_SET_MASK(gang_mask); else GPIO_SET(pic_data); }while(0)
+#define PGD_CLR()	do{ if(gang_count) GPIO_CLR_MASK(gang_mask); else GPIO_CLR(pic_data); }while(0)
+#else
+#define GPIO_LEV_ALL()	0
+#define PGD_SET()	GPIO_SET(pic_data)
+#define PGD_CLR()	GPIO_CLR(pic_data)
+#endif
+
+/* Daemon mode drives several channels from different threads: the host
+ * needs write-only set/clear registers and locked FSEL updates */
+#define DAEMON_MAX_CHANNELS	8
+
+#ifdef GPIO_FSEL_IN
+#define DAEMON_SUPPORTED
+void gpio_dir(int g, bool out);
+#endif
+
 /* Low-level functions */
 void delay_us(unsigned int howLong);
+void delay_since(struct timeval *start, unsigned int howLong);
+void delay_clk(void);	// half a period of PGC, see clk_half_ns
 void setup_io(void);
+void map_io(void);
+void setup_pins(void);
 void close_io(void);
 
 /* inhx.cpp functions */
-unsigned int read_inhx(char *infile, memory *mem, uint32_t offset=0);
+unsigned int read_inhx(char *infile, memory *mem, uint32_t offset=0, uint32_t shift=0);
+unsigned int read_inhx_fp(FILE *fp, memory *mem, uint32_t offset=0, uint32_t shift=0);
+unsigned int read_images(const char *spec, memory *mem, uint32_t offset=0);
 void write_inhx(memory *mem, char *outfile, uint32_t offset=0);
+void write_inhx_fp(memory *mem, FILE *fp, uint32_t offset=0);
+void clear_image(memory *mem);
+
+/* lz4.cpp functions */
+int lz4_decode(const uint8_t *src, uint32_t src_len, uint8_t *dst, uint32_t dst_len);
 
 /* Runtime Functions */
 void pic_reset(bool silent = false);
 
+/* Gang functions */
+void pgd_in(void);
+void pgd_out(void);
+void gang_split(uint32_t *levels, uint8_t bits, uint16_t *words);
+void gang_report(void);
+
 /* main functions */
+Pic *pic_create(const char *family);
+Pic *pic_autodetect(void);
 void usage(void);
+
+/* server.cpp functions */
 void server_mode(int port);
-uint8_t send_file(char * filename);
-uint8_t receive_file(int sock, char * filename);
+
+/* queue.cpp: blocking FIFO between a producer and a worker thread */
+struct queue_node;
+struct job_queue{
+	pthread_mutex_t		lock;
+	pthread_cond_t		cond;
+	struct queue_node	*head, *tail;
+	unsigned int		len;
+};
+
+void queue_init(job_queue *q);
+void queue_push(job_queue *q, void *item);
+void *queue_pop(job_queue *q);
+void *queue_pop_timed(job_queue *q, unsigned int ms);
+unsigned int queue_len(job_queue *q);
+
+/* script.cpp functions */
+bool script_parse(char *spec);
+void script_run(Pic *pic);
+
+/* production.cpp functions */
+void production_mode(Pic *pic, char *infile);
+
+/* timing.cpp: per fixture PGC speed, found by --calibrate */
+#define TIMING_PROFILE	"/etc/picberry.timing"
+
+extern const char *timing_file;
+bool timing_load(const char *family);
+void calibrate_mode(Pic *pic, const char *family);
+
+/* journal.cpp: progress of a write, for --resume */
+#define JOURNAL_DIR	"/var/tmp"
+
+extern const char *journal_dir;
+uint32_t crc32(uint32_t crc, const void *buf, size_t len);
+uint32_t image_crc(memory *mem);
+uint32_t journal_load(Pic *pic, uint32_t crc);
+bool journal_save(Pic *pic, uint32_t crc, uint32_t next);
+void journal_clear(void);
+
+/* serial.cpp: per unit values patched into the image, --serialize */
+bool serial_load(const char *rulefile);
+bool serial_active(void);
+bool serial_apply(Pic *pic);
+bool serial_commit(Pic *pic);
+
+/* plan.cpp: dry run of -w with time estimate, --plan */
+bool plan_mode(const char *part, char *infile);
+
+/* daemon.cpp functions */
+void daemon_mode(char **channels, int nchannels);
 
 extern volatile uint32_t *gpio;
-extern int pic_clk, pic_data, pic_mclr;
+extern thread_local int pic_clk, pic_data, pic_mclr;	// per programming channel
+extern thread_local unsigned int clk_half_ns;
+extern int gang_count, gang_pins[GANG_MAX];
+extern uint32_t gang_mask, gang_fail;
 
 struct flags_struct {
    int debug = 0;
@@ -69,6 +168,13 @@ struct flags_struct {
    int boot_only = 0;
    int program_only = 0;
    int fulldump = 0;
+   int stats = 0;
+   int row_verify = 0;
+   int retries = 2;				// attempts at recovering a row which fails to verify
+   int resume = 0;				// go on with an interrupted write, see journal.cpp
+   int journal = 0;				// journal writes for a later --resume
+   int skip_identical = 0;		// do not write a device which already holds the image
+   int config_only = 0;			// -w updates the configuration words only
 };
 
 extern struct flags_struct flags;
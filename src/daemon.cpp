@@ -0,0 +1,314 @@
+/*
+ * Raspberry Pi PIC Programmer using GPIO connector
+ * https://github.com/WallaceIT/picberry
+ * Copyright 2016 Francesco Valla
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include "common.h"
+
+/*
+ * Daemon mode: every channel (PGC, PGD, MCLR and family) owns a worker
+ * thread, pinned to a CPU, which runs the jobs of its queue one after the
+ * other. Jobs are read from stdin as "CHANNEL OP [FILE]". Hex images to be
+ * written are parsed once and shared read-only by all the channels.
+ */
+
+#ifdef DAEMON_SUPPORTED
+
+enum job_op {JOB_WRITE, JOB_READ, JOB_ERASE, JOB_BLANKCHECK, JOB_REGDUMP, JOB_QUIT};
+
+static const char *job_names[] = {"write", "read", "erase", "blankcheck", "regdump"};
+
+struct job{
+	int				id;
+	job_op			op;
+	char			file[256];
+};
+
+struct channel{
+	int				num;
+	int				clk, data, mclr;
+	char			family[32];
+	pthread_t		thread;
+	job_queue		jobs;
+};
+
+/* Parsed image, shared by every channel writing the same file */
+struct image{
+	char			path[256];
+	time_t			mtime;
+	uint32_t		size;		// program_memory_size it was parsed for
+	uint32_t		offset;		// hex_offset it was parsed with
+	unsigned int	users;
+	memory			mem;
+	struct image	*next;
+};
+
+static struct image *images = NULL;
+static pthread_mutex_t images_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Get the image of path for pic's memory layout, parsing it if needed */
+static struct image *image_get(const char *path, Pic *pic)
+{
+	struct image *img;
+	struct stat st;
+
+	if(stat(path, &st)){
+		fprintf(stderr, "Error: cannot open source file %s\n", path);
+		return NULL;
+	}
+
+	pthread_mutex_lock(&images_lock);
+	for(img = images; img; img = img->next)
+		if(!strcmp(img->path, path) && img->mtime == st.st_mtime &&
+		   img->size == pic->mem.program_memory_size && img->offset == pic->hex_offset)
+			break;
+
+	if(!img){
+		img = (struct image *) calloc(1, sizeof(struct image));
+		snprintf(img->path, sizeof(img->path), "%s", path);
+		img->mtime = st.st_mtime;
+		img->size = pic->mem.program_memory_size;
+		img->offset = pic->hex_offset;
+		img->mem = pic->mem;
+		img->mem.location = (uint16_t*) calloc(img->size, sizeof(uint16_t));
+		img->mem.filled = (bool*) calloc(img->size, sizeof(bool));
+		if(!read_inhx(img->path, &img->mem, img->offset)){
+			free(img->mem.location);
+			free(img->mem.filled);
+			free(img);
+			pthread_mutex_unlock(&images_lock);
+			return NULL;
+		}
+		img->next = images;
+		images = img;
+	}
+	img->users++;
+	pthread_mutex_unlock(&images_lock);
+
+	return img;
+}
+
+/* Release an image; stale ones (file changed meanwhile) are freed */
+static void image_put(struct image *img)
+{
+	struct image **p;
+	struct stat st;
+
+	pthread_mutex_lock(&images_lock);
+	img->users--;
+	if(!img->users && (stat(img->path, &st) || st.st_mtime != img->mtime)){
+		for(p = &images; *p != img; p = &(*p)->next);
+		*p = img->next;
+		free(img->mem.location);
+		free(img->mem.filled);
+		free(img);
+	}
+	pthread_mutex_unlock(&images_lock);
+}
+
+/* Run one job on the channel of the calling thread */
+static void run_job(struct channel *ch, struct job *j)
+{
+	struct timeval start, end;
+	struct image *img = NULL;
+	const char *result = "DONE";
+	uint32_t errors;
+	Pic *pic;
+
+	gettimeofday(&start, 0);
+	pic = pic_create(ch->family);
+
+	pic->enter_program_mode();
+	pic->setup_pe();
+	errors = pic->errors;
+
+	if(!pic->read_device_id()){
+		fprintf(stdout, "[ch%d] job %d: unknown device (ID 0x%x)\n",
+				ch->num, j->id, pic->device_id);
+		result = "FAILED";
+	}
+	else switch(j->op){
+		case JOB_WRITE:
+			img = image_get(j->file, pic);
+			if(!img){
+				result = "FAILED";
+				break;
+			}
+			/* program from the shared image instead of a private copy */
+			free(pic->mem.location);
+			free(pic->mem.filled);
+			pic->mem.location = img->mem.location;
+			pic->mem.filled = img->mem.filled;
+			if(flags.skip_identical && pic->already_programmed())
+				result = "ALREADY PROGRAMMED";
+			else{
+				pic->write(NULL);
+				if(pic->errors != errors)
+					result = "FAILED";
+			}
+			pic->mem.location = NULL;
+			pic->mem.filled = NULL;
+			image_put(img);
+			break;
+		case JOB_READ:
+			pic->read(j->file, 0, 0);
+			if(pic->errors != errors)
+				result = "FAILED";
+			break;
+		case JOB_ERASE:
+			pic->bulk_erase();
+			if(pic->errors != errors)
+				result = "FAILED";
+			break;
+		case JOB_BLANKCHECK:
+			result = pic->blank_check() ? "NOT BLANK" : "BLANK";
+			break;
+		case JOB_REGDUMP:
+			pic->dump_configuration_registers();
+			break;
+		default:
+			break;
+	}
+
+	pic->exit_program_mode();
+
+	gettimeofday(&end, 0);
+	fprintf(stdout, "[ch%d] job %d: %s %s%s%s: %s in %.2fs\n", ch->num, j->id,
+			job_names[j->op], pic->name, j->file[0] ? " " : "", j->file, result,
+			(end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6);
+
+	free(pic->mem.location);
+	free(pic->mem.filled);
+	delete pic;
+}
+
+static void *channel_worker(void *arg)
+{
+	struct channel *ch = (struct channel *) arg;
+	struct job *j;
+
+	/* pins are thread local: this thread only drives its own channel */
+	pic_clk = ch->clk;
+	pic_data = ch->data;
+	pic_mclr = ch->mclr;
+	setup_pins();
+	timing_load(ch->family);
+
+	for(;;){
+		j = (struct job *) queue_pop(&ch->jobs);
+		if(j->op == JOB_QUIT){
+			free(j);
+			break;
+		}
+		run_job(ch, j);
+		free(j);
+	}
+
+	GPIO_IN(pic_mclr);
+	return NULL;
+}
+
+void daemon_mode(char **channels, int nchannels)
+{
+	struct channel ch[DAEMON_MAX_CHANNELS];
+	char line[512], op[16], file[256];
+	int i, n, num, jobs = 0;
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	cpu_set_t cpuset;
+	struct job *j;
+	Pic *pic;
+
+	for(i = 0; i < nchannels; i++){
+		memset(&ch[i], 0, sizeof(struct channel));
+		ch[i].num = i;
+		if(sscanf(channels[i], "%d,%d,%d,%31s", &ch[i].clk, &ch[i].data,
+				  &ch[i].mclr, ch[i].family) != 4 || !(pic = pic_create(ch[i].family))){
+			fprintf(stderr, "Channel %d: expected PGC,PGD,MCLR,family, got %s\n",
+					i, channels[i]);
+			exit(1);
+		}
+		delete pic;
+	}
+
+	for(i = 0; i < nchannels; i++){
+		queue_init(&ch[i].jobs);
+		pthread_create(&ch[i].thread, NULL, channel_worker, &ch[i]);
+
+		/* leave CPU 0 to the main thread when there are enough */
+		CPU_ZERO(&cpuset);
+		CPU_SET((cpus > 1) ? 1 + i % (cpus - 1) : 0, &cpuset);
+		pthread_setaffinity_np(ch[i].thread, sizeof(cpu_set_t), &cpuset);
+
+		fprintf(stdout, "[ch%d] %s on PGC %d, PGD %d, MCLR %d\n", i,
+				ch[i].family, ch[i].clk, ch[i].data, ch[i].mclr);
+	}
+
+	while(fgets(line, sizeof(line), stdin)){
+		if(!strncmp(line, "quit", 4))
+			break;
+		file[0] = 0;
+		n = sscanf(line, "%d %15s %255s", &num, op, file);
+		if(n <= 0)
+			continue;
+		if(n < 2 || num < 0 || num >= nchannels){
+			fprintf(stdout, "Invalid job: %s", line);
+			continue;
+		}
+
+		j = (struct job *) calloc(1, sizeof(struct job));
+		for(i = 0; i < JOB_QUIT; i++)
+			if(!strcmp(op, job_names[i]))
+				break;
+		if(i == JOB_QUIT || ((i == JOB_WRITE || i == JOB_READ) && n < 3)){
+			fprintf(stdout, "Invalid job: %s", line);
+			free(j);
+			continue;
+		}
+		j->id = ++jobs;
+		j->op = (job_op) i;
+		strcpy(j->file, file);
+		queue_push(&ch[num].jobs, j);
+		fprintf(stdout, "[ch%d] job %d queued\n", num, j->id);
+	}
+
+	/* let the queued jobs complete, then stop the workers */
+	for(i = 0; i < nchannels; i++){
+		j = (struct job *) calloc(1, sizeof(struct job));
+		j->op = JOB_QUIT;
+		queue_push(&ch[i].jobs, j);
+	}
+	for(i = 0; i < nchannels; i++)
+		pthread_join(ch[i].thread, NULL);
+}
+
+#else
+
+void daemon_mode(char **channels, int nchannels)
+{
+	fprintf(stderr, "Daemon mode is not supported on this host!\n");
+}
+
+#endif /* DAEMON_SUPPORTED */
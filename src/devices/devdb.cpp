@@ -0,0 +1,66 @@
+/*
+ * Raspberry Pi PIC Programmer using GPIO connector
+ * https://github.com/WallaceIT/picberry
+ * Copyright 2016 Francesco Valla
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <strings.h>
+
+#include "device.h"
+
+#define DEVDB_KEY(db, id)	(((uint64_t)(db) << 32) | (uint32_t)(id))
+
+/*
+ * The whole database is one switch, which the compiler lays out as jump
+ * tables and a binary search at build time; two parts with the same key
+ * do not compile.
+ */
+const pic_device *devdb_lookup(devdb db, uint32_t device_id, const char **family)
+{
+	switch(DEVDB_KEY(db, device_id)){
+#define PIC_DEVICE(table, fam, id, part, size) \
+		case DEVDB_KEY(table, id):{ \
+			static const pic_device dev = {id, part, size}; \
+			if(family) \
+				*family = fam; \
+			return &dev; \
+		}
+#include "devices.def"
+#undef PIC_DEVICE
+		default:
+			return NULL;
+	}
+}
+
+const pic_device *devdb_find(const char *part, const char **family)
+{
+	static const struct{
+		const char	*family;
+		pic_device	dev;
+	} parts[] = {
+#define PIC_DEVICE(table, fam, id, part, size) {fam, {id, part, size}},
+#include "devices.def"
+#undef PIC_DEVICE
+	};
+
+	for(size_t i = 0; i < sizeof(parts)/sizeof(parts[0]); i++)
+		if(!strcasecmp(parts[i].dev.name, part)){
+			if(family)
+				*family = parts[i].family;
+			return &parts[i].dev;
+		}
+	return NULL;
+}
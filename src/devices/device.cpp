@@ -0,0 +1,274 @@
+/*
+ * Raspberry Pi PIC Programmer using GPIO connector
+ * https://github.com/WallaceIT/picberry
+ * Copyright 2016 Francesco Valla
+ *
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "../common.h"
+#include "device.h"
+
+#define NVM_TIMEOUT_FACTOR	4		// give up after 4 times the datasheet max
+#define NVM_TIMEOUT_MIN		100000	// but never before 100ms
+#define RETRY_CLK_NS		1000	// PGC half period of row retries
+
+static void nvm_stats_init(nvm_stats *stats, const char *name)
+{
+	memset(stats, 0, sizeof(nvm_stats));
+	stats->name = name;
+}
+
+static uint32_t elapsed_us(struct timeval *start)
+{
+	struct timeval now;
+
+	gettimeofday(&now, 0);
+	return (now.tv_sec - start->tv_sec) * 1000000 + (now.tv_usec - start->tv_usec);
+}
+
+Pic::Pic(uint8_t sf)
+{
+	device_id=0;
+	device_rev=0;
+	subfamily=sf;
+	hex_offset=0;
+	errors=0;
+	progress_cb=NULL;
+	progress_ctx=NULL;
+	memset(&mem, 0, sizeof(mem));
+	nvm_stats_init(&erase_stats, "erase");
+	nvm_stats_init(&row_stats, "row write");
+	nvm_stats_init(&config_stats, "config write");
+	memset(&retries, 0, sizeof(retries));
+	retry_clk = 0;
+	memset(&nvm_start, 0, sizeof(nvm_start));
+}
+
+/*
+ * Load the image to be written into mem and return the number of filled
+ * locations; infile may list several images, see read_images(). Without
+ * infile the image already in mem is used as it is, so callers can hand
+ * several sessions the same (read only) image.
+ */
+unsigned int Pic::load_image(char *infile)
+{
+	unsigned int filled = 0;
+	uint32_t i;
+
+	if(infile)
+		return read_images(infile, &mem, hex_offset);
+
+	for(i = 0; i < mem.program_memory_size; i++)
+		if(mem.filled[i]) filled++;
+
+	return filled;
+}
+
+/*
+ * Read back the span of memory filled by the image in mem and compare it
+ * with the image. Only the words of the image are compared: anything else
+ * on the device is not looked at.
+ */
+bool Pic::already_programmed(void)
+{
+	memory image = mem;
+	uint32_t i, first = 0, last = 0;
+	bool found = false, same = true;
+
+	if(gang_count)
+		return false;
+
+	for(i = 0; i < mem.code_memory_size; i++)
+		if(mem.filled[i]){
+			if(!found)
+				first = i;
+			last = i;
+			found = true;
+		}
+	if(!found)
+		return false;
+
+	mem.location = (uint16_t*) calloc(mem.program_memory_size, sizeof(uint16_t));
+	mem.filled = (bool*) calloc(mem.program_memory_size, sizeof(bool));
+	if(mem.location && mem.filled)
+		read(NULL, first, last - first + 1);
+	else
+		same = false;
+
+	for(i = 0; i < image.program_memory_size && same; i++){
+		if(!image.filled[i])
+			continue;
+		if(mem.filled[i])
+			same = mem.location[i] == image.location[i];
+		else
+			same = image.location[i] == erased_value(i);
+	}
+
+	free(mem.location);
+	free(mem.filled);
+	mem = image;
+	return same;
+}
+
+void Pic::write_configuration(char *infile)
+{
+	fprintf(stderr, "Configuration-only writes are not supported for this family\n");
+	errors++;
+}
+
+/* Name and memory of a part, the image left by a previous part freed */
+void Pic::setup_memory(const pic_device *dev, uint32_t program_memory_size)
+{
+	strcpy(name, dev->name);
+	mem.code_memory_size = dev->code_memory_size;
+	mem.program_memory_size = program_memory_size;
+	free(mem.location);
+	free(mem.filled);
+	mem.location = (uint16_t*) calloc(mem.program_memory_size,sizeof(uint16_t));
+	mem.filled = (bool*) calloc(mem.program_memory_size,sizeof(bool));
+}
+
+/* Report the progress of the running operation */
+void Pic::progress(int percent)
+{
+	if(progress_cb)
+		progress_cb(percent, progress_ctx);
+	else
+		fprintf(stderr, "\b\b\b\b\b[%2d%%]", percent);
+}
+
+/* Mark the start of a self-timed NVM operation (right after setting WR) */
+void Pic::nvm_begin(void)
+{
+	gettimeofday(&nvm_start, 0);
+}
+
+/*
+ * Wait for the NVM operation started by nvm_begin() to complete.
+ * Instead of sleeping for the worst case max_us, the first poll is issued
+ * after the shortest duration observed so far (max_us/8 before the first
+ * sample), then nvm_busy() is polled with an interval doubling up to max_us/4.
+ * Returns false if the operation did not complete in time.
+ */
+bool Pic::nvm_wait(nvm_stats *stats, uint32_t max_us)
+{
+	uint32_t first, backoff, now, timeout;
+	uint8_t bucket = 0;
+
+	first = max_us / 8;
+	if(stats->count && stats->min_us < first)
+		first = stats->min_us;
+
+	timeout = max_us * NVM_TIMEOUT_FACTOR;
+	if(timeout < NVM_TIMEOUT_MIN)
+		timeout = NVM_TIMEOUT_MIN;
+
+	now = elapsed_us(&nvm_start);
+	if(now < first)
+		delay_us(first - now);
+
+	backoff = (max_us / 32) ? max_us / 32 : 1;
+	while(nvm_busy()){
+		if(elapsed_us(&nvm_start) > timeout){
+			stats->timeouts++;
+			errors++;
+			fprintf(stderr, "\nError: %s did not complete in %dus!\n",
+					stats->name, timeout);
+			return false;
+		}
+		delay_us(backoff);
+		if(backoff < max_us / 4)
+			backoff *= 2;
+	}
+
+	now = elapsed_us(&nvm_start);
+	if(!stats->count || now < stats->min_us) stats->min_us = now;
+	if(now > stats->max_us) stats->max_us = now;
+	stats->total_us += now;
+	stats->count++;
+
+	while((now >> (bucket + 1)) && bucket < NVM_HIST_BUCKETS - 1)
+		bucket++;
+	stats->hist[bucket]++;
+
+	return true;
+}
+
+/* Print min/avg/max and a log2 histogram of the measured NVM timings */
+void Pic::print_nvm_stats(void)
+{
+	nvm_stats *all[3] = {&erase_stats, &row_stats, &config_stats};
+	uint32_t peak;
+	int i, j;
+
+	fprintf(stderr, "\nNVM timing statistics:\n");
+	for(i = 0; i < 3; i++){
+		nvm_stats *s = all[i];
+		if(!s->count && !s->timeouts)
+			continue;
+		fprintf(stderr, " - %s: %d ops, %d timeouts", s->name, s->count, s->timeouts);
+		if(!s->count){
+			fprintf(stderr, "\n");
+			continue;
+		}
+		fprintf(stderr, ", min %dus, avg %dus, max %dus\n", s->min_us,
+				(uint32_t)(s->total_us / s->count), s->max_us);
+
+		peak = 0;
+		for(j = 0; j < NVM_HIST_BUCKETS; j++)
+			if(s->hist[j] > peak) peak = s->hist[j];
+		for(j = 0; j < NVM_HIST_BUCKETS; j++){
+			if(!s->hist[j])
+				continue;
+			fprintf(stderr, "   %8dus %-40.*s %d\n", 1 << j,
+					(int)((s->hist[j] * 40 + peak - 1) / peak),
+					"########################################", s->hist[j]);
+		}
+	}
+}
+
+void Pic::retry_begin(void)
+{
+	retries.rows++;
+	retry_clk = clk_half_ns;
+	if(clk_half_ns < RETRY_CLK_NS){
+		clk_half_ns = RETRY_CLK_NS;
+		retries.slowed++;
+	}
+}
+
+void Pic::retry_end(void)
+{
+	clk_half_ns = retry_clk;
+}
+
+void Pic::print_retry_stats(void)
+{
+	if(!retries.rows)
+		return;
+
+	fprintf(stderr, "\nRow retries: %d rows, %d right when read again, "
+			"%d programmed again, %d failed", retries.rows, retries.reread,
+			retries.rewritten, retries.failed);
+	if(retries.slowed)
+		fprintf(stderr, ", %d at a slower PGC", retries.slowed);
+	fprintf(stderr, "\n");
+}
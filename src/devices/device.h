@@ -20,7 +20,13 @@
  
 #ifndef DEVICE_H_
 #define DEVICE_H_
- 
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/time.h>
+
+#define NVM_HIST_BUCKETS	20	// log2(us) buckets, the last one is open-ended
+
  struct memory{
 		uint32_t	program_memory_size;   	// size in WORDS (16bits each)
 		uint32_t	code_memory_size;		// size in WORDS (16bits each)
@@ -34,6 +40,62 @@ struct pic_device{
 	int			code_memory_size;	/* size in WORDS (16bits each)  */
 };
 
+/* Tables of the device database, see devices.def */
+enum devdb{
+	DB_DSPIC33E,
+	DB_DSPIC33F,
+	DB_DSPIC33CK,
+	DB_PIC10F322,
+	DB_PIC18FJ,
+	DB_PIC24FJXXXGA0XX,
+	DB_PIC24FJXXGA1XX_GB0XX,
+	DB_PIC24FJXXXGA1_GB1,
+	DB_PIC24FJXXXGA2_GB2,
+	DB_PIC24FJXXXGA3XX,
+	DB_PIC24FXXKA1XX,
+	DB_PIC32
+};
+
+/* Part with the given ID in a table, NULL if unknown; family: its -f name */
+const pic_device *devdb_lookup(devdb db, uint32_t device_id, const char **family=NULL);
+/* Part with the given name, for work done without a device to ask */
+const pic_device *devdb_find(const char *part, const char **family=NULL);
+
+/* What a write costs on a family, counted from the driver's own command
+ * sequences: PGC cycles, delay_us(1) calls and datasheet waits */
+struct plan_model{
+		uint32_t	row_words;			// mem locations per row
+		bool		all_rows;			// empty rows are programmed and verified too
+		uint32_t	row_clocks, row_delays;		// loading and starting a row
+		uint32_t	row_us;						// programming a row
+		uint32_t	verify_clocks, verify_delays;	// reading a row back, 0 if not done
+		uint32_t	erase_us;					// bulk erase
+		uint32_t	fixed_us;					// entering program mode, settling
+		uint32_t	config_addr, config_count;	// config words written on their own,
+		uint32_t	config_clocks, config_delays;	// 2 locations apart
+		uint32_t	config_us;
+};
+
+/* Measured duration of one kind of NVM operation (erase, row write...) */
+struct nvm_stats{
+		const char	*name;
+		uint32_t	count;
+		uint32_t	timeouts;
+		uint32_t	min_us;
+		uint32_t	max_us;
+		uint64_t	total_us;
+		uint32_t	hist[NVM_HIST_BUCKETS];
+};
+
+/* Rows which failed to verify and were tried again */
+struct retry_stats{
+		uint32_t	rows;			// rows retried
+		uint32_t	reread;			// right when read again
+		uint32_t	rewritten;		// right once their page was erased and programmed again
+		uint32_t	failed;			// still wrong
+		uint32_t	slowed;			// retried at a slower PGC than the profile's
+};
+
 class Pic{
 
 	public:
@@ -42,23 +104,61 @@ class Pic{
 		uint8_t			subfamily;
 		char			name[25];
 		memory 			mem;
+		uint32_t		hex_offset;		// address of mem[0] in the .hex files
+		uint32_t		errors;			// write/verify failures, cleared by the caller
+		nvm_stats		erase_stats, row_stats, config_stats;
+		retry_stats		retries;
+		/* progress of the running operation; the terminal bar if not set */
+		void			(*progress_cb)(int percent, void *ctx);
+		void			*progress_ctx;
 
-		Pic(uint8_t sf=0){
-			device_id=0;
-			device_rev=0;
-			subfamily=sf;
-		};
+		Pic(uint8_t sf=0);
 		virtual ~Pic(){};
 
 		virtual void enter_program_mode(void) = 0;
 		virtual void exit_program_mode(void) = 0;
 		virtual bool setup_pe(void) = 0;
+		/* true if a PE set up by a previous session still answers */
+		virtual bool pe_resident(void){return false;};
 		virtual bool read_device_id(void) = 0;
+		/* read the device ID only, right after enter_program_mode() */
+		virtual void probe_device_id(void){read_device_id();};
 		virtual void bulk_erase(void) = 0;
 		virtual void dump_configuration_registers(void) = 0;
+		/* outfile NULL: leave what was read in mem only */
 		virtual void read(char *outfile, uint32_t start=0, uint32_t count=0) = 0;
 		virtual void write(char *infile) = 0;
 		virtual uint8_t blank_check(void) = 0;
+		/* true if the device already holds the image in mem */
+		virtual bool already_programmed(void);
+		/* what mem[addr] reads as when erased; read() leaves such words unfilled */
+		virtual uint16_t erased_value(uint32_t addr){return 0xFFFF;};
+		/* write only the configuration words of the image which differ */
+		virtual void write_configuration(char *infile);
+		/* set up for the given part without a device, false if the
+		 * family has no cost model for --plan */
+		virtual bool plan_setup(const pic_device *dev, plan_model *model){return false;};
+
+		void print_nvm_stats(void);
+		void print_retry_stats(void);
+		unsigned int load_image(char *infile);
+
+	protected:
+		void progress(int percent);
+		void setup_memory(const pic_device *dev, uint32_t program_memory_size);
+
+		/* true while a self-timed NVM operation is in progress */
+		virtual bool nvm_busy(void){return false;};
+		void nvm_begin(void);
+		bool nvm_wait(nvm_stats *stats, uint32_t max_us);
+
+		struct timeval	nvm_start;
+
+		/* around the retry of a row: it runs at the default PGC speed */
+		void retry_begin(void);
+		void retry_end(void);
+
+		unsigned int	retry_clk;
 };
 
 #endif
\ No newline at end of file
@@ -27,8 +27,6 @@
 
 /* delays (in microseconds; nanoseconds are rounded to 1us) */
 #define DELAY_P1   			1		// 200ns
-#define DELAY_P1A			1		// 80ns
-#define DELAY_P1B			1		// 80ns
 #define DELAY_P2			1		// 15ns
 #define DELAY_P3			1		// 15ns
 #define DELAY_P4			1		// 40ns
@@ -43,6 +41,7 @@
 #define DELAY_P11			100000	// 20ms max, guess 10ms
 #define DELAY_P12			100000	// 20ms max, guess 10ms
 #define DELAY_P13			10		// 20us max, guess 10us
+#define DELAY_P13R			1500	// row programming time
 #define DELAY_P14			1		// 1us MAX!
 #define DELAY_P15			1		// 10ns
 #define DELAY_P16			0		// 0s
@@ -54,11 +53,13 @@
 
 #define ENTER_PROGRAM_KEY	0x4D434851
 
+#define RAM_BUFFER			0x1000	// start of data RAM, holds one row for NVM
+
 #define reset_pc() send_cmd(0x040200)
 #define send_nop() send_cmd(0x000000)
 
-static unsigned int counter=0;
-static uint16_t nvmcon;
+static thread_local unsigned int counter=0;
+static thread_local uint16_t nvmcon;
 
 /* Send a 24-bit command to the PIC (LSB first) through a SIX instruction */
 void dspic33ck::send_cmd(uint32_t cmd)
@@ -70,9 +71,9 @@ void dspic33ck::send_cmd(uint32_t cmd)
 	/* send the SIX = 0x0000 instruction */
 	for (i = 0; i < 4; i++) {
 		GPIO_SET(pic_clk);
-		delay_us(DELAY_P1B);
+		delay_clk();
 		GPIO_CLR(pic_clk);
-		delay_us(DELAY_P1A);
+		delay_clk();
 	}
 
 	delay_us(DELAY_P4);
@@ -83,9 +84,9 @@ void dspic33ck::send_cmd(uint32_t cmd)
 			GPIO_SET(pic_data);
 		else
 			GPIO_CLR(pic_data);
-		delay_us(DELAY_P1A);
+		delay_clk();
 		GPIO_SET(pic_clk);
-		delay_us(DELAY_P1B);
+		delay_clk();
 		GPIO_CLR(pic_clk);
 	}
 
@@ -108,9 +109,9 @@ uint16_t dspic33ck::read_data(void)
 			GPIO_SET(pic_data);
 		else
 			GPIO_CLR(pic_data);
-		delay_us(DELAY_P1A);
+		delay_clk();
 		GPIO_SET(pic_clk);
-		delay_us(DELAY_P1B);
+		delay_clk();
 		GPIO_CLR(pic_clk);
 	}
 
@@ -119,9 +120,9 @@ uint16_t dspic33ck::read_data(void)
 	/* idle for 8 clock cycles, waiting for the data to be ready */
 	for (i = 0; i < 8; i++) {
 		GPIO_SET(pic_clk);
-		delay_us(DELAY_P1B);
+		delay_clk();
 		GPIO_CLR(pic_clk);
-		delay_us(DELAY_P1A);
+		delay_clk();
 	}
 
 	delay_us(DELAY_P5);
@@ -131,10 +132,10 @@ uint16_t dspic33ck::read_data(void)
 	/* read a 16-bit data word */
 	for (i = 0; i < 16; i++) {
 		GPIO_SET(pic_clk);
-		delay_us(DELAY_P1B);
+		delay_clk();
 		data |= ( GPIO_LEV(pic_data) & 0x00000001 ) << i;
 		GPIO_CLR(pic_clk);
-		delay_us(DELAY_P1A);
+		delay_clk();
 	}
 
 	delay_us(DELAY_P4A);
@@ -142,6 +143,128 @@ uint16_t dspic33ck::read_data(void)
 	return data;
 }
 
+/* Read NVMCON; returns true while the WR bit is set */
+bool dspic33ck::nvm_busy(void)
+{
+	send_nop();
+	send_cmd(0x804680);
+	send_nop();
+	send_cmd(0x887E60);
+	send_nop();
+	nvmcon = read_data();
+	send_nop();
+	send_nop();
+	send_nop();
+	reset_pc();
+	send_nop();
+	send_nop();
+	send_nop();
+	return (nvmcon & 0x8000) == 0x8000;
+}
+
+/* Read back the 8 locations starting at addr and compare them with mem */
+bool dspic33ck::verify_group(uint32_t addr)
+{
+	uint16_t i;
+	uint32_t data[8], raw_data[6];
+
+	send_cmd(0x200000 | ((addr & 0x00FF0000) >> 12) );	// MOV #<DestAddress23:16>, W0
+	send_cmd(0x8802A0);									// MOV W0, TBLPAG
+	send_cmd(0x200006 | ((addr & 0x0000FFFF) << 4) );	// MOV #<DestAddress15:0>, W6
+
+	/* Fetch the next four memory locations and put them to W0:W5 */
+	send_cmd(0xEB0380);	// CLR W7
+	send_nop();
+	send_cmd(0xBA1B96);
+	send_nop();
+	send_nop();
+	send_nop();
+	send_nop();
+	send_nop();
+	send_cmd(0xBADBB6);
+	send_nop();
+	send_nop();
+	send_nop();
+	send_nop();
+	send_nop();
+	send_cmd(0xBADBD6);
+	send_nop();
+	send_nop();
+	send_nop();
+	send_nop();
+	send_nop();
+	send_cmd(0xBA1BB6);
+	send_nop();
+	send_nop();
+	send_nop();
+	send_nop();
+	send_nop();
+	send_cmd(0xBA1B96);
+	send_nop();
+	send_nop();
+	send_nop();
+	send_nop();
+	send_nop();
+	send_cmd(0xBADBB6);
+	send_nop();
+	send_nop();
+	send_nop();
+	send_nop();
+	send_nop();
+	send_cmd(0xBADBD6);
+	send_nop();
+	send_nop();
+	send_nop();
+	send_nop();
+	send_nop();
+	send_cmd(0xBA0BB6);
+	send_nop();
+	send_nop();
+	send_nop();
+	send_nop();
+	send_nop();
+
+	/* read six data words (16 bits each) */
+	for(i=0; i<6; i++){
+		send_cmd(0x887E60 + i);
+		send_nop();
+		raw_data[i] = read_data();
+		send_nop();
+	}
+
+	send_nop();
+	send_nop();
+	send_nop();
+	reset_pc();
+	send_nop();
+	send_nop();
+	send_nop();
+
+	/* store data correctly */
+	data[0] = raw_data[0];
+	data[1] = raw_data[1] & 0x00FF;
+	data[3] = (raw_data[1] & 0xFF00) >> 8;
+	data[2] = raw_data[2];
+	data[4] = raw_data[3];
+	data[5] = raw_data[4] & 0x00FF;
+	data[7] = (raw_data[4] & 0xFF00) >> 8;
+	data[6] = raw_data[5];
+
+	for(i=0; i<8; i++){
+		if (flags.debug)
+			fprintf(stderr, "\n addr = 0x%06X data = 0x%04X", (addr+i), data[i]);
+
+		if(mem.filled[addr+i] && data[i] != mem.location[addr+i]){
+			errors++;
+			fprintf(stderr,"\n\n ERROR at address %06X: written %04X but %04X read!\n\n",
+							addr+i, mem.location[addr+i], data[i]);
+			return false;
+		}
+
+	}
+	return true;
+}
+
 /* enter program mode */
 void dspic33ck::enter_program_mode(void)
 {
@@ -165,9 +288,9 @@ void dspic33ck::enter_program_mode(void)
 			GPIO_SET(pic_data);
 		else
 			GPIO_CLR(pic_data);
-		delay_us(DELAY_P1A);
+		delay_clk();
 		GPIO_SET(pic_clk);
-		delay_us(DELAY_P1B);
+		delay_clk();
 		GPIO_CLR(pic_clk);
 
 	}
@@ -179,9 +302,9 @@ void dspic33ck::enter_program_mode(void)
 	/* idle for 5 clock cycles */
 	for (i = 0; i < 5; i++) {
 		GPIO_SET(pic_clk);
-		delay_us(DELAY_P1B);
+		delay_clk();
 		GPIO_CLR(pic_clk);
-		delay_us(DELAY_P1A);
+		delay_clk();
 	}
 
 }
@@ -236,36 +359,34 @@ bool dspic33ck::read_device_id(void)
 
 	fprintf(stderr, "devid: 0x%04x , devrev: 0x%04x\n", device_id, device_rev);
 
-	for (unsigned short i=0;i < sizeof(piclist)/sizeof(piclist[0]);i++){
-
-		if (piclist[i].device_id == device_id){
-
-			strcpy(name, piclist[i].name);
-			mem.code_memory_size = piclist[i].code_memory_size;
-			if (mem.code_memory_size == 0x005EFF)
-			{
-				mem.program_memory_size = 0x005FFF;
-			}
-			else
-			{
-				mem.program_memory_size = 0x00AFFF;
-			}
-			if (i <= 5)
-			{
-				subfamily = SF_DSPIC33CKxxMP;
-			}
-			else
-			{
-				subfamily = SF_DSPIC33CKxxMC;
-			}
-			if (flags.debug)
-				fprintf(stderr, "program memory: 0x%06x, subfamily: %d\n", mem.program_memory_size, subfamily);
-
-			mem.location = (uint16_t*) calloc(mem.program_memory_size,sizeof(uint16_t));
-			mem.filled = (bool*) calloc(mem.program_memory_size,sizeof(bool));
-			found = 1;
-			break;
+	const pic_device *dev = devdb_lookup(DB_DSPIC33CK, device_id);
+	if(dev){
+		strcpy(name, dev->name);
+		mem.code_memory_size = dev->code_memory_size;
+		if (mem.code_memory_size == 0x005EFF)
+		{
+			mem.program_memory_size = 0x005FFF;
+		}
+		else
+		{
+			mem.program_memory_size = 0x00AFFF;
 		}
+		if ((device_id & 0xFF00) == 0x8E00)	// dsPIC33CKxxMP IDs
+		{
+			subfamily = SF_DSPIC33CKxxMP;
+		}
+		else
+		{
+			subfamily = SF_DSPIC33CKxxMC;
+		}
+		if (flags.debug)
+			fprintf(stderr, "program memory: 0x%06x, subfamily: %d\n", mem.program_memory_size, subfamily);
+
+		free(mem.location);	// left by a previous read_device_id()
+		free(mem.filled);
+		mem.location = (uint16_t*) calloc(mem.program_memory_size,sizeof(uint16_t));
+		mem.filled = (bool*) calloc(mem.program_memory_size,sizeof(bool));
+		found = 1;
 	}
 
 	return found;
@@ -384,7 +505,7 @@ uint8_t dspic33ck::blank_check(void)
 
 		if(counter != addr*100/mem.code_memory_size){
 			counter = addr*100/mem.code_memory_size;
-			fprintf(stderr, "\b\b\b\b\b[%2d%%]", counter);	
+			progress(counter);	
 		}
 
 		for(i=0; i<8; i++){
@@ -441,28 +562,16 @@ void dspic33ck::bulk_erase(void)
 	//	send_cmd(0xA8F1A1);
 	//else //if (subfamily == SF_DSPIC33CKxxMC)
 		send_cmd(0xA8E8D1); // There seems to be something wrong with the official documentation, it says it should be 0xA8F1A1 for xxMP chips, but only 0xA8E8D1 works, as for MC chips.
+		nvm_begin();
 	send_nop();
 	send_nop();
 	send_nop();
 
-	delay_us(DELAY_P11);
-
 	/* wait while the erase operation completes */
-	do{
-		send_nop();
-		send_cmd(0x804680);
-		send_nop();		
-		send_cmd(0x887E60);
-		send_nop();
-		nvmcon = read_data();
-		send_nop();
-		send_nop();
-		send_nop();
-		reset_pc();
-		send_nop();
-		send_nop();
-		send_nop();
-	} while((nvmcon & 0x8000) == 0x8000);
+	if(!nvm_wait(&erase_stats, DELAY_P11)){
+		if(flags.client) fprintf(stdout, "@ERR");
+		return;
+	}
 	
 	if(flags.client) fprintf(stdout, "@FIN");
 }
@@ -605,7 +714,7 @@ void dspic33ck::read(char *outfile, uint32_t start, uint32_t count)
 			if(flags.client)
 				fprintf(stdout,"@%03d", counter);
 			if(!flags.debug)
-				fprintf(stderr,"\b\b\b\b\b[%2d%%]", counter);
+				progress(counter);
 		}
 
 		/* TODO: checksum */
@@ -707,25 +816,29 @@ void dspic33ck::read(char *outfile, uint32_t start, uint32_t count)
 
 	if(!flags.debug) cerr << "\b\b\b\b\b";
 	if(flags.client) fprintf(stdout, "@FIN");
-	write_inhx(&mem, outfile);
+	if(outfile)
+		write_inhx(&mem, outfile);
 }
 
 /* Write contents of the .hex file to the PIC */
 void dspic33ck::write(char *infile)
 {
-	uint16_t i,j,k;
+	uint16_t i,j,k,p;
 	bool skip;
-	uint32_t data[8],raw_data[6];
-	uint32_t addr = 0;
+	uint32_t data[8];
+	uint32_t addr = 0, erase_errors;
 
 	unsigned int filled_locations=1;
 
 	const char *regname[] = {"FSEC","FBSLIM","FSIGN","FOSCSEL","FOSC","FWDT","FPOR","FICD","FDMTIVTL","FDMTIVTH","FDMTCNTL","FDMTCNTH","FDMT","FDEVOPT","FALTREG"};
 
-	filled_locations = read_inhx(infile, &mem);
+	filled_locations = load_image(infile);
 	if(!filled_locations) return;
 
+	erase_errors = errors;
 	bulk_erase();
+	if(errors != erase_errors)
+		return;		// bulk_erase() has sent @ERR
 
 	/* Exit reset vector */
 	send_nop();
@@ -753,46 +866,48 @@ void dspic33ck::write(char *infile)
 			continue;
 		}
 
-		send_cmd(0x200FAC);
-		send_cmd(0x8802AC);
-
-		for(j=0;j<4;j++){
-			if (mem.filled[addr+j]) data[j] = mem.location[addr+j];
-			else data[j] = 0xFFFF;
-			if (flags.debug)
-				fprintf(stderr,"\n  Writing 0x%04X to address 0x%06X ", data[j], addr+j );
-		}
-
-		send_cmd(0x200000 | (data[0] << 4));										// MOV #<LSW0>, W0
-		send_cmd(0x200001 | (0x00FFFF & ((data[3] << 8) | (data[1] & 0x00FF))) <<4);// MOV #<MSB1:MSB0>, W1
-		send_cmd(0x200002 | (data[2] << 4));										// MOV #<LSW1>, W2
-
-		/* set W6+W7 and load latches */
-		send_cmd(0xEB0300);
-		send_nop();
-		send_cmd(0xEB0380);
-		send_nop();
-		send_cmd(0xBB0BB6);
-		send_nop();
-		send_nop();
-		send_cmd(0xBBDBB6);
-		send_nop();
-		send_nop();
-		send_cmd(0xBBEBB6);
-		send_nop();
 		send_nop();
-		send_cmd(0xBB0B96);
+		reset_pc();
 		send_nop();
+
+		/* Stage the row in the RAM buffer, in compressed format */
+		send_cmd(0x200007 | (RAM_BUFFER << 4));	// MOV #RAM_BUFFER, W7
 		send_nop();
 
+		for(p=0; p<32; p++){
+
+			for(j=0;j<8;j++){
+				if (mem.filled[addr+p*8+j]) data[j] = mem.location[addr+p*8+j];
+				else data[j] = 0xFFFF;
+				if (flags.debug)
+					fprintf(stderr,"\n  Writing 0x%04X to address 0x%06X ", data[j], addr+p*8+j );
+			}
+
+			send_cmd(0x200000 | (data[0] << 4));										// MOV #<LSW0>, W0
+			send_cmd(0x200001 | (0x00FFFF & ((data[3] << 8) | (data[1] & 0x00FF))) <<4);// MOV #<MSB1:MSB0>, W1
+			send_cmd(0x200002 | (data[2] << 4));										// MOV #<LSW1>, W2
+			send_cmd(0x200003 | (data[4] << 4));										// MOV #<LSW2>, W3
+			send_cmd(0x200004 | (0x00FFFF & ((data[7] << 8) | (data[5] & 0x00FF))) <<4);// MOV #<MSB3:MSB2>, W4
+			send_cmd(0x200005 | (data[6] << 4));										// MOV #<LSW3>, W5
+
+			for(j=0; j<6; j++)
+				send_cmd(0x781B80 | j);		// MOV Wj, [W7++]
+		}
+
+		/* Point NVMSRCADRH:NVMSRCADRL to the RAM buffer */
+		send_cmd(0x200000 | (RAM_BUFFER << 4));	// MOV #RAM_BUFFER, W0
+		send_cmd(0x8846C0);						// MOV W0, NVMSRCADRL
+		send_cmd(0x200000);						// MOV #0, W0
+		send_cmd(0x8846D0);						// MOV W0, NVMSRCADRH
+
 		/* Set the NVMADRU/NVMADR register-pair to point to the correct row */
 		send_cmd(0x200003 | ((addr & 0x0000FFFF) << 4));
 		send_cmd(0x200004 | ((addr & 0x00FF0000) >> 12));
 		send_cmd(0x884693);
 		send_cmd(0x8846A4);
 
-		/* Set the NVMCON to program two instruction words */
-		send_cmd(0x24001A);
+		/* Set the NVMCON to program a row from compressed RAM data */
+		send_cmd(0x24202A);
 		send_nop();
 		send_cmd(0x88468A);
 		send_nop();
@@ -803,42 +918,40 @@ void dspic33ck::write(char *infile)
 		send_cmd(0x8846B1);
 		send_cmd(0x200AA1);
 		send_cmd(0x8846B1);
-		//if (subfamily == SF_DSPIC33CKxxMP)
-		//	send_cmd(0xA8F1A1);
-		//else //if (subfamily == SF_DSPIC33CKxxMC)
-			send_cmd(0xA8E8D1); // There seems to be something wrong with the official documentation, it says it should be 0xA8F1A1 for xxMP chips, but only 0xA8E8D1 works, as for MC chips.
+		send_cmd(0xA8E8D1);
+		nvm_begin();
 		send_nop();
 		send_nop();
 		send_nop();
 
-		delay_us(DELAY_P13);
-
 		// Wait until finished
-		do{
-			send_nop();
-			send_cmd(0x804680);
-			send_nop();
-			send_cmd(0x887E60);
-			send_nop();
-			nvmcon = read_data();
-			send_nop();
-			send_nop();
-			send_nop();
-			reset_pc();
-			send_nop();
-			send_nop();
-			send_nop();
-		} while((nvmcon & 0x8000) == 0x8000);
+		if(!nvm_wait(&row_stats, DELAY_P13R)){
+			if(flags.client) fprintf(stdout, "@ERR");
+			return;
+		}
+
+		/* Verify the row just programmed, abort on mismatch */
+		if(flags.row_verify){
+			for(k=0; k<256; k+=8){
+				if(!mem.filled[addr+k] && !mem.filled[addr+k+2] &&
+				   !mem.filled[addr+k+4] && !mem.filled[addr+k+6])
+					continue;
+				if(!verify_group(addr+k)){
+					if(flags.client) fprintf(stdout, "@ERR");
+					return;
+				}
+			}
+		}
+
+		addr += 256;
 
 		if(counter != addr*100/filled_locations){
 			if(flags.client)
 				fprintf(stdout,"@%03d", (addr*100/(filled_locations+0x100)));
 			if(!flags.debug)
-				fprintf(stderr,"\b\b\b\b\b[%2d%%]", addr*100/(filled_locations+0x100));
+				progress(addr*100/(filled_locations+0x100));
 			counter = addr*100/filled_locations;
 		}
-
-		addr += 4;
 	};
 
 	if(!flags.debug) cerr << "\b\b\b\b\b\b";
@@ -915,30 +1028,18 @@ void dspic33ck::write(char *infile)
 			//	send_cmd(0xA8F1A1);
 			//else //if (subfamily == SF_DSPIC33CKxxMC)
 				send_cmd(0xA8E8D1); // There seems to be something wrong with the official documentation, it says it should be 0xA8F1A1 for xxMP chips, but only 0xA8E8D1 works, as for MC chips.
+				nvm_begin();
 			send_nop();
 			send_nop();
 			send_nop();
 			send_nop();
 			send_nop();
 
-			delay_us(DELAY_P20);
-
 			// Wait until finished
-			do{
-				send_nop();
-				send_cmd(0x804680);
-				send_nop();
-				send_cmd(0x887E60);
-				send_nop();
-				nvmcon = read_data();
-				send_nop();
-				send_nop();
-				send_nop();
-				reset_pc();
-				send_nop();
-				send_nop();
-				send_nop();
-			} while((nvmcon & 0x8000) == 0x8000);
+			if(!nvm_wait(&config_stats, DELAY_P20)){
+				if(flags.client) fprintf(stdout, "@ERR");
+				return;
+			}
 
 			if (flags.debug)
 			{
@@ -956,7 +1057,7 @@ void dspic33ck::write(char *infile)
 	delay_us(100000);
 
 	/* VERIFY CODE MEMORY */
-	if(!flags.noverify){
+	if(!flags.noverify && !flags.row_verify){
 		if(!flags.debug) cerr << "[ 0%]";
 		if(flags.client) fprintf(stdout, "@000");
 		counter = 0;
@@ -979,105 +1080,13 @@ void dspic33ck::write(char *infile)
 
 			if(skip) continue;
 
-			send_cmd(0x200000 | ((addr & 0x00FF0000) >> 12) );	// MOV #<DestAddress23:16>, W0
-			send_cmd(0x8802A0);									// MOV W0, TBLPAG
-			send_cmd(0x200006 | ((addr & 0x0000FFFF) << 4) );	// MOV #<DestAddress15:0>, W6
-
-			/* Fetch the next four memory locations and put them to W0:W5 */
-			send_cmd(0xEB0380);	// CLR W7
-			send_nop();
-			send_cmd(0xBA1B96);
-			send_nop();
-			send_nop();
-			send_nop();
-			send_nop();
-			send_nop();
-			send_cmd(0xBADBB6);
-			send_nop();
-			send_nop();
-			send_nop();
-			send_nop();
-			send_nop();
-			send_cmd(0xBADBD6);
-			send_nop();
-			send_nop();
-			send_nop();
-			send_nop();
-			send_nop();
-			send_cmd(0xBA1BB6);
-			send_nop();
-			send_nop();
-			send_nop();
-			send_nop();
-			send_nop();
-			send_cmd(0xBA1B96);
-			send_nop();
-			send_nop();
-			send_nop();
-			send_nop();
-			send_nop();
-			send_cmd(0xBADBB6);
-			send_nop();
-			send_nop();
-			send_nop();
-			send_nop();
-			send_nop();
-			send_cmd(0xBADBD6);
-			send_nop();
-			send_nop();
-			send_nop();
-			send_nop();
-			send_nop();
-			send_cmd(0xBA0BB6);
-			send_nop();
-			send_nop();
-			send_nop();
-			send_nop();
-			send_nop();
-
-			/* read six data words (16 bits each) */
-			for(i=0; i<6; i++){
-				send_cmd(0x887E60 + i);
-				send_nop();
-				raw_data[i] = read_data();
-				send_nop();
-			}
-
-			send_nop();
-			send_nop();
-			send_nop();
-			reset_pc();
-			send_nop();
-			send_nop();
-			send_nop();
-
-			/* store data correctly */
-			data[0] = raw_data[0];
-			data[1] = raw_data[1] & 0x00FF;
-			data[3] = (raw_data[1] & 0xFF00) >> 8;
-			data[2] = raw_data[2];
-			data[4] = raw_data[3];
-			data[5] = raw_data[4] & 0x00FF;
-			data[7] = (raw_data[4] & 0xFF00) >> 8;
-			data[6] = raw_data[5];
-
-			for(i=0; i<8; i++){
-				if (flags.debug)
-					fprintf(stderr, "\n addr = 0x%06X data = 0x%04X", (addr+i), data[i]);
-
-				if(mem.filled[addr+i] && data[i] != mem.location[addr+i]){
-					fprintf(stderr,"\n\n ERROR at address %06X: written %04X but %04X read!\n\n",
-									addr+i, mem.location[addr+i], data[i]);
-					return;
-				}
-
-			}
+			if(!verify_group(addr)) return;
 
 			if(counter != addr*100/filled_locations){
 				if(flags.client)
 					fprintf(stdout,"@%03d", (addr*100/(filled_locations+0x100)));
 				if(!flags.debug)
-					fprintf(stderr,"\b\b\b\b\b[%2d%%]", addr*100/(filled_locations+0x100));
+					progress(addr*100/(filled_locations+0x100));
 				counter = addr*100/filled_locations;
 			}
 		}
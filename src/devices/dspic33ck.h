@@ -40,25 +40,13 @@ class dspic33ck : public Pic{
 		void read(char *outfile, uint32_t start, uint32_t count);
 		void write(char *infile);
 		uint8_t blank_check(void);
+		uint16_t erased_value(uint32_t addr){
+			return (addr < mem.code_memory_size && (addr & 1)) ? 0x00FF : 0xFFFF;
+		};
 
 	protected:
 		void send_cmd(uint32_t cmd);
 		uint16_t read_data(void);
-
-		/*
-		* DEVICES SECTION
-		*                       ID       NAME           	  MEMSIZE
-		*/
-		pic_device piclist[12] = {{0x8E00, "dsPIC33CK32MP102", 0x005EFF},
-								  {0x8E01, "dsPIC33CK32MP103", 0x005EFF},
-								  {0x8E02, "dsPIC33CK32MP105", 0x005EFF},
-								  {0x8E10, "dsPIC33CK64MP102", 0x00AEFF},
-								  {0x8E11, "dsPIC33CK64MP103", 0x00AEFF},
-								  {0x8E12, "dsPIC33CK64MP105", 0x00AEFF},
-								  {0x9900, "dsPIC33CK32MC102", 0x005EFF},
-								  {0x9901, "dsPIC33CK32MC103", 0x005EFF},
-								  {0x9902, "dsPIC33CK32MC105", 0x005EFF},
-								  {0x9910, "dsPIC33CK64MC102", 0x00AEFF},
-								  {0x9911, "dsPIC33CK64MC103", 0x00AEFF},
-								  {0x9912, "dsPIC33CK64MC105", 0x00AEFF} };
+		bool nvm_busy(void);
+		bool verify_group(uint32_t addr);
 };
@@ -27,8 +27,6 @@
 
 /* delays (in microseconds; nanoseconds are rounded to 1us) */
 #define DELAY_P1   			1		// 200ns
-#define DELAY_P1A			1		// 80ns
-#define DELAY_P1B			1		// 80ns
 #define DELAY_P2			1		// 15ns
 #define DELAY_P3			1		// 15ns
 #define DELAY_P4			1		// 40ns
@@ -56,27 +54,49 @@
 #define DELAY_P20			25000	// 25ms
 #define DELAY_P21			1		// 1us - 500us MAX!
 
+#define DELAY_P11	((subfamily == SF_DSPIC33E) ? DELAY_P11_DSPIC33E : DELAY_P11_PIC24FJ)
+#define DELAY_P12	((subfamily == SF_DSPIC33E) ? DELAY_P12_DSPIC33E : DELAY_P12_PIC24FJ)
+#define DELAY_P13	((subfamily == SF_DSPIC33E) ? DELAY_P13_DSPIC33E : DELAY_P13_PIC24FJ)
+
 #define ENTER_PROGRAM_KEY	0x4D434851
 
-#define reset_pc() send_cmd(0x040200)
+#define ROW_SIX				(32*6)		// MOV commands loading one row of latches
+#define TBLRD_IDLE			0xFFFFFFFF	// TBLPAG/W6 not set up for reading
+#define PC_RESET_SIX		1024		// SIX commands allowed between PC resets
+#define PAGE_ADDR			2048		// addresses in an erase page (8 rows)
+#define RESUME_CHECK_ROWS	2			// rows verified again before resuming a write
+#define CONFIG_ADDR			0x00F80004	// first configuration register
+
+/* cost of the ICSP instructions, for plan_setup() */
+#define SIX_CLOCKS			28			// PGC cycles of a SIX
+#define SIX_DELAYS			2			// and its delay_us() calls
+#define REGOUT_CLOCKS		28
+#define REGOUT_DELAYS		3
+#define ROW_SIX_COUNT		1040		// SIX commands in program_row()
+#define GROUP_SIX_COUNT		68			// tblrd_fetch(): SIX and REGOUT per 8 locations
+#define GROUP_REGOUT_COUNT	6
+#define CONFIG_SIX_COUNT	18			// program_config()
+
+#define reset_pc() do{ send_cmd(0x040200); six_count = 0; }while(0)
 #define send_nop() send_cmd(0x000000)
 
-static unsigned int counter=0;
-static uint16_t nvmcon;
+static thread_local unsigned int counter=0;
+static thread_local uint16_t nvmcon;
+static thread_local unsigned int six_count=0;
 
 /* Send a 24-bit command to the PIC (LSB first) through a SIX instruction */
 void dspic33e::send_cmd(uint32_t cmd)
 {
 	uint8_t i;
 
-	GPIO_CLR(pic_data);
+	PGD_CLR();
 
 	/* send the SIX = 0x0000 instruction */
 	for (i = 0; i < 4; i++) {
 		GPIO_SET(pic_clk);
-		delay_us(DELAY_P1B);
+		delay_clk();
 		GPIO_CLR(pic_clk);
-		delay_us(DELAY_P1A);
+		delay_clk();
 	}
 
 	delay_us(DELAY_P4);
@@ -84,17 +104,18 @@ void dspic33e::send_cmd(uint32_t cmd)
 	/* send the 24-bit command */
 	for (i = 0; i < 24; i++) {
 		if ( (cmd >> i) & 0x00000001 )
-			GPIO_SET(pic_data);
+			PGD_SET();
 		else
-			GPIO_CLR(pic_data);
-		delay_us(DELAY_P1A);
+			PGD_CLR();
+		delay_clk();
 		GPIO_SET(pic_clk);
-		delay_us(DELAY_P1B);
+		delay_clk();
 		GPIO_CLR(pic_clk);
 	}
 
 	delay_us(DELAY_P4A);
 
+	six_count++;
 }
 
 /* Send five NOPs (should be with a frequency greater than 2MHz...) */
@@ -102,14 +123,14 @@ inline void dspic33e::send_prog_nop(void)
 {
 	uint8_t i;
 
-	GPIO_CLR(pic_data);
+	PGD_CLR();
 
 	/* send 5 NOP commands */
 	for (i = 0; i < 140; i++) {
 		GPIO_SET(pic_clk);
-		delay_us(DELAY_P1A);
+		delay_clk();
 		GPIO_CLR(pic_clk);
-		delay_us(DELAY_P1B);
+		delay_clk();
 	}
 }
 
@@ -118,19 +139,20 @@ uint16_t dspic33e::read_data(void)
 {
 	uint8_t i;
 	uint16_t data = 0;
+	uint32_t levels[16];
 
-	GPIO_CLR(pic_data);
+	PGD_CLR();
 	GPIO_CLR(pic_clk);
 
 	/* send the REGOUT=0x0001 instruction */
 	for (i = 0; i < 4; i++) {
 		if ( (0x0001 >> i) & 0x001 )
-			GPIO_SET(pic_data);
+			PGD_SET();
 		else
-			GPIO_CLR(pic_data);
-		delay_us(DELAY_P1A);
+			PGD_CLR();
+		delay_clk();
 		GPIO_SET(pic_clk);
-		delay_us(DELAY_P1B);
+		delay_clk();
 		GPIO_CLR(pic_clk);
 	}
 
@@ -139,29 +161,488 @@ uint16_t dspic33e::read_data(void)
 	/* idle for 8 clock cycles, waiting for the data to be ready */
 	for (i = 0; i < 8; i++) {
 		GPIO_SET(pic_clk);
-		delay_us(DELAY_P1B);
+		delay_clk();
 		GPIO_CLR(pic_clk);
-		delay_us(DELAY_P1A);
+		delay_clk();
 	}
 
 	delay_us(DELAY_P5);
 
-	GPIO_IN(pic_data);
+	pgd_in();
 
 	/* read a 16-bit data word */
 	for (i = 0; i < 16; i++) {
 		GPIO_SET(pic_clk);
-		delay_us(DELAY_P1B);
-		data |= ( GPIO_LEV(pic_data) & 0x00000001 ) << i;
+		delay_clk();
+		if(gang_count)
+			levels[i] = GPIO_LEV_ALL();
+		else
+			data |= ( GPIO_LEV(pic_data) & 0x00000001 ) << i;
 		GPIO_CLR(pic_clk);
-		delay_us(DELAY_P1A);
+		delay_clk();
 	}
 
 	delay_us(DELAY_P4A);
-	GPIO_OUT(pic_data);
+	pgd_out();
+
+	/* gang mode: keep the word of every target, return the first one */
+	if(gang_count){
+		gang_split(levels, 16, gang_data);
+		data = gang_data[0];
+	}
 	return data;
 }
 
+/* Store the six words read from W0:W5 as eight memory locations */
+static void unpack_group(uint16_t *raw_data, uint16_t *data)
+{
+	data[0] = raw_data[0];
+	data[1] = raw_data[1] & 0x00FF;
+	data[3] = (raw_data[1] & 0xFF00) >> 8;
+	data[2] = raw_data[2];
+	data[4] = raw_data[3];
+	data[5] = raw_data[4] & 0x00FF;
+	data[7] = (raw_data[4] & 0xFF00) >> 8;
+	data[6] = raw_data[5];
+}
+
+/* Point TBLPAG:W6 to addr, unless the previous fetch already left them there */
+void dspic33e::tblrd_seek(uint32_t addr)
+{
+	if(addr == tblrd_addr)
+		return;
+
+	send_cmd(0x200000 | ((addr & 0x00FF0000) >> 12) );	// MOV #<DestAddress23:16>, W0
+	send_cmd(0x8802A0);									// MOV W0, TBLPAG
+	send_cmd(0x200006 | ((addr & 0x0000FFFF) << 4) );	// MOV #<DestAddress15:0>, W6
+	tblrd_addr = addr;
+}
+
+/*
+ * Read the four instructions (eight words) pointed by TBLPAG:W6 and advance.
+ * W6 is left pointing to the next group, so consecutive fetches only need a
+ * new tblrd_seek() when crossing a 64K page; the PC is reset only once every
+ * PC_RESET_SIX commands instead of after each group.
+ */
+void dspic33e::tblrd_fetch(uint16_t *data)
+{
+	uint16_t raw_data[6];
+	int i, t;
+
+	/* Fetch the next four memory locations and put them to W0:W5 */
+	send_cmd(0xEB0380);	// CLR W7
+	send_nop();
+	send_cmd(0xBA1B96);
+	send_nop();
+	send_nop();
+	send_nop();
+	send_nop();
+	send_nop();
+	send_cmd(0xBADBB6);
+	send_nop();
+	send_nop();
+	send_nop();
+	send_nop();
+	send_nop();
+	send_cmd(0xBADBD6);
+	send_nop();
+	send_nop();
+	send_nop();
+	send_nop();
+	send_nop();
+	send_cmd(0xBA1BB6);
+	send_nop();
+	send_nop();
+	send_nop();
+	send_nop();
+	send_nop();
+	send_cmd(0xBA1B96);
+	send_nop();
+	send_nop();
+	send_nop();
+	send_nop();
+	send_nop();
+	send_cmd(0xBADBB6);
+	send_nop();
+	send_nop();
+	send_nop();
+	send_nop();
+	send_nop();
+	send_cmd(0xBADBD6);
+	send_nop();
+	send_nop();
+	send_nop();
+	send_nop();
+	send_nop();
+	send_cmd(0xBA0BB6);
+	send_nop();
+	send_nop();
+	send_nop();
+	send_nop();
+	send_nop();
+
+	/* read six data words (16 bits each) */
+	for(i=0; i<6; i++){
+		send_cmd(0x887C40 + i);
+		send_nop();
+		raw_data[i] = read_data();
+		for(t=0; t<gang_count; t++)
+			gang_raw[t][i] = gang_data[t];
+		send_nop();
+	}
+
+	tblrd_addr += 8;
+	if((tblrd_addr & 0x0000FFFF) == 0)	// W6 wrapped, TBLPAG must be updated
+		tblrd_addr = TBLRD_IDLE;
+
+	if(six_count > PC_RESET_SIX){
+		send_nop();
+		send_nop();
+		send_nop();
+		reset_pc();
+		send_nop();
+		send_nop();
+		send_nop();
+	}
+
+	unpack_group(raw_data, data);
+}
+
+/* Read NVMCON; returns true while the WR bit is set */
+bool dspic33e::nvm_busy(void)
+{
+	int t;
+
+	send_nop();
+	send_cmd(0x803940);
+	send_nop();
+	send_cmd(0x887C40);
+	send_nop();
+	nvmcon = read_data();
+	send_nop();
+	send_nop();
+	send_nop();
+	reset_pc();
+	send_nop();
+	send_nop();
+	send_nop();
+
+	/* gang mode: busy until every target still in the run is done */
+	for(t=0; t<gang_count; t++)
+		if(!(gang_fail & (1 << t)) && (gang_data[t] & 0x8000))
+			return true;
+	if(gang_count)
+		return false;
+
+	return (nvmcon & 0x8000) == 0x8000;
+}
+
+/* Compare the 8 locations starting at addr with mem, using the table read
+ * pointers left by the previous call when possible */
+bool dspic33e::verify_group(uint32_t addr, bool report)
+{
+	uint16_t i;
+	int t;
+	uint16_t data[8];
+
+	tblrd_seek(addr);
+	tblrd_fetch(data);
+
+	/* gang mode: drop failing targets, give up only when none is left */
+	if(gang_count){
+		for(t=0; t<gang_count; t++){
+			if(gang_fail & (1 << t))
+				continue;
+			unpack_group(gang_raw[t], data);
+			for(i=0; i<8; i++)
+				if(mem.filled[addr+i] && data[i] != mem.location[addr+i]){
+					fprintf(stderr,"\n\n ERROR on target %d at address %06X: written %04X but %04X read!\n\n",
+									t, addr+i, mem.location[addr+i], data[i]);
+					gang_fail |= 1 << t;
+					break;
+				}
+		}
+		return gang_fail != (uint32_t)((1 << gang_count) - 1);
+	}
+
+	for(i=0; i<8; i++){
+		if (flags.debug)
+			fprintf(stderr, "\n addr = 0x%06X data = 0x%04X", (addr+i), data[i]);
+
+		if(mem.filled[addr+i] && data[i] != mem.location[addr+i]){
+			if(!report)
+				return false;
+			errors++;
+			fprintf(stderr,"\n\n ERROR at address %06X: written %04X but %04X read!\n\n",
+							addr+i, mem.location[addr+i], data[i]);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/* Compare the filled groups of a row, reporting nothing */
+bool dspic33e::verify_row(uint32_t row)
+{
+	uint32_t k;
+
+	for(k=row; k<row+256; k+=8){
+		if(!mem.filled[k] && !mem.filled[k+2] &&
+		   !mem.filled[k+4] && !mem.filled[k+6])
+			continue;
+		if(!verify_group(k, false))
+			return false;
+	}
+	return true;
+}
+
+/* Verify a group; on a mismatch, try to recover its row before reporting it */
+bool dspic33e::check_group(uint32_t addr, uint32_t upto)
+{
+	if(gang_count || !flags.retries)
+		return verify_group(addr);
+
+	if(verify_group(addr, false))
+		return true;
+	if(recover_row(addr & ~0xFF, upto)){
+		tblrd_addr = TBLRD_IDLE;
+		return true;
+	}
+
+	errors++;
+	fprintf(stderr,"\n\n ERROR: row %06X still does not verify after %d retries!\n\n",
+					addr & ~0xFF, flags.retries);
+	return false;
+}
+
+/*
+ * Recover a row which does not verify. It is read again first, as a fast
+ * PGC may just have garbled the read; if it is really wrong, its page is
+ * erased and the rows of the page written so far (below upto) are
+ * programmed again.
+ */
+bool dspic33e::recover_row(uint32_t row, uint32_t upto)
+{
+	uint32_t cmds[ROW_SIX];
+	uint32_t page, r;
+	int attempt;
+	bool ok = false;
+
+	retry_begin();
+	page = row & ~(PAGE_ADDR - 1);
+
+	for(attempt=0; attempt < flags.retries && !ok; attempt++){
+		send_nop();
+		reset_pc();
+		send_nop();
+		tblrd_addr = TBLRD_IDLE;
+		if(verify_row(row)){
+			retries.reread++;
+			ok = true;
+			break;
+		}
+
+		if(flags.debug)
+			fprintf(stderr, "\n Row %06X: erasing and programming page %06X again\n", row, page);
+		if(!erase_page(page))
+			continue;
+		for(r=page; r < page + PAGE_ADDR && r < upto; r += 256){
+			if(prepare_row(r, cmds) != r)
+				continue;
+			program_row(r, cmds);
+			if(!nvm_wait(&row_stats, DELAY_P13))
+				break;
+		}
+
+		tblrd_addr = TBLRD_IDLE;
+		ok = true;
+		for(r=page; r < page + PAGE_ADDR && r < upto && ok; r += 256)
+			ok = verify_row(r);
+		if(ok)
+			retries.rewritten++;
+	}
+
+	if(!ok)
+		retries.failed++;
+	retry_end();
+	return ok;
+}
+
+/*
+ * Where a journaled write of this image can go on from, 0 to start over.
+ * The last rows written before the interrupted one must still verify. The
+ * interrupted row may be half programmed, so its page is erased and the
+ * write goes on from the start of the page.
+ */
+uint32_t dspic33e::resume_point(uint32_t crc)
+{
+	uint32_t next, page, row, k;
+	int checked = 0;
+
+	next = journal_load(this, crc);
+	if(!next)
+		return 0;
+	page = (next < mem.code_memory_size) ? (next & ~(PAGE_ADDR - 1)) : next;
+
+	send_nop();
+	reset_pc();
+	send_nop();
+	tblrd_addr = TBLRD_IDLE;
+	for(row = page; row > 0 && checked < RESUME_CHECK_ROWS; ){
+		row -= 256;
+		for(k=row; k<row+256 && !mem.filled[k]; k++);
+		if(k == row+256)
+			continue;
+		if(!verify_row(row)){
+			fprintf(stderr, "Row %06X does not verify, starting over\n", row);
+			return 0;
+		}
+		checked++;
+	}
+
+	if(page < mem.code_memory_size && !erase_page(page))
+		return 0;
+	tblrd_addr = TBLRD_IDLE;
+
+	fprintf(stderr, "Resuming the interrupted write at %06X\n", page);
+	return page;
+}
+
+/*
+ * Find the first row at or after addr containing data and pack it into the
+ * MOV #lit,Wn commands that load W0:W5 for each of its 32 latch groups.
+ * Returns the row address, or code_memory_size if there is nothing left.
+ */
+uint32_t dspic33e::prepare_row(uint32_t addr, uint32_t *cmds)
+{
+	uint32_t data[8];
+	uint16_t j, k, p;
+	bool skip;
+
+	for(; addr < mem.code_memory_size; addr += 256){
+		skip = 1;
+		for(k=0; k<256; k+=2)
+			if(mem.filled[addr+k]) skip = 0;
+		if(!skip)
+			break;
+	}
+	if(addr >= mem.code_memory_size)
+		return mem.code_memory_size;
+
+	for(p=0; p<32; p++){
+
+		for(j=0;j<8;j++){
+			if (mem.filled[addr+p*8+j]) data[j] = mem.location[addr+p*8+j];
+			else data[j] = 0xFFFF;
+			if(flags.debug)
+				fprintf(stderr,"\n  Writing 0x%04X to address 0x%06X ", data[j], addr+p*8+j );
+		}
+
+		cmds[p*6+0] = 0x200000 | (data[0] << 4);										// MOV #<LSW0>, W0
+		cmds[p*6+1] = 0x200001 | (0x00FFFF & ((data[3] << 8) | (data[1] & 0x00FF))) <<4;	// MOV #<MSB1:MSB0>, W1
+		cmds[p*6+2] = 0x200002 | (data[2] << 4);										// MOV #<LSW1>, W2
+		cmds[p*6+3] = 0x200003 | (data[4] << 4);										// MOV #<LSW2>, W3
+		cmds[p*6+4] = 0x200004 | (0x00FFFF & ((data[7] << 8) | (data[5] & 0x00FF))) <<4;	// MOV #<MSB3:MSB2>, W4
+		cmds[p*6+5] = 0x200005 | (data[6] << 4);										// MOV #<LSW3>, W5
+	}
+
+	return addr;
+}
+
+/* Load the latches with a packed row and start programming it */
+void dspic33e::program_row(uint32_t addr, uint32_t *cmds)
+{
+	uint16_t j, p;
+
+	/* Set the NVMADRU/NVMADR register-pair to point to the correct row */
+	send_cmd(0x200002 | ((addr & 0x0000FFFF) << 4) );
+	send_cmd(0x200003 | ((addr & 0x00FF0000) >> 12) );
+	send_cmd(0x883963);
+	send_cmd(0x883952);
+
+	send_cmd(0x200FAC);
+	send_cmd(0x8802AC);
+	send_cmd(0x200007);
+
+	for(p=0; p<32; p++){
+
+		for(j=0; j<6; j++)
+			send_cmd(cmds[p*6+j]);
+
+		/* set_W6_and_load_latches */
+		send_cmd(0xEB0300);
+		send_nop();
+		send_cmd(0xBB0BB6);
+		send_nop();
+		send_nop();
+		send_cmd(0xBBDBB6);
+		send_nop();
+		send_nop();
+		send_cmd(0xBBEBB6);
+		send_nop();
+		send_nop();
+		send_cmd(0xBB1BB6);
+		send_nop();
+		send_nop();
+		send_cmd(0xBB0BB6);
+		send_nop();
+		send_nop();
+		send_cmd(0xBBDBB6);
+		send_nop();
+		send_nop();
+		send_cmd(0xBBEBB6);
+		send_nop();
+		send_nop();
+		send_cmd(0xBB1BB6);
+		send_nop();
+		send_nop();
+	}
+
+	/* Set the NVMCON to program 128 instruction words */
+	send_cmd(0x24002A);
+	send_cmd(0x88394A);
+	send_nop();
+	send_nop();
+
+	/* Initiate the write cycle */
+	send_cmd(0x200551);
+	send_cmd(0x883971);
+	send_cmd(0x200AA1);
+	send_cmd(0x883971);
+	send_cmd(0xA8E729);
+	nvm_begin();
+	send_prog_nop();	// FIXME: timing???
+}
+
+/* Erase the page (1024 instruction words) starting at addr */
+bool dspic33e::erase_page(uint32_t addr)
+{
+	/* Set the NVMCON to erase one page */
+	send_cmd(0x24003A);
+	send_cmd(0x88394A);
+	send_nop();
+	send_nop();
+
+	send_cmd(0x200002 | ((addr & 0x0000FFFF) << 4) );
+	send_cmd(0x200003 | ((addr & 0x00FF0000) >> 12) );
+	send_cmd(0x883963);
+	send_cmd(0x883952);
+
+	/* Initiate the erase cycle */
+	send_cmd(0x200551);
+	send_cmd(0x883971);
+	send_cmd(0x200AA1);
+	send_cmd(0x883971);
+	send_cmd(0xA8E729);
+	nvm_begin();
+	send_nop();
+	send_nop();
+	send_nop();
+
+	return nvm_wait(&erase_stats, DELAY_P12);
+}
+
 /* enter program mode */
 void dspic33e::enter_program_mode(void)
 {
@@ -182,16 +663,16 @@ void dspic33e::enter_program_mode(void)
 	/* Shift in the "enter program mode" key sequence (MSB first) */
 	for (i = 31; i > -1; i--) {
 		if ( (ENTER_PROGRAM_KEY >> i) & 0x01 )
-			GPIO_SET(pic_data);
+			PGD_SET();
 		else
-			GPIO_CLR(pic_data);
-		delay_us(DELAY_P1A);
+			PGD_CLR();
+		delay_clk();
 		GPIO_SET(pic_clk);
-		delay_us(DELAY_P1B);
+		delay_clk();
 		GPIO_CLR(pic_clk);
 
 	}
-	GPIO_CLR(pic_data);
+	PGD_CLR();
 	delay_us(DELAY_P19);
 	GPIO_SET(pic_mclr);
 	if(subfamily == SF_DSPIC33E)
@@ -202,9 +683,9 @@ void dspic33e::enter_program_mode(void)
 	/* idle for 5 clock cycles */
 	for (i = 0; i < 5; i++) {
 		GPIO_SET(pic_clk);
-		delay_us(DELAY_P1B);
+		delay_clk();
 		GPIO_CLR(pic_clk);
-		delay_us(DELAY_P1A);
+		delay_clk();
 	}
 
 }
@@ -213,7 +694,7 @@ void dspic33e::enter_program_mode(void)
 void dspic33e::exit_program_mode(void)
 {
 	GPIO_CLR(pic_clk);
-	GPIO_CLR(pic_data);
+	PGD_CLR();
 	delay_us(DELAY_P16);
 	GPIO_CLR(pic_mclr);		/* remove VDD from MCLR pin */
 	delay_us(DELAY_P17);	/* wait (at least) P17 */
@@ -248,6 +729,14 @@ bool dspic33e::read_device_id(void)
 	send_nop();
 	device_id = read_data();
 
+	/* gang mode: every target must be the same part */
+	for(int t=1; t<gang_count; t++)
+		if(gang_data[t] != device_id){
+			fprintf(stderr, "Target %d: device ID 0x%04x differs from 0x%04x!\n",
+					t, gang_data[t], device_id);
+			gang_fail |= 1 << t;
+		}
+
 	send_cmd(0xBA0BB6);
 	send_nop();
 	send_nop();
@@ -259,30 +748,47 @@ bool dspic33e::read_device_id(void)
 	reset_pc();
 	send_nop();
 
-	for (unsigned short i=0;i < sizeof(piclist)/sizeof(piclist[0]);i++){
-
-		if (piclist[i].device_id == device_id){
-
-			strcpy(name, piclist[i].name);
-			mem.code_memory_size = piclist[i].code_memory_size;
-			mem.program_memory_size = 0x0F80018;
-			mem.location = (uint16_t*) calloc(mem.program_memory_size,sizeof(uint16_t));
-			mem.filled = (bool*) calloc(mem.program_memory_size,sizeof(bool));
-			found = 1;
-			break;
-		}
+	const pic_device *dev = devdb_lookup(DB_DSPIC33E, device_id);
+	if(dev){
+		setup_memory(dev, 0x0F80018);
+		found = 1;
 	}
 
 	return found;
 
 }
 
+/* Set up for a part without reading it, and cost the way write() works */
+bool dspic33e::plan_setup(const pic_device *dev, plan_model *model)
+{
+	setup_memory(dev, 0x0F80018);
+
+	memset(model, 0, sizeof(*model));
+	model->row_words = 256;
+	model->row_clocks = ROW_SIX_COUNT*SIX_CLOCKS + 140;	// and send_prog_nop()
+	model->row_delays = ROW_SIX_COUNT*SIX_DELAYS;
+	model->row_us = DELAY_P13;
+	if(!flags.noverify || flags.row_verify){
+		model->verify_clocks = 32*(GROUP_SIX_COUNT*SIX_CLOCKS + GROUP_REGOUT_COUNT*REGOUT_CLOCKS);
+		model->verify_delays = 32*(GROUP_SIX_COUNT*SIX_DELAYS + GROUP_REGOUT_COUNT*REGOUT_DELAYS);
+	}
+	model->erase_us = DELAY_P11;
+	model->fixed_us = DELAY_P18 + ((subfamily == SF_DSPIC33E) ? DELAY_P7_DSPIC33E : DELAY_P7_PIC24FJ)
+					  + 2*100000;
+	model->config_addr = CONFIG_ADDR;
+	model->config_count = 8;
+	model->config_clocks = CONFIG_SIX_COUNT*SIX_CLOCKS;
+	model->config_delays = CONFIG_SIX_COUNT*SIX_DELAYS;
+	model->config_us = DELAY_P20;
+	return true;
+}
+
 /* Check if the device is blank */
 uint8_t dspic33e::blank_check(void)
 {
 	uint32_t addr;
 	unsigned short i;
-	uint16_t data[8], raw_data[6];
+	uint16_t data[8];
 	uint8_t ret = 0;
 
 	if(!flags.debug) cerr << "[ 0%]";
@@ -298,96 +804,18 @@ uint8_t dspic33e::blank_check(void)
 	send_nop();
 	send_nop();
 
-	/* Output data to W0:W5; repeat until all desired code memory is read. */
-	for(addr=0; addr < mem.code_memory_size; addr=addr+8) {
-
-		if((addr & 0x0000FFFF) == 0){
-			send_cmd(0x200000 | ((addr & 0x00FF0000) >> 12) );	// MOV #<DestAddress23:16>, W0
-			send_cmd(0x8802A0);									// MOV W0, TBLPAG
-			send_cmd(0x200006 | ((addr & 0x0000FFFF) << 4) );	// MOV #<DestAddress15:0>, W6
-		}
-
-		/* Fetch the next four memory locations and put them to W0:W5 */
-		send_cmd(0xEB0380);	// CLR W7
-		send_nop();
-		send_cmd(0xBA1B96);
-		send_nop();
-		send_nop();
-		send_nop();
-		send_nop();
-		send_nop();
-		send_cmd(0xBADBB6);
-		send_nop();
-		send_nop();
-		send_nop();
-		send_nop();
-		send_nop();
-		send_cmd(0xBADBD6);
-		send_nop();
-		send_nop();
-		send_nop();
-		send_nop();
-		send_nop();
-		send_cmd(0xBA1BB6);
-		send_nop();
-		send_nop();
-		send_nop();
-		send_nop();
-		send_nop();
-		send_cmd(0xBA1B96);
-		send_nop();
-		send_nop();
-		send_nop();
-		send_nop();
-		send_nop();
-		send_cmd(0xBADBB6);
-		send_nop();
-		send_nop();
-		send_nop();
-		send_nop();
-		send_nop();
-		send_cmd(0xBADBD6);
-		send_nop();
-		send_nop();
-		send_nop();
-		send_nop();
-		send_nop();
-		send_cmd(0xBA0BB6);
-		send_nop();
-		send_nop();
-		send_nop();
-		send_nop();
-		send_nop();
+	tblrd_addr = TBLRD_IDLE;
 
-		/* read six data words (16 bits each) */
-		for(i=0; i<6; i++){
-			send_cmd(0x887C40 + i);
-			send_nop();
-			raw_data[i] = read_data();
-			send_nop();
-		}
+	/* Output data to W0:W5; repeat until all desired code memory is read. */
+	for(addr=0; addr < mem.code_memory_size; addr=addr+8) {
 
-		send_nop();
-		send_nop();
-		send_nop();
-		reset_pc();
-		send_nop();
-		send_nop();
-		send_nop();
+		tblrd_seek(addr);
 
-		/* store data correctly */
-		data[0] = raw_data[0];
-		data[1] = raw_data[1] & 0x00FF;
-		data[3] = (raw_data[1] & 0xFF00) >> 8;
-		data[2] = raw_data[2];
-		data[4] = raw_data[3];
-		data[5] = raw_data[4] & 0x00FF;
-		data[7] = (raw_data[4] & 0xFF00) >> 8;
-		data[6] = raw_data[5];
+		tblrd_fetch(data);
 
 		if(counter != addr*100/mem.code_memory_size){
 			counter = addr*100/mem.code_memory_size;
-			fprintf(stderr, "\b\b\b\b\b[%2d%%]", counter);	
+			progress(counter);	
 		}
 
 		for(i=0; i<8; i++){
@@ -441,30 +869,16 @@ void dspic33e::bulk_erase(void)
 	send_cmd(0x200AA1);
 	send_cmd(0x883971);
 	send_cmd(0xA8E729);
+	nvm_begin();
 	send_nop();
 	send_nop();
 	send_nop();
 
-	if(subfamily == SF_DSPIC33E)
-		delay_us(DELAY_P11_DSPIC33E);
-	else if(subfamily == SF_PIC24FJ)
-		delay_us(DELAY_P11_PIC24FJ);
-
 	/* wait while the erase operation completes */
-	do{
-		send_cmd(0x803940);
-		send_nop();		
-		send_cmd(0x887C40);
-		send_nop();
-		nvmcon = read_data();
-		send_nop();
-		send_nop();
-		send_nop();
-		reset_pc();
-		send_nop();
-		send_nop();
-		send_nop();
-	} while((nvmcon & 0x8000) == 0x8000);
+	if(!nvm_wait(&erase_stats, DELAY_P11)){
+		if(flags.client) fprintf(stdout, "@ERR");
+		return;
+	}
 	
 	if(flags.client) fprintf(stdout, "@FIN");
 }
@@ -473,7 +887,7 @@ void dspic33e::bulk_erase(void)
 void dspic33e::read(char *outfile, uint32_t start, uint32_t count)
 {
 	uint32_t addr, startaddr, stopaddr;
-	uint16_t data[8], raw_data[6];
+	uint16_t data[8];
 	int i=0;
 
 	startaddr = start;
@@ -497,93 +911,14 @@ void dspic33e::read(char *outfile, uint32_t start, uint32_t count)
 	send_nop();
 	send_nop();
 
+	tblrd_addr = TBLRD_IDLE;
+
 	/* Output data to W0:W5; repeat until all desired code memory is read. */
 	for(addr=startaddr; addr < stopaddr; addr=addr+8) {
 
-		if((addr & 0x0000FFFF) == 0 || startaddr != 0){
-			send_cmd(0x200000 | ((addr & 0x00FF0000) >> 12) );	// MOV #<DestAddress23:16>, W0
-			send_cmd(0x8802A0);									// MOV W0, TBLPAG
-			send_cmd(0x200006 | ((addr & 0x0000FFFF) << 4) );	// MOV #<DestAddress15:0>, W6
-			startaddr = 0;
-		}
-
-		/* Fetch the next four memory locations and put them to W0:W5 */
-		send_cmd(0xEB0380);	// CLR W7
-		send_nop();
-		send_cmd(0xBA1B96);
-		send_nop();
-		send_nop();
-		send_nop();
-		send_nop();
-		send_nop();
-		send_cmd(0xBADBB6);
-		send_nop();
-		send_nop();
-		send_nop();
-		send_nop();
-		send_nop();
-		send_cmd(0xBADBD6);
-		send_nop();
-		send_nop();
-		send_nop();
-		send_nop();
-		send_nop();
-		send_cmd(0xBA1BB6);
-		send_nop();
-		send_nop();
-		send_nop();
-		send_nop();
-		send_nop();
-		send_cmd(0xBA1B96);
-		send_nop();
-		send_nop();
-		send_nop();
-		send_nop();
-		send_nop();
-		send_cmd(0xBADBB6);
-		send_nop();
-		send_nop();
-		send_nop();
-		send_nop();
-		send_nop();
-		send_cmd(0xBADBD6);
-		send_nop();
-		send_nop();
-		send_nop();
-		send_nop();
-		send_nop();
-		send_cmd(0xBA0BB6);
-		send_nop();
-		send_nop();
-		send_nop();
-		send_nop();
-		send_nop();
-
-		/* read six data words (16 bits each) */
-		for(i=0; i<6; i++){
-			send_cmd(0x887C40 + i);
-			send_nop();
-			raw_data[i] = read_data();
-			send_nop();
-		}
-
-		send_nop();
-		send_nop();
-		send_nop();
-		reset_pc();
-		send_nop();
-		send_nop();
-		send_nop();
+		tblrd_seek(addr);
 
-		/* store data correctly */
-		data[0] = raw_data[0];
-		data[1] = raw_data[1] & 0x00FF;
-		data[3] = (raw_data[1] & 0xFF00) >> 8;
-		data[2] = raw_data[2];
-		data[4] = raw_data[3];
-		data[5] = raw_data[4] & 0x00FF;
-		data[7] = (raw_data[4] & 0xFF00) >> 8;
-		data[6] = raw_data[5];
+		tblrd_fetch(data);
 
 		for(i=0; i<8; i++){
 			if (flags.debug)
@@ -606,73 +941,60 @@ void dspic33e::read(char *outfile, uint32_t start, uint32_t count)
 			if(flags.client)
 				fprintf(stdout,"@%03d", counter);
 			if(!flags.debug)
-				fprintf(stderr,"\b\b\b\b\b[%2d%%]", counter);
+				progress(counter);
 		}
 
 		/* TODO: checksum */
 	}
 
-	send_nop();
-	send_nop();
-	send_nop();
-	reset_pc();
-	send_nop();
-	send_nop();
-	send_nop();
-
-	send_cmd(0x200F80);
-	send_cmd(0x8802A0);
-	send_cmd(0x200046);
-	send_cmd(0x20F887);
-	send_nop();
-
-	addr = 0x00F80004;
-
+	read_config(data);
 	for(i=0; i<8; i++){
-		send_cmd(0xBA0BB6);
-		send_nop();
-		send_nop();
-		send_nop();
-		send_nop();
-		send_nop();
-		data[0] = read_data();
-		if (data[0] != 0xFFFF) {
-			mem.location[addr+2*i] = data[0];
-			mem.filled[addr+2*i] = 1;
+		if (data[i] != 0xFFFF) {
+			mem.location[CONFIG_ADDR+2*i] = data[i];
+			mem.filled[CONFIG_ADDR+2*i] = 1;
 		}
 	}
 
-	send_nop();
-	send_nop();
-	send_nop();
-	reset_pc();
-	send_nop();
-	send_nop();
-	send_nop();
-
 	if(!flags.debug) cerr << "\b\b\b\b\b";
 	if(flags.client) fprintf(stdout, "@FIN");
-	write_inhx(&mem, outfile);
+	if(outfile)
+		write_inhx(&mem, outfile);
 }
 
 /* Write contents of the .hex file to the PIC */
 void dspic33e::write(char *infile)
 {
-	uint16_t i,j,p;
-	uint16_t k;
+	uint16_t i;
+	uint32_t k;
 	bool skip;
-	uint32_t data[8],raw_data[6];
-	uint32_t addr = 0;
+	uint32_t addr = 0, next;
+	uint32_t row_cmds[2][ROW_SIX];
+	uint8_t buf;
+	uint32_t crc = 0, start = 0, erase_errors;
+	bool journal = !gang_count && (flags.journal || flags.resume);
 
 	unsigned int filled_locations=1;
 
 	const char *regname[] = {"FGS","FOSCSEL","FOSC","FWDT","FPOR",
 							"FICD","FAS","FUID0"};
 
-	filled_locations = read_inhx(infile, &mem);
+	filled_locations = load_image(infile);
 	if(!filled_locations) return;
 
-	bulk_erase();
+	/* one device, one journal, kept only when a resume may be asked for */
+	if(journal)
+		crc = image_crc(&mem);
+
+	if(journal && flags.resume)
+		start = resume_point(crc);
+	if(!start){
+		if(journal)
+			journal_clear();
+		erase_errors = errors;
+		bulk_erase();
+		if(errors != erase_errors)
+			return;		// bulk_erase() has sent @ERR
+	}
 
 	/* Exit reset vector */
 	send_nop();
@@ -688,207 +1010,58 @@ void dspic33e::write(char *infile)
 	if(flags.client) fprintf(stdout, "@000");
 	counter=0;
 
-	for (addr = 0; addr < mem.code_memory_size; ){
-
-		skip = 1;
-
-		for(k=0; k<256; k+=2)
-			if(mem.filled[addr+k]) skip = 0;
-
-		if(skip){
-			addr=addr+256;
-			continue;
-		}
-
-		/* Set the NVMADRU/NVMADR register-pair to point to the correct row */
-		send_cmd(0x200002 | ((addr & 0x0000FFFF) << 4) );
-		send_cmd(0x200003 | ((addr & 0x00FF0000) >> 12) );
-		send_cmd(0x883963);
-		send_cmd(0x883952);
-
-		send_cmd(0x200FAC);
-		send_cmd(0x8802AC);
-		send_cmd(0x200007);
-
-		for(p=0; p<32; p++){
+	/* The next row is packed while the current one is being programmed */
+	addr = prepare_row(start, row_cmds[0]);
+	buf = 0;
 
-			for(j=0;j<8;j++){
-				if (mem.filled[addr+j]) data[j] = mem.location[addr+j];
-				else data[j] = 0xFFFF;
-				if(flags.debug)
-					fprintf(stderr,"\n  Writing 0x%04X to address 0x%06X ", data[j], addr+j );
-			}
-
-			send_cmd(0x200000 | (data[0] << 4));										// MOV #<LSW0>, W0
-			send_cmd(0x200001 | (0x00FFFF & ((data[3] << 8) | (data[1] & 0x00FF))) <<4);// MOV #<MSB1:MSB0>, W1
-			send_cmd(0x200002 | (data[2] << 4));										// MOV #<LSW1>, W2
-			send_cmd(0x200003 | (data[4] << 4));										// MOV #<LSW2>, W3
-			send_cmd(0x200004 | (0x00FFFF & ((data[7] << 8) | (data[5] & 0x00FF))) <<4);// MOV #<MSB3:MSB2>, W4
-			send_cmd(0x200005 | (data[6] << 4));										// MOV #<LSW3>, W5
-
-			/* set_W6_and_load_latches */
-			send_cmd(0xEB0300);
-			send_nop();
-			send_cmd(0xBB0BB6);
-			send_nop();
-			send_nop();
-			send_cmd(0xBBDBB6);
-			send_nop();
-			send_nop();
-			send_cmd(0xBBEBB6);
-			send_nop();
-			send_nop();
-			send_cmd(0xBB1BB6);
-			send_nop();
-			send_nop();
-			send_cmd(0xBB0BB6);
-			send_nop();
-			send_nop();
-			send_cmd(0xBBDBB6);
-			send_nop();
-			send_nop();
-			send_cmd(0xBBEBB6);
-			send_nop();
-			send_nop();
-			send_cmd(0xBB1BB6);
-			send_nop();
-			send_nop();
-
-			addr = addr+8;
-		}
-		
-		/* Set the NVMCON to program 128 instruction words */
-		send_cmd(0x24002A);
-		send_cmd(0x88394A);
-		send_nop();
-		send_nop();
+	while(addr < mem.code_memory_size){
 
-		/* Initiate the write cycle */
-		send_cmd(0x200551);
-		send_cmd(0x883971);
-		send_cmd(0x200AA1);
-		send_cmd(0x883971);
-		send_cmd(0xA8E729);
-		send_prog_nop();	// FIXME: timing???
-
-		if(subfamily == SF_DSPIC33E)
-			delay_us(DELAY_P13_DSPIC33E);
-		else if(subfamily == SF_PIC24FJ)
-			delay_us(DELAY_P13_PIC24FJ);
-
-		do{
-			send_nop();
-			send_cmd(0x803940);
-			send_nop();
-			send_cmd(0x887C40);
-			send_nop();
-			nvmcon = read_data();
-			send_nop();
-			send_nop();
-			send_nop();
-			reset_pc();
-			send_nop();
-			send_nop();
-			send_nop();
-		} while((nvmcon & 0x8000) == 0x8000);
+		program_row(addr, row_cmds[buf]);
+		addr = addr+256;
 
+		/* Flash is busy now: report progress and pack the next row */
 		if(counter != addr*100/filled_locations){
 			if(flags.client)
 				fprintf(stdout,"@%03d", (addr*100/(filled_locations+0x100)));
 			if(!flags.debug)
-				fprintf(stderr,"\b\b\b\b\b[%2d%%]", addr*100/(filled_locations+0x100));
+				progress(addr*100/(filled_locations+0x100));
 			counter = addr*100/filled_locations;
 		}
-	};
-
-	if(!flags.debug) cerr << "\b\b\b\b\b\b";
-	if(flags.client) fprintf(stdout, "@100");
-
-	delay_us(100000);
-
-	/* WRITE CONFIGURATION REGISTERS */
-	if(flags.debug)
-		cerr << endl << "Writing Configuration registers..." << endl;
-
-	send_nop();
-	send_nop();
-	send_nop();
-	reset_pc();
-	send_nop();
-	send_nop();
-	send_nop();
-
-	send_cmd(0x200007);
-	send_cmd(0x200FAC);
-	send_cmd(0x8802AC);
-
-	addr = 0x00F80004;
-
-	for(i=0; i<8; i++){
 
-		if(mem.filled[addr]){
+		buf ^= 1;
+		next = prepare_row(addr, row_cmds[buf]);
 
-			send_cmd(0x200000 | ((0x0000FFFF & mem.location[addr]) << 4));
-
-			send_cmd(0xBB0B80);
-			send_nop();
-			send_nop();
-
-			send_cmd(0x200002 | ((addr & 0x0000FFFF) <<  4));
-			send_cmd(0x200F83);
-			send_cmd(0x883963);
-			send_cmd(0x883952);
-
-			/* Set the NVMCON register to program one Configuration register */
-			send_cmd(0x24000A);
-			send_cmd(0x88394A);
-			send_nop();
-			send_nop();
-
-			/* Initiate the write cycle */
-			send_cmd(0x200551);
-			send_cmd(0x883971);
-			send_cmd(0x200AA1);
-			send_cmd(0x883971);
-			send_cmd(0xA8E729);
-			send_nop();
-			send_nop();
-			send_nop();
-
-			delay_us(DELAY_P20);
-
-			do{
-				send_nop();
-				send_cmd(0x803940);
-				send_nop();
-				send_cmd(0x887C40);
-				send_nop();
-				nvmcon = read_data();
-				send_nop();
-				send_nop();
-				send_nop();
-				reset_pc();
-				send_nop();
-				send_nop();
-				send_nop();
-			} while((nvmcon & 0x8000) == 0x8000);
+		if(!nvm_wait(&row_stats, DELAY_P13)){
+			if(flags.client) fprintf(stdout, "@ERR");
+			return;
+		}
 
-			if(flags.debug)
-				fprintf(stderr,"\n - %s set to 0x%01x",
-						regname[i], mem.location[addr]);
+		/* Verify the row just programmed, abort if it cannot be recovered */
+		if(flags.row_verify){
+			tblrd_addr = TBLRD_IDLE;	// TBLPAG was moved to the latches
+			for(k=addr-256; k<addr; k+=8){
+				if(!mem.filled[k] && !mem.filled[k+2] &&
+				   !mem.filled[k+4] && !mem.filled[k+6])
+					continue;
+				if(!check_group(k, addr)){
+					if(flags.client) fprintf(stdout, "@ERR");
+					return;
+				}
+			}
 		}
-		else if(flags.debug)
-				fprintf(stderr,"\n - %s left unchanged", regname[i]);
 
-		addr = addr+2;
-	}
+		if(journal && !journal_save(this, crc, next))
+			journal = false;	// reported, the write goes on without it
+		addr = next;
+	};
 
-	if(flags.debug) cerr << endl;
+	if(!flags.debug) cerr << "\b\b\b\b\b\b";
+	if(flags.client) fprintf(stdout, "@100");
 
 	delay_us(100000);
 
 	/* VERIFY CODE MEMORY */
-	if(!flags.noverify){
+	if(!flags.noverify && !flags.row_verify){
 		if(!flags.debug) cerr << "[ 0%]";
 		if(flags.client) fprintf(stdout, "@000");
 		counter = 0;
@@ -901,6 +1074,8 @@ void dspic33e::write(char *infile)
 		send_nop();
 		send_nop();
 
+		tblrd_addr = TBLRD_IDLE;
+
 		for(addr=0; addr < mem.code_memory_size; addr=addr+8) {
 
 			skip=1;
@@ -911,116 +1086,67 @@ void dspic33e::write(char *infile)
 
 			if(skip) continue;
 
-			send_cmd(0x200000 | ((addr & 0x00FF0000) >> 12) );	// MOV #<DestAddress23:16>, W0
-			send_cmd(0x8802A0);									// MOV W0, TBLPAG
-			send_cmd(0x200006 | ((addr & 0x0000FFFF) << 4) );	// MOV #<DestAddress15:0>, W6
-
-			/* Fetch the next four memory locations and put them to W0:W5 */
-			send_cmd(0xEB0380);	// CLR W7
-			send_nop();
-			send_cmd(0xBA1B96);
-			send_nop();
-			send_nop();
-			send_nop();
-			send_nop();
-			send_nop();
-			send_cmd(0xBADBB6);
-			send_nop();
-			send_nop();
-			send_nop();
-			send_nop();
-			send_nop();
-			send_cmd(0xBADBD6);
-			send_nop();
-			send_nop();
-			send_nop();
-			send_nop();
-			send_nop();
-			send_cmd(0xBA1BB6);
-			send_nop();
-			send_nop();
-			send_nop();
-			send_nop();
-			send_nop();
-			send_cmd(0xBA1B96);
-			send_nop();
-			send_nop();
-			send_nop();
-			send_nop();
-			send_nop();
-			send_cmd(0xBADBB6);
-			send_nop();
-			send_nop();
-			send_nop();
-			send_nop();
-			send_nop();
-			send_cmd(0xBADBD6);
-			send_nop();
-			send_nop();
-			send_nop();
-			send_nop();
-			send_nop();
-			send_cmd(0xBA0BB6);
-			send_nop();
-			send_nop();
-			send_nop();
-			send_nop();
-			send_nop();
-
-			/* read six data words (16 bits each) */
-			for(i=0; i<6; i++){
-				send_cmd(0x887C40 + i);
-				send_nop();
-				raw_data[i] = read_data();
-				send_nop();
-			}
-
-			send_nop();
-			send_nop();
-			send_nop();
-			reset_pc();
-			send_nop();
-			send_nop();
-			send_nop();
-
-			/* store data correctly */
-			data[0] = raw_data[0];
-			data[1] = raw_data[1] & 0x00FF;
-			data[3] = (raw_data[1] & 0xFF00) >> 8;
-			data[2] = raw_data[2];
-			data[4] = raw_data[3];
-			data[5] = raw_data[4] & 0x00FF;
-			data[7] = (raw_data[4] & 0xFF00) >> 8;
-			data[6] = raw_data[5];
-
-			for(i=0; i<8; i++){
-				if (flags.debug)
-					fprintf(stderr, "\n addr = 0x%06X data = 0x%04X", (addr+i), data[i]);
-
-				if(mem.filled[addr+i] && data[i] != mem.location[addr+i]){
-					fprintf(stderr,"\n\n ERROR at address %06X: written %04X but %04X read!\n\n",
-									addr+i, mem.location[addr+i], data[i]);
-					return;
-				}
-
+			if(!check_group(addr, mem.code_memory_size)){
+				if(flags.client) fprintf(stdout, "@ERR");
+				return;
 			}
 
 			if(counter != addr*100/filled_locations){
 				if(flags.client)
 					fprintf(stdout,"@%03d", (addr*100/(filled_locations+0x100)));
 				if(!flags.debug)
-					fprintf(stderr,"\b\b\b\b\b[%2d%%]", addr*100/(filled_locations+0x100));
+					progress(addr*100/(filled_locations+0x100));
 				counter = addr*100/filled_locations;
 			}
 		}
 
 		if(!flags.debug) cerr << "\b\b\b\b\b";
-		if(flags.client) fprintf(stdout, "@FIN");
 	}
-	else{
-		if(flags.client) fprintf(stdout, "@FIN");
+
+	/* WRITE CONFIGURATION REGISTERS, once the pages need no more erasing */
+	if(flags.debug)
+		cerr << endl << "Writing Configuration registers..." << endl;
+
+	send_nop();
+	send_nop();
+	send_nop();
+	reset_pc();
+	send_nop();
+	send_nop();
+	send_nop();
+
+	send_cmd(0x200007);
+	send_cmd(0x200FAC);
+	send_cmd(0x8802AC);
+
+	addr = CONFIG_ADDR;
+
+	for(i=0; i<8; i++){
+
+		if(mem.filled[addr]){
+
+			if(!program_config(addr, mem.location[addr])){
+				if(flags.client) fprintf(stdout, "@ERR");
+				return;
+			}
+
+			if(flags.debug)
+				fprintf(stderr,"\n - %s set to 0x%01x",
+						regname[i], mem.location[addr]);
+		}
+		else if(flags.debug)
+				fprintf(stderr,"\n - %s left unchanged", regname[i]);
+
+		addr = addr+2;
 	}
 
+	if(flags.debug) cerr << endl;
+
+	delay_us(100000);
+
+	if(journal)
+		journal_clear();
+	if(flags.client) fprintf(stdout, "@FIN");
 }
 
 /* write to screen the configuration registers, without saving them anywhere */
@@ -1029,8 +1155,20 @@ void dspic33e::dump_configuration_registers(void)
 	const char *regname[] = {"FGS","FOSCSEL","FOSC","FWDT","FPOR",
 							"FICD","FAS","FUID0"};
 
+	uint16_t regs[8];
+
 	cerr << endl << "Configuration registers:" << endl << endl;
 
+	read_config(regs);
+	for(unsigned short i=0; i<8; i++)
+		fprintf(stderr," - %s: 0x%02x\n", regname[i], regs[i]);
+
+	cerr << endl;
+}
+
+/* Read the 8 configuration registers */
+void dspic33e::read_config(uint16_t *regs)
+{
 	send_nop();
 	send_nop();
 	send_nop();
@@ -1052,11 +1190,9 @@ void dspic33e::dump_configuration_registers(void)
 		send_nop();
 		send_nop();
 		send_nop();
-		fprintf(stderr," - %s: 0x%02x\n", regname[i], read_data());
+		regs[i] = read_data();
 	}
 
-	cerr << endl;
-
 	send_nop();
 	send_nop();
 	send_nop();
@@ -1064,5 +1200,86 @@ void dspic33e::dump_configuration_registers(void)
 	send_nop();
 	send_nop();
 	send_nop();
+	tblrd_addr = TBLRD_IDLE;
+}
+
+/* Program one configuration register; the caller sets up W7 and TBLPAG */
+bool dspic33e::program_config(uint32_t addr, uint16_t value)
+{
+	send_cmd(0x200000 | ((0x0000FFFF & value) << 4));
+
+	send_cmd(0xBB0B80);
+	send_nop();
+	send_nop();
+
+	send_cmd(0x200002 | ((addr & 0x0000FFFF) <<  4));
+	send_cmd(0x200F83);
+	send_cmd(0x883963);
+	send_cmd(0x883952);
+
+	/* Set the NVMCON register to program one Configuration register */
+	send_cmd(0x24000A);
+	send_cmd(0x88394A);
+	send_nop();
+	send_nop();
+
+	/* Initiate the write cycle */
+	send_cmd(0x200551);
+	send_cmd(0x883971);
+	send_cmd(0x200AA1);
+	send_cmd(0x883971);
+	send_cmd(0xA8E729);
+	nvm_begin();
+	send_nop();
+	send_nop();
+	send_nop();
+
+	return nvm_wait(&config_stats, DELAY_P20);
+}
+
+/*
+ * Update the configuration registers of the image which differ from the
+ * device, leaving program memory alone, and read them back.
+ */
+void dspic33e::write_configuration(char *infile)
+{
+	const char *regname[] = {"FGS","FOSCSEL","FOSC","FWDT","FPOR",
+							"FICD","FAS","FUID0"};
+	uint16_t regs[8];
+	uint32_t addr;
+	int i, written = 0;
+
+	if(!load_image(infile))
+		return;
+
+	read_config(regs);
+
+	send_cmd(0x200007);
+	send_cmd(0x200FAC);
+	send_cmd(0x8802AC);
+
+	for(i=0, addr=CONFIG_ADDR; i<8; i++, addr+=2){
+		if(!mem.filled[addr] || (regs[i] & 0xFF) == (mem.location[addr] & 0xFF))
+			continue;
+		if(!program_config(addr, mem.location[addr])){
+			if(flags.client) fprintf(stdout, "@ERR");
+			return;
+		}
+		fprintf(stderr, " - %s: 0x%02x -> 0x%02x\n", regname[i],
+				regs[i] & 0xFF, mem.location[addr] & 0xFF);
+		written++;
+	}
+
+	read_config(regs);
+	for(i=0, addr=CONFIG_ADDR; i<8; i++, addr+=2){
+		if(mem.filled[addr] && (regs[i] & 0xFF) != (mem.location[addr] & 0xFF)){
+			errors++;
+			fprintf(stderr, "\n\n ERROR: %s is 0x%02x, written 0x%02x!\n\n",
+					regname[i], regs[i] & 0xFF, mem.location[addr] & 0xFF);
+		}
+	}
+
+	fprintf(stderr, "%d configuration registers written\n", written);
+	if(flags.client) fprintf(stdout, errors ? "@ERR" : "@FIN");
 }
 
@@ -43,42 +43,31 @@ class dspic33e : public Pic{
 		void read(char *outfile, uint32_t start, uint32_t count);
 		void write(char *infile);
 		uint8_t blank_check(void);
+		uint16_t erased_value(uint32_t addr){
+			return (addr < mem.code_memory_size && (addr & 1)) ? 0x00FF : 0xFFFF;
+		};
+		void write_configuration(char *infile);
+		bool plan_setup(const pic_device *dev, plan_model *model);
 
 	protected:
 		void send_cmd(uint32_t cmd);
 		inline void send_prog_nop(void);
 		uint16_t read_data(void);
+		bool nvm_busy(void);
+		void tblrd_seek(uint32_t addr);
+		void tblrd_fetch(uint16_t *data);
+		bool verify_group(uint32_t addr, bool report=true);
+		bool verify_row(uint32_t row);
+		bool check_group(uint32_t addr, uint32_t upto);
+		bool recover_row(uint32_t row, uint32_t upto);
+		uint32_t prepare_row(uint32_t addr, uint32_t *cmds);
+		void program_row(uint32_t addr, uint32_t *cmds);
+		bool erase_page(uint32_t addr);
+		uint32_t resume_point(uint32_t crc);
+		void read_config(uint16_t *regs);
+		bool program_config(uint32_t addr, uint16_t value);
 
-		/*
-		* DEVICES SECTION
-		*                       ID       NAME           	  MEMSIZE
-		*/
-		pic_device piclist[28] = {{0x1861, "dsPIC33EP256MU806", 0x02ABFF},
-								  {0x1862, "dsPIC33EP256MU810", 0x02ABFF},
-								  {0x1863, "dsPIC33EP256MU814", 0x02ABFF},
-								  {0x1826, "PIC24EP256GU810", 0x02ABFF},
-								  {0x1827, "PIC24EP256GU814", 0x02ABFF},
-								  {0x187D, "dsPIC33EP512GP806", 0x02ABFF},
-								  {0x1879, "dsPIC33EP512MC806", 0x0557FF},
-								  {0x1872, "dsPIC33EP512MU810", 0x0557FF},
-								  {0x1873, "dsPIC33EP512MU814", 0x0557FF},
-								  {0x183D, "PIC24EP512GP806", 0x0557FF},
-								  {0x1836, "PIC24EP512GU810", 0x0557FF},
-								  {0x1837, "PIC24EP512GU814", 0x0557FF},
-								  {0x6000, "PIC24FJ128GA606", 0x015FFF},
-								  {0x6008, "PIC24FJ256GA606", 0x02AFFF},
-                                  {0x6010, "PIC24FJ512GA606", 0x055FFF},
-                                  {0x6018, "PIC24FJ1024GA606", 0x0ABFFF},
-                                  {0x6001, "PIC24FJ128GA610", 0x015FFF},
-                                  {0x6009, "PIC24FJ256GA610", 0x02AFFF},
-                                  {0x6011, "PIC24FJ512GA610", 0x055FFF},
-                                  {0x6019, "PIC24FJ1024GA610", 0x0ABFFF},
-                                  {0x6004, "PIC24FJ128GB606", 0x015FFF},
-                                  {0x600C, "PIC24FJ256GB606", 0x02AFFF},
-                                  {0x6014, "PIC24FJ512GB606", 0x055FFF},
-                                  {0x601C, "PIC24FJ1024GB606", 0x0ABFFF},
-                                  {0x6005, "PIC24FJ128GB610", 0x015FFF},
-                                  {0x600D, "PIC24FJ256GB610", 0x02AFFF},
-                                  {0x6015, "PIC24FJ512GB610", 0x055FFF},
-                                  {0x601D, "PIC24FJ1024GB610", 0x0ABFFF}};
+		uint32_t tblrd_addr;	/* address TBLPAG:W6 currently point to */
+		uint16_t gang_data[GANG_MAX];		/* last word read from each target */
+		uint16_t gang_raw[GANG_MAX][6];		/* last W0:W5 of each target */
 };
@@ -27,8 +27,6 @@
 
 /* delays (in microseconds; nanoseconds are rounded to 1us) */
 #define DELAY_P1   		1		// 200ns
-#define DELAY_P1A		1		// 80ns
-#define DELAY_P1B		1		// 80ns
 #define DELAY_P2		1		// 15ns
 #define DELAY_P3		1		// 15ns
 #define DELAY_P4		1		// 40ns
@@ -57,8 +55,8 @@
 #define reset_pc() send_cmd(0x040200)
 #define send_nop() send_cmd(0x000000)
 
-static unsigned int counter=0;
-static uint16_t nvmcon;
+static thread_local unsigned int counter=0;
+static thread_local uint16_t nvmcon;
 
 /* Send a 24-bit command to the PIC (LSB first) through a SIX instruction */
 void dspic33f::send_cmd(uint32_t cmd)
@@ -70,9 +68,9 @@ void dspic33f::send_cmd(uint32_t cmd)
 	/* send the SIX = 0x0000 instruction */
 	for (i = 0; i < 4; i++) {
 		GPIO_SET(pic_clk);
-		delay_us(DELAY_P1B);
+		delay_clk();
 		GPIO_CLR(pic_clk);
-		delay_us(DELAY_P1A);
+		delay_clk();
 	}
 
 	delay_us(DELAY_P4);
@@ -83,9 +81,9 @@ void dspic33f::send_cmd(uint32_t cmd)
 			GPIO_SET(pic_data);
 		else
 			GPIO_CLR(pic_data);
-		delay_us(DELAY_P1A);
+		delay_clk();
 		GPIO_SET(pic_clk);
-		delay_us(DELAY_P1B);
+		delay_clk();
 		GPIO_CLR(pic_clk);
 	}
 
@@ -108,9 +106,9 @@ uint16_t dspic33f::read_data(void)
 			GPIO_SET(pic_data);
 		else
 			GPIO_CLR(pic_data);
-		delay_us(DELAY_P1A);
+		delay_clk();
 		GPIO_SET(pic_clk);
-		delay_us(DELAY_P1B);
+		delay_clk();
 		GPIO_CLR(pic_clk);
 	}
 
@@ -119,9 +117,9 @@ uint16_t dspic33f::read_data(void)
 	/* idle for 8 clock cycles, waiting for the data to be ready */
 	for (i = 0; i < 8; i++) {
 		GPIO_SET(pic_clk);
-		delay_us(DELAY_P1B);
+		delay_clk();
 		GPIO_CLR(pic_clk);
-		delay_us(DELAY_P1A);
+		delay_clk();
 	}
 
 	delay_us(DELAY_P5);
@@ -131,10 +129,10 @@ uint16_t dspic33f::read_data(void)
 	/* read a 16-bit data word */
 	for (i = 0; i < 16; i++) {
 		GPIO_SET(pic_clk);
-		delay_us(DELAY_P1B);
+		delay_clk();
 		data |= ( GPIO_LEV(pic_data) & 0x00000001 ) << i;
 		GPIO_CLR(pic_clk);
-		delay_us(DELAY_P1A);
+		delay_clk();
 	}
 
 	delay_us(DELAY_P4A);
@@ -142,6 +140,91 @@ uint16_t dspic33f::read_data(void)
 	return data;
 }
 
+/* Read NVMCON; returns true while the WR bit is set */
+bool dspic33f::nvm_busy(void)
+{
+	send_cmd(0x803B00);
+	send_cmd(0x883C20);
+	send_nop();
+	nvmcon = read_data();
+	reset_pc();
+	send_nop();
+	return (nvmcon & 0x8000) == 0x8000;
+}
+
+/* Read back the 8 locations TBLPAG:W6 point to (addr) and compare them
+ * with mem; W6 is left pointing to the next group */
+bool dspic33f::verify_group(uint32_t addr)
+{
+	uint8_t i;
+	uint32_t data[8], raw_data[6];
+
+	/* Fetch the next four memory locations and put them to W0:W5 */
+	send_cmd(0xEB0380);
+	send_nop();
+	send_cmd(0xBA1B96);
+	send_nop();
+	send_nop();
+	send_cmd(0xBADBB6);
+	send_nop();
+	send_nop();
+	send_cmd(0xBADBD6);
+	send_nop();
+	send_nop();
+	send_cmd(0xBA1BB6);
+	send_nop();
+	send_nop();
+	send_cmd(0xBA1B96);
+	send_nop();
+	send_nop();
+	send_cmd(0xBADBB6);
+	send_nop();
+	send_nop();
+	send_cmd(0xBADBD6);
+	send_nop();
+	send_nop();
+	send_cmd(0xBA0BB6);
+	send_nop();
+	send_nop();
+
+	/* read six data words (16 bits each) */
+	for(i=0; i<6; i++){
+		send_cmd(0x883C20 + i);
+		send_nop();
+		send_nop();
+		raw_data[i] = read_data();
+		send_nop();
+	}
+
+	reset_pc();
+	send_nop();
+
+	/* store data correctly */
+	data[0] = raw_data[0];
+	data[1] = raw_data[1] & 0x00FF;
+	data[3] = (raw_data[1] & 0xFF00) >> 8;
+	data[2] = raw_data[2];
+	data[4] = raw_data[3];
+	data[5] = raw_data[4] & 0x00FF;
+	data[7] = (raw_data[4] & 0xFF00) >> 8;
+	data[6] = raw_data[5];
+
+	for(i=0; i<8; i++){
+		if (flags.debug)
+			fprintf(stderr, "\n addr = 0x%06X data = 0x%04X",
+						(addr+i), data[i]);
+
+		if(mem.filled[addr+i] && data[i] != mem.location[addr+i]){
+			errors++;
+			fprintf(stderr,"\n\n ERROR at address %06X: written %04X but %04X read!\n\n",
+							addr+i, mem.location[addr+i], data[i]);
+			return false;
+		}
+
+	}
+	return true;
+}
+
 /* enter program mode */
 void dspic33f::enter_program_mode(void)
 {
@@ -165,9 +248,9 @@ void dspic33f::enter_program_mode(void)
 			GPIO_SET(pic_data);
 		else
 			GPIO_CLR(pic_data);
-		delay_us(DELAY_P1A);
+		delay_clk();
 		GPIO_SET(pic_clk);
-		delay_us(DELAY_P1B);
+		delay_clk();
 		GPIO_CLR(pic_clk);
 
 	}
@@ -179,9 +262,9 @@ void dspic33f::enter_program_mode(void)
 	/* idle for 5 clock cycles */
 	for (i = 0; i < 5; i++) {
 		GPIO_SET(pic_clk);
-		delay_us(DELAY_P1B);
+		delay_clk();
 		GPIO_CLR(pic_clk);
-		delay_us(DELAY_P1A);
+		delay_clk();
 	}
 
 }
@@ -226,18 +309,16 @@ bool dspic33f::read_device_id(void)
 	reset_pc();
 	send_nop();
 
-	for (unsigned short i=0;i < sizeof(piclist)/sizeof(piclist[0]);i++){
-
-		if (piclist[i].device_id == device_id){
-
-			strcpy(name,piclist[i].name);
-			mem.code_memory_size = piclist[i].code_memory_size;
-			mem.program_memory_size = 0x0F80018;
-			mem.location = (uint16_t*) calloc(mem.program_memory_size,sizeof(uint16_t));
-			mem.filled = (bool*) calloc(mem.program_memory_size,sizeof(bool));
-			found = 1;
-			break;
-		}
+	const pic_device *dev = devdb_lookup(DB_DSPIC33F, device_id);
+	if(dev){
+		strcpy(name,dev->name);
+		mem.code_memory_size = dev->code_memory_size;
+		mem.program_memory_size = 0x0F80018;
+		free(mem.location);	// left by a previous read_device_id()
+		free(mem.filled);
+		mem.location = (uint16_t*) calloc(mem.program_memory_size,sizeof(uint16_t));
+		mem.filled = (bool*) calloc(mem.program_memory_size,sizeof(bool));
+		found = 1;
 	}
 
 	return found;
@@ -321,7 +402,7 @@ uint8_t dspic33f::blank_check(void)
 
 		if(counter != addr*100/mem.code_memory_size){
 			counter = addr*100/mem.code_memory_size;
-			fprintf(stderr, "\b\b\b\b\b[%2d%%]", counter);
+			progress(counter);
 		}
 
 		for(i=0; i<8; i++)
@@ -357,20 +438,17 @@ void dspic33f::bulk_erase(void)
 	send_cmd(0x883B0A);
 
 	send_cmd(0xA8E761);
+	nvm_begin();
 	send_nop();
 	send_nop();
 	send_nop();
 	send_nop();
 
 	/* wait while the erase operation completes */
-	do{
-		send_cmd(0x803B00);
-		send_cmd(0x883C20);
-		send_nop();
-		nvmcon = read_data();
-		reset_pc();
-		send_nop();
-	} while((nvmcon & 0x8000) == 0x8000);
+	if(!nvm_wait(&erase_stats, DELAY_P11)){
+		if(flags.client) fprintf(stdout, "@ERR");
+		return;
+	}
 
 	if(flags.client) fprintf(stdout, "@FIN");
 }
@@ -480,7 +558,7 @@ void dspic33f::read(char *outfile, uint32_t start, uint32_t count)
 			if(flags.client)
 				fprintf(stdout,"@%03d", counter);
 			if(!flags.debug)
-				fprintf(stderr,"\b\b\b\b\b[%2d%%]", counter);
+				progress(counter);
 		}
 
 		/* TODO: checksum */
@@ -511,7 +589,8 @@ void dspic33f::read(char *outfile, uint32_t start, uint32_t count)
 
 	if(!flags.debug) cerr << "\b\b\b\b\b";
 	if(flags.client) fprintf(stdout, "@FIN");
-	write_inhx(&mem, outfile);
+	if(outfile)
+		write_inhx(&mem, outfile);
 }
 
 /* Write contents of the .hex file to the PIC */
@@ -519,18 +598,21 @@ void dspic33f::write(char *infile)
 {
 	uint8_t i,j,k,p;
 	bool skip, skipped=0;
-	uint32_t data[8],raw_data[6];
-	uint32_t addr = 0;
+	uint32_t data[8];
+	uint32_t addr = 0, erase_errors;
 
 	unsigned int filled_locations=1;
 
 	const char *regname[] = {"FBS","FSS","FGS","FOSCSEL","FOSC","FWDT","FPOR",
 								"FICD","FUID0","FUID1","FUID2","FUID3"};
 
-	filled_locations = read_inhx(infile, &mem);
+	filled_locations = load_image(infile);
 	if(!filled_locations) return;
 
+	erase_errors = errors;
 	bulk_erase();
+	if(errors != erase_errors)
+		return;		// bulk_erase() has sent @ERR
 
 	/* Exit reset vector */
 	reset_pc();
@@ -610,26 +692,35 @@ void dspic33f::write(char *infile)
 		}
 
 		send_cmd(0xA8E761);
+		nvm_begin();
 		send_nop();
 		send_nop();
 		send_nop();
 		send_nop();
 
-		do{
-			send_cmd(0x803B00);
-			send_cmd(0x883C20);
-			send_nop();
-			nvmcon = read_data();
-			reset_pc();
-			send_nop();
-		} while((nvmcon & 0x8000) == 0x8000);
+		if(!nvm_wait(&row_stats, DELAY_P13)){
+			if(flags.client) fprintf(stdout, "@ERR");
+			return;
+		}
+
+		/* Verify the row just programmed, abort on mismatch */
+		if(flags.row_verify){
+			send_cmd(0x200000 | (((addr-128) & 0x00FF0000) >> 12) );	// MOV #<DestAddress23:16>, W0
+			send_cmd(0x880190);											// MOV W0, TBLPAG
+			send_cmd(0x200006 | (((addr-128) & 0x0000FFFF) << 4) );		// MOV #<DestAddress15:0>, W6
+			for(p=0; p<16; p++)
+				if(!verify_group(addr-128+p*8)){
+					if(flags.client) fprintf(stdout, "@ERR");
+					return;
+				}
+		}
 
 		if(counter != addr*100/filled_locations){
 			counter = addr*100/filled_locations;
 			if(flags.client)
 				fprintf(stdout,"@%03d", counter);
 			if(!flags.debug)
-				fprintf(stderr,"\b\b\b\b\b[%2d%%]", counter);
+				progress(counter);
 		}
 	};
 
@@ -660,18 +751,15 @@ void dspic33f::write(char *infile)
 			send_nop();
 
 			send_cmd(0xA8E761);
+			nvm_begin();
 			send_nop();
 			send_nop();
 			send_nop();
 			send_nop();
-			do{
-				send_cmd(0x803B00);
-				send_cmd(0x883C20);
-				send_nop();
-				nvmcon = read_data();
-				reset_pc();
-				send_nop();
-			} while((nvmcon & 0x8000) == 0x8000);
+			if(!nvm_wait(&config_stats, DELAY_P20)){
+				if(flags.client) fprintf(stdout, "@ERR");
+				return;
+			}
 
 			if(flags.debug)
 				fprintf(stderr,"\n - %s set to 0x%02x",
@@ -682,7 +770,7 @@ void dspic33f::write(char *infile)
 	if(flags.debug) cerr << endl;
 
 	/* VERIFY CODE MEMORY */
-	if(!flags.noverify){
+	if(!flags.noverify && !flags.row_verify){
 		if(!flags.debug) cerr << "[ 0%]";
 		if(flags.client) fprintf(stdout, "@000");
 		counter = 0;
@@ -709,74 +797,13 @@ void dspic33f::write(char *infile)
 			}
 			else skipped=0;
 
-			/* Fetch the next four memory locations and put them to W0:W5 */
-			send_cmd(0xEB0380);
-			send_nop();
-			send_cmd(0xBA1B96);
-			send_nop();
-			send_nop();
-			send_cmd(0xBADBB6);
-			send_nop();
-			send_nop();
-			send_cmd(0xBADBD6);
-			send_nop();
-			send_nop();
-			send_cmd(0xBA1BB6);
-			send_nop();
-			send_nop();
-			send_cmd(0xBA1B96);
-			send_nop();
-			send_nop();
-			send_cmd(0xBADBB6);
-			send_nop();
-			send_nop();
-			send_cmd(0xBADBD6);
-			send_nop();
-			send_nop();
-			send_cmd(0xBA0BB6);
-			send_nop();
-			send_nop();
-
-			/* read six data words (16 bits each) */
-			for(i=0; i<6; i++){
-				send_cmd(0x883C20 + i);
-				send_nop();
-				send_nop();
-				raw_data[i] = read_data();
-				send_nop();
-			}
-
-			reset_pc();
-			send_nop();
-
-			/* store data correctly */
-			data[0] = raw_data[0];
-			data[1] = raw_data[1] & 0x00FF;
-			data[3] = (raw_data[1] & 0xFF00) >> 8;
-			data[2] = raw_data[2];
-			data[4] = raw_data[3];
-			data[5] = raw_data[4] & 0x00FF;
-			data[7] = (raw_data[4] & 0xFF00) >> 8;
-			data[6] = raw_data[5];
-
-			for(i=0; i<8; i++){
-				if (flags.debug)
-					fprintf(stderr, "\n addr = 0x%06X data = 0x%04X",
-								(addr+i), data[i]);
-
-				if(mem.filled[addr+i] && data[i] != mem.location[addr+i]){
-					fprintf(stderr,"\n\n ERROR at address %06X: written %04X but %04X read!\n\n",
-									addr+i, mem.location[addr+i], data[i]);
-					return;
-				}
-
-			}
+			if(!verify_group(addr)) return;
 
 			if(counter != addr*100/filled_locations){
 				if(flags.client)
 					fprintf(stdout,"@%03d", (addr*100/(filled_locations+0x100)));
 				if(!flags.debug)
-					fprintf(stderr,"\b\b\b\b\b[%2d%%]", addr*100/(filled_locations+0x100));
+					progress(addr*100/(filled_locations+0x100));
 				counter = addr*100/filled_locations;
 			}
 		}
@@ -26,13 +26,8 @@
 #include "pic10f322.h"
 
 /* delays (in microseconds) */
-#define DELAY_SETUP	1
-#define	DELAY_HOLD	1
 #define DELAY_TENTS	1
 #define DELAY_TENTH	250
-#define DELAY_TCKH	1
-#define DELAY_TCKL 	1
-#define DELAY_TCO 	1
 #define DELAY_TDLY	1
 #define DELAY_TERAB	5000
 #define DELAY_TEXIT	1
@@ -69,18 +64,18 @@ void pic10f322::enter_program_mode(void)
 		else
 			GPIO_CLR(pic_data);
 
-		delay_us(DELAY_TCKL);	/* Setup time */
+		delay_clk();	/* Setup time */
 		GPIO_SET(pic_clk);
-		delay_us(DELAY_TCKH);	/* Hold time */
+		delay_clk();	/* Hold time */
 		GPIO_CLR(pic_clk);
 
 	}
 	GPIO_CLR(pic_data);
 
 	//Last clock(Don't care data)
-	delay_us(DELAY_TCKL);	/* Setup time */
+	delay_clk();	/* Setup time */
 	GPIO_SET(pic_clk);
-	delay_us(DELAY_TCKH);	/* Hold time */
+	delay_clk();	/* Hold time */
 	GPIO_CLR(pic_clk);
 
 }
@@ -105,9 +100,9 @@ void pic10f322::send_cmd(uint8_t cmd, unsigned int delay)
 			GPIO_SET(pic_data);
 		else
 			GPIO_CLR(pic_data);
-		delay_us(DELAY_TCKH);	/* Setup time */
+		delay_clk();	/* Setup time */
 		GPIO_CLR(pic_clk);
-		delay_us(DELAY_TCKL);	/* Hold time */
+		delay_clk();	/* Hold time */
 	}
 	GPIO_CLR(pic_data);
 	delay_us(delay);
@@ -123,11 +118,11 @@ uint16_t pic10f322::read_data(void)
 
 	for (i = 0; i < 16; i++) {
 		GPIO_SET(pic_clk);
-		delay_us(DELAY_TCKH);
-		delay_us(DELAY_TCO);	/* Wait for data to be valid */
+		delay_clk();
+		delay_clk();	/* Wait for data to be valid */
 		data |= ( GPIO_LEV(pic_data) & 0x00000001 ) << i;
 		GPIO_CLR(pic_clk);
-		delay_us(DELAY_TCKL);
+		delay_clk();
 	}
 
 	GPIO_IN(pic_data);
@@ -148,9 +143,9 @@ void pic10f322::write_data(uint16_t data)
 			GPIO_SET(pic_data);
 		else
 			GPIO_CLR(pic_data);
-		delay_us(DELAY_SETUP);	/* Setup time */
+		delay_clk();	/* Setup time */
 		GPIO_CLR(pic_clk);
-		delay_us(DELAY_HOLD);	/* Hold time */
+		delay_clk();	/* Hold time */
 	}
 	GPIO_CLR(pic_data);
 }
@@ -178,18 +173,16 @@ bool pic10f322::read_device_id(void)
 	device_id = (id >> 5) & 0x1ff;
 	device_rev = id & 0x1f;
 
-	for (unsigned short i=0;i < sizeof(piclist)/sizeof(piclist[0]);i++){
-
-		if (piclist[i].device_id == device_id){
-
-			strcpy(name,piclist[i].name);
-			mem.code_memory_size = piclist[i].code_memory_size;
-			mem.program_memory_size = 0x0F80018;
-			mem.location = (uint16_t*) calloc(mem.program_memory_size,sizeof(uint16_t));
-			mem.filled = (bool*) calloc(mem.program_memory_size,sizeof(bool));
-			found = 1;
-			break;
-		}
+	const pic_device *dev = devdb_lookup(DB_PIC10F322, device_id);
+	if(dev){
+		strcpy(name,dev->name);
+		mem.code_memory_size = dev->code_memory_size;
+		mem.program_memory_size = 0x0F80018;
+		free(mem.location);	// left by a previous read_device_id()
+		free(mem.filled);
+		mem.location = (uint16_t*) calloc(mem.program_memory_size,sizeof(uint16_t));
+		mem.filled = (bool*) calloc(mem.program_memory_size,sizeof(bool));
+		found = 1;
 	}
 	for (unsigned short i=0;i < sizeof(detailed_subfamily_table)/sizeof(detailed_subfamily_table[0]);i++){
 
@@ -230,7 +223,7 @@ uint8_t pic10f322::blank_check(void)
 
 		if(lcounter != addr*100/mem.code_memory_size){
 			lcounter = addr*100/mem.code_memory_size;
-			fprintf(stderr, "\b\b\b\b\b[%2d%%]", lcounter);
+			progress(lcounter);
 		}
 	}
 
@@ -312,7 +305,7 @@ void pic10f322::read(char *outfile, uint32_t start, uint32_t count)
 			if(flags.client)
 				fprintf(stderr,"RED@%2d\n", (addr*100/mem.code_memory_size));
 			if(!flags.debug)
-				fprintf(stderr,"\b\b\b\b%2d%%]", addr*100/mem.code_memory_size);
+				progress(addr*100/mem.code_memory_size);
 			lcounter = addr*100/mem.code_memory_size;
 		}
 	}
@@ -363,7 +356,8 @@ void pic10f322::read(char *outfile, uint32_t start, uint32_t count)
 
 	if(!flags.debug) cerr << "\b\b\b\b\b";
 	if(flags.client) fprintf(stdout, "@FIN");
-	write_inhx(&mem, outfile);
+	if(outfile)
+		write_inhx(&mem, outfile);
 }
 
 /* Bulk erase the chip, and then write contents of the .hex file to the PIC */
@@ -373,7 +367,7 @@ void pic10f322::write(char *infile)
 	uint16_t data, fileconf;
 	uint32_t addr = 0x00000000;
 
-	read_inhx(infile, &mem);
+	load_image(infile);
 
 	bulk_erase();
 
@@ -429,7 +423,7 @@ void pic10f322::write(char *infile)
 			if(flags.client)
 				fprintf(stdout,"@%03d", lcounter);
 			if(!flags.debug)
-				fprintf(stderr,"\b\b\b\b\b[%2d%%]", lcounter);
+				progress(lcounter);
 		}
 	};
 
@@ -484,6 +478,7 @@ void pic10f322::write(char *infile)
 						addr, data, (mem.filled[addr]) ? (mem.location[addr]) : 0x3FFF);
 
 			if ( (data != mem.location[addr]) & ( mem.filled[addr]) ) {
+				errors++;
 				fprintf(stderr, "Error at addr = 0x%06X:  pic = 0x%04X, file = 0x%04X.\nExiting...",
 						addr, data, mem.location[addr]);
 				return;
@@ -493,7 +488,7 @@ void pic10f322::write(char *infile)
 				if(flags.client)
 					fprintf(stdout,"@%03d", lcounter);
 				if(!flags.debug)
-					fprintf(stderr,"\b\b\b\b\b[%2d%%]", lcounter);
+					progress(lcounter);
 			}
 		}
 
@@ -521,6 +516,7 @@ void pic10f322::write(char *infile)
 		data = read_data() & mask;
 		fileconf = mem.location[addr] & mask;
 		if ( ( data != fileconf ) & ( mem.filled[addr] ) ) {
+			errors++;
 			fprintf(stderr, "Error at addr = 0x%06X:  pic = 0x%04X, file = 0x%04X.\nExiting...",
 					addr, data, mem.location[addr] & mask);
 			return;
@@ -542,6 +538,7 @@ void pic10f322::write(char *infile)
 			data = read_data() & mask;
 			fileconf = mem.location[addr] & mask;
 			if ( ( data != fileconf ) & ( mem.filled[addr] ) ) {
+				errors++;
 				fprintf(stderr, "Error at addr = 0x%06X:  pic = 0x%04X, file = 0x%04X.\nExiting...",
 						addr, data & mask, mem.location[addr] & mask);
 				return;
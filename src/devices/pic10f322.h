@@ -52,6 +52,7 @@ class pic10f322: public Pic{
 		void read(char *outfile, uint32_t start, uint32_t count);
 		void write(char *infile);
 		uint8_t blank_check(void);
+		uint16_t erased_value(uint32_t addr){return 0x3FFF;};
 
 	protected:
 		void send_cmd(uint8_t cmd, unsigned int delay);
@@ -59,30 +60,6 @@ class pic10f322: public Pic{
 		void write_data(uint16_t data);
 		void reset_mem_location(void);
 
-		/*
-		* DEVICES SECTION
-		*                    	ID       NAME           MEMSIZE
-		*/
-		pic_device piclist[19] = {{0x14D,  "PIC10F320", 0x100},
-								{0x14C,  "PIC10F322", 0x200},
-								{0x14F,  "PIC10LF320", 0x100},
-								{0x13C,  "PIC16F1826", 0x800},
-								{0x13D,  "PIC16F1827", 0x1000},
-								{0x144,  "PIC16LF1826", 0x800},
-								{0x145,  "PIC16LF1827", 0x1000},
-								{0x139,  "PIC16F1823", 0x800},
-								{0x141,  "PICLF1823", 0x800},
-								{0x138,  "PIC12F1822", 0x800},
-								{0x140,  "PIC12LF1822", 0x800},
-								{0x13A,  "PIC16F1824", 0x1000},
-								{0x142,  "PIC16LF1824", 0x1000},
-								{0x13B,  "PIC16F1825", 0x2000},
-								{0x143,  "PIC16LF1825", 0x2000},
-								{0x13E,  "PIC16F1828", 0x1000},
-								{0x146,  "PIC16LF1828", 0x1000},
-								{0x13F,  "PIC16F1829", 0x2000},
-								{0x147,  "PIC16LF1829", 0x2000}
-								};
 		detailed_subfamily_t detailed_subfamily_table[19] = {
 								{0x14D,SF_PIC10F322,	16},	//PIC10F320
 								{0x14C,SF_PIC10F322,	16},	//PIC10F322
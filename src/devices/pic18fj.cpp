@@ -28,8 +28,6 @@
 /* delays (in microseconds) */
 #define DELAY_P1   	1
 #define DELAY_P2   	1
-#define DELAY_P2A  	1
-#define DELAY_P2B  	1
 #define DELAY_P3   	1
 #define DELAY_P4   	1
 #define DELAY_P5   	1
@@ -60,7 +58,13 @@
 
 #define ENTER_PROGRAM_KEY	0x4D434850
 
-unsigned int lcounter = 0;
+/* cost of the ICSP operations, for plan_setup() */
+#define CMD_DATA_CLOCKS		20		// send_cmd() and write_data(): PGC cycles
+#define CMD_DATA_DELAYS		2		// and delay_us() calls
+#define READ_CLOCKS			20		// send_cmd() and read_data()
+#define READ_DELAYS			11
+
+static thread_local unsigned int lcounter = 0;
 
 void pic18fj::enter_program_mode(void)
 {
@@ -83,9 +87,9 @@ void pic18fj::enter_program_mode(void)
 			GPIO_SET(pic_data);
 		else
 			GPIO_CLR(pic_data);
-		delay_us(DELAY_P2B);	/* Setup time */
+		delay_clk();	/* Setup time */
 		GPIO_SET(pic_clk);
-		delay_us(DELAY_P2A);	/* Hold time */
+		delay_clk();	/* Hold time */
 		GPIO_CLR(pic_clk);
 
 	}
@@ -118,9 +122,9 @@ void pic18fj::send_cmd(uint8_t cmd)
 			GPIO_SET(pic_data);
 		else
 			GPIO_CLR(pic_data);
-		delay_us(DELAY_P2B);	/* Setup time */
+		delay_clk();	/* Setup time */
 		GPIO_CLR(pic_clk);
-		delay_us(DELAY_P2A);	/* Hold time */
+		delay_clk();	/* Hold time */
 	}
 	GPIO_CLR(pic_data);
 	delay_us(DELAY_P5);
@@ -134,9 +138,9 @@ uint16_t pic18fj::read_data(void)
 
 	for (i = 0; i < 8; i++) {
 		GPIO_SET(pic_clk);
-		delay_us(DELAY_P2B);
+		delay_clk();
 		GPIO_CLR(pic_clk);
-		delay_us(DELAY_P2A);
+		delay_clk();
 	}
 
 	delay_us(DELAY_P6);	/* wait for the data... */
@@ -147,9 +151,9 @@ uint16_t pic18fj::read_data(void)
 		GPIO_SET(pic_clk);
 		delay_us(DELAY_P14);	/* Wait for data to be valid */
 		data |= ( GPIO_LEV(pic_data) & 0x00000001 ) << i;
-		delay_us(DELAY_P2B);
+		delay_clk();
 		GPIO_CLR(pic_clk);
-		delay_us(DELAY_P2A);
+		delay_clk();
 	}
 
 	delay_us(DELAY_P5A);
@@ -169,9 +173,9 @@ void pic18fj::write_data(uint16_t data)
 			GPIO_SET(pic_data);
 		else
 			GPIO_CLR(pic_data);
-		delay_us(DELAY_P2B);	/* Setup time */
+		delay_clk();	/* Setup time */
 		GPIO_CLR(pic_clk);
-		delay_us(DELAY_P2A);	/* Hold time */
+		delay_clk();	/* Hold time */
 	}
 	GPIO_CLR(pic_data);
 	delay_us(DELAY_P5A);
@@ -212,18 +216,10 @@ bool pic18fj::read_device_id(void)
 
 	device_id = id;
 
-	for (unsigned short i=0;i < sizeof(piclist)/sizeof(piclist[0]);i++){
-
-		if (piclist[i].device_id == device_id){
-
-			strcpy(name,piclist[i].name);
-			mem.code_memory_size = piclist[i].code_memory_size;
-			mem.program_memory_size = 0x0F80018;
-			mem.location = (uint16_t*) calloc(mem.program_memory_size,sizeof(uint16_t));
-			mem.filled = (bool*) calloc(mem.program_memory_size,sizeof(bool));
-			found = 1;
-			break;
-		}
+	const pic_device *dev = devdb_lookup(DB_PIC18FJ, device_id);
+	if(dev){
+		setup_memory(dev, 0x0F80018);
+		found = 1;
 	}
 
 	return found;
@@ -255,7 +251,7 @@ uint8_t pic18fj::blank_check(void)
 
 		if(lcounter != addr*100/mem.code_memory_size){
 			lcounter = addr*100/mem.code_memory_size;
-			fprintf(stderr, "\b\b\b\b\b[%2d%%]", lcounter);
+			progress(lcounter);
 		}
 	}
 
@@ -265,6 +261,29 @@ uint8_t pic18fj::blank_check(void)
 
 }
 
+/* Set up for a part without reading it, and cost the way write() works:
+ * every row is programmed and every location read back */
+bool pic18fj::plan_setup(const pic_device *dev, plan_model *model)
+{
+	setup_memory(dev, 0x0F80018);
+
+	memset(model, 0, sizeof(*model));
+	model->row_words = 32;
+	model->all_rows = true;
+	/* goto_mem_location(), the row, the programming sequence and the
+	 * write_data() closing it */
+	model->row_clocks = (6 + 32)*CMD_DATA_CLOCKS + 3 + 16;
+	model->row_delays = (6 + 32)*CMD_DATA_DELAYS + 2;
+	model->row_us = DELAY_P9;
+	if(!flags.noverify){
+		model->verify_clocks = 2*32*READ_CLOCKS;
+		model->verify_delays = 2*32*READ_DELAYS;
+	}
+	model->erase_us = DELAY_P11 + DELAY_P10;
+	model->fixed_us = DELAY_P19 + DELAY_P12;
+	return true;
+}
+
 /* Bulk erase the chip */
 void pic18fj::bulk_erase(void)
 {
@@ -314,25 +333,154 @@ void pic18fj::read(char *outfile, uint32_t start, uint32_t count)
 			if(flags.client)
 				fprintf(stderr,"RED@%2d\n", (addr*100/mem.code_memory_size));
 			if(!flags.debug)
-				fprintf(stderr,"\b\b\b\b%2d%%]", addr*100/mem.code_memory_size);
+				progress(addr*100/mem.code_memory_size);
 			lcounter = addr*100/mem.code_memory_size;
 		}
 	}
 
 	if(!flags.debug) cerr << "\b\b\b\b\b";
 	if(flags.client) fprintf(stdout, "@FIN");
-	write_inhx(&mem, outfile);
+	if(outfile)
+		write_inhx(&mem, outfile);
+}
+
+/* Fill a 32 word row buffer, using 0xFFFF for empty locations */
+void pic18fj::prepare_row(uint32_t addr, uint16_t *row)
+{
+	int i;
+
+	for(i=0; i<32; i++){
+		row[i] = (mem.filled[addr+i]) ? mem.location[addr+i] : 0xFFFF;
+		if (flags.debug)
+			fprintf(stderr, "  Writing 0x%04X to address 0x%06X \n", row[i], (addr+i)*2 );
+	}
+}
+
+/* Load a row into the holding registers and start programming it */
+void pic18fj::program_row(uint32_t addr, uint16_t *row)
+{
+	int i;
+
+	goto_mem_location(2*addr);
+	if (flags.debug)
+		fprintf(stderr, "Go to address 0x%08X \n", addr);
+
+	for(i=0; i<31; i++){		                        /* write the first 62 bytes */
+		send_cmd(COMM_TABLE_WRITE_POST_INC_2);
+		write_data(row[i]);
+	}
+
+	/* write the last 2 bytes and start programming */
+	send_cmd(COMM_TABLE_WRITE_STARTP);
+	write_data(row[31]);
+
+	/* Programming Sequence */
+	GPIO_CLR(pic_data);
+	for (i = 0; i < 3; i++) {
+		GPIO_SET(pic_clk);
+		delay_clk();       /* Setup time */
+		GPIO_CLR(pic_clk);
+		delay_clk();       /* Hold time */
+	}
+	GPIO_SET(pic_clk);
+	gettimeofday(&row_start, 0);
+}
+
+/* Wait for the row started by program_row() to be programmed */
+void pic18fj::end_row(void)
+{
+	delay_since(&row_start, DELAY_P9);
+	GPIO_CLR(pic_clk);
+	delay_us(DELAY_P5);
+	write_data(0x0000);
+	/* end of Programming Sequence */
+}
+
+/* Erase the 512 word page containing addr (writes must be enabled) */
+void pic18fj::erase_page(uint32_t addr)
+{
+	goto_mem_location(2*(addr & ~0x1FF));
+	send_cmd(COMM_CORE_INSTRUCTION);
+	write_data(0x88A6);			/* BSF EECON1, FREE */
+	send_cmd(COMM_CORE_INSTRUCTION);
+	write_data(0x82A6);			/* BSF EECON1, WR */
+	send_cmd(COMM_CORE_INSTRUCTION);
+	write_data(0x0000);			/* NOP */
+	send_cmd(COMM_CORE_INSTRUCTION);
+	write_data(0x0000);			/* NOP */
+	GPIO_CLR(pic_data);			/* Hold PGD low until erase completes. */
+	delay_us(DELAY_P10);
+	send_cmd(COMM_CORE_INSTRUCTION);
+	write_data(0x98A6);			/* BCF EECON1, FREE */
+}
+
+/* Compare a 32 word row with the image, reporting nothing */
+bool pic18fj::verify_row(uint32_t row)
+{
+	uint32_t addr;
+	uint16_t data;
+
+	goto_mem_location(2*row);
+	for(addr = row; addr < row + 32; addr++){
+		send_cmd(COMM_TABLE_READ_POST_INC);
+		data = read_data();
+		send_cmd(COMM_TABLE_READ_POST_INC);
+		data = ( read_data() << 8 ) | ( data & 0xFF );
+		if(mem.filled[addr] && data != mem.location[addr])
+			return false;
+	}
+	return true;
+}
+
+/*
+ * Recover a row which does not verify: read it again, then erase its page
+ * and program again the page rows below upto.
+ */
+bool pic18fj::recover_row(uint32_t row, uint32_t upto)
+{
+	uint16_t data[32];
+	uint32_t page = row & ~0x1FF, r;
+	int attempt;
+	bool ok = false;
+
+	retry_begin();
+	for(attempt=0; attempt < flags.retries && !ok; attempt++){
+		if(verify_row(row)){
+			retries.reread++;
+			ok = true;
+			break;
+		}
+
+		erase_page(page);
+		for(r = page; r < page + 0x200 && r < upto; r += 32){
+			prepare_row(r, data);
+			program_row(r, data);
+			end_row();
+		}
+
+		ok = true;
+		for(r = page; r < page + 0x200 && r < upto && ok; r += 32)
+			ok = verify_row(r);
+		if(ok)
+			retries.rewritten++;
+	}
+
+	if(!ok)
+		retries.failed++;
+	retry_end();
+	return ok;
 }
 
 /* Bulk erase the chip, and then write contents of the .hex file to the PIC */
 void pic18fj::write(char *infile)
 {
-	int i;
 	uint16_t data;
+	uint16_t row[2][32];
+	uint8_t buf;
 	uint32_t addr = 0x00000000;
 	unsigned int filled_locations=1;
 
-	filled_locations = read_inhx(infile, &mem);
+	filled_locations = load_image(infile);
 
 	bulk_erase();
 
@@ -343,62 +491,27 @@ void pic18fj::write(char *infile)
 	send_cmd(COMM_CORE_INSTRUCTION);
 	write_data(0x84A6);			/* enable writes */
 
+	/* The next row is packed while the current one is being programmed */
+	buf = 0;
+	prepare_row(0, row[buf]);
+
 	for (addr = 0; addr < mem.code_memory_size; addr += 32){        /* address in WORDS (2 Bytes) */
 
-		goto_mem_location(2*addr);
-		if (flags.debug)
-			fprintf(stderr, "Go to address 0x%08X \n", addr);
-
-		for(i=0; i<31; i++){		                        /* write the first 62 bytes */
-			if (mem.filled[addr+i]) {
-				if (flags.debug)
-					fprintf(stderr, "  Writing 0x%04X to address 0x%06X \n", mem.location[addr + i], (addr+i)*2 );
-				send_cmd(COMM_TABLE_WRITE_POST_INC_2);
-				write_data(mem.location[addr+i]);
-			}
-			else {
-				if (flags.debug)
-					fprintf(stderr, "  Writing 0xFFFF to address 0x%06X \n", (addr+i)*2 );
-				send_cmd(COMM_TABLE_WRITE_POST_INC_2);
-				write_data(0xFFFF);			/* write 0xFFFF in empty locations */
-			};
-		}
+		program_row(addr, row[buf]);
 
-		/* write the last 2 bytes and start programming */
-		if (mem.filled[addr+31]) {
-			if (flags.debug)
-				fprintf(stderr, "  Writing 0x%04X to address 0x%06X and then start programming...\n", mem.location[addr+31], (addr+31)*2);
-			send_cmd(COMM_TABLE_WRITE_STARTP);
-			write_data(mem.location[addr+31]);
-		}
-		else {
-			if (flags.debug)
-				fprintf(stderr, "  Writing 0xFFFF to address 0x%06X and then start programming...\n", (addr+31)*2);
-			send_cmd(COMM_TABLE_WRITE_STARTP);
-			write_data(0xFFFF);			         /* write 0xFFFF in empty locations */
-		};
-
-		/* Programming Sequence */
-		GPIO_CLR(pic_data);
-		for (i = 0; i < 3; i++) {
-			GPIO_SET(pic_clk);
-			delay_us(DELAY_P2B);       /* Setup time */
-			GPIO_CLR(pic_clk);
-			delay_us(DELAY_P2A);       /* Hold time */
-		}
-		GPIO_SET(pic_clk);
-		delay_us(DELAY_P9);        /* Programming time */
-		GPIO_CLR(pic_clk);
-		delay_us(DELAY_P5);
-		write_data(0x0000);
-		/* end of Programming Sequence */
+		/* Programming time: report progress and pack the next row */
 		if(lcounter != addr*100/filled_locations){
 			lcounter = addr*100/filled_locations;
 			if(flags.client)
 				fprintf(stdout,"@%03d", lcounter);
 			if(!flags.debug)
-				fprintf(stderr,"\b\b\b\b\b[%2d%%]", lcounter);
+				progress(lcounter);
 		}
+		buf ^= 1;
+		if(addr + 32 < mem.code_memory_size)
+			prepare_row(addr + 32, row[buf]);
+
+		end_row();
 	};
 
 	if(!flags.debug) cerr << "\b\b\b\b\b\b";
@@ -424,6 +537,11 @@ void pic18fj::write(char *infile)
 						addr*2, data, (mem.filled[addr]) ? (mem.location[addr]) : 0xFFFF);
 
 			if ( (data != mem.location[addr]) & ( mem.filled[addr]) ) {
+				if(flags.retries && recover_row(addr & ~31, mem.code_memory_size)){
+					goto_mem_location(2*(addr+1));
+					continue;
+				}
+				errors++;
 				fprintf(stderr, "Error at addr = 0x%06X:  pic = 0x%04X, file = 0x%04X.\nExiting...",
 						addr*2, data, mem.location[addr]);
 				break;
@@ -433,7 +551,7 @@ void pic18fj::write(char *infile)
 				if(flags.client)
 					fprintf(stdout,"@%03d", lcounter);
 				if(!flags.debug)
-					fprintf(stderr,"\b\b\b\b\b[%2d%%]", lcounter);
+					progress(lcounter);
 			}
 		}
 
@@ -38,37 +38,19 @@ class pic18fj: public Pic{
 		void read(char *outfile, uint32_t start, uint32_t count);
 		void write(char *infile);
 		uint8_t blank_check(void);
+		bool plan_setup(const pic_device *dev, plan_model *model);
 
 	protected:
 		void send_cmd(uint8_t cmd);
 		uint16_t read_data(void);
 		void write_data(uint16_t data);
 		void goto_mem_location(uint32_t data);
-
-		/*
-		* DEVICES SECTION
-		*                    	ID       NAME           MEMSIZE
-		*/
-		pic_device piclist[22] = {{0x1D20,  "PIC18F44J10", 0x2000},
-								{0x1C20,  "PIC18F45J10", 0x4000},
-								{0x4D80,  "PIC18F24J11", 0x2000},
-								{0x4DA0,  "PIC18F25J11", 0x4000},
-								{0x4DC0,  "PIC18F26J11", 0x8000},
-								{0x4DE0,  "PIC18F44J11", 0x2000},
-								{0x4E00,  "PIC18F45J11", 0x4000},
-								{0x4E20,  "PIC18F46J11", 0x8000},
-								{0x4C00,  "PIC18F24J50", 0x2000},
-								{0x4C20,  "PIC18F25J50", 0x4000},
-								{0x4C40,  "PIC18F26J50", 0x8000},
-								{0x4C60,  "PIC18F44J50", 0x2000},
-								{0x4C80,  "PIC18F45J50", 0x4000},
-								{0x4CA0,  "PIC18F46J50", 0x8000},
-								{0x5920,  "PIC18F26J13", 0x8000},
-								{0x59A0,  "PIC18F46J13", 0x8000},
-								{0x5820,  "PIC18F26J53", 0x8000},
-								{0x58A0,  "PIC18F46J53", 0x8000},
-								{0x5960,  "PIC18F27J13", 0x10000},
-								{0x59E0,  "PIC18F47J13", 0x10000},
-								{0x5860,  "PIC18F27J53", 0x10000},
-								{0x58E0,  "PIC18F47J53", 0x10000}};
+		void prepare_row(uint32_t addr, uint16_t *row);
+		void program_row(uint32_t addr, uint16_t *row);
+		void end_row(void);
+		void erase_page(uint32_t addr);
+		bool verify_row(uint32_t row);
+		bool recover_row(uint32_t row, uint32_t upto);
+
+		struct timeval row_start;	/* programming of the last row started */
 };
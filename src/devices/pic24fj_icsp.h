@@ -0,0 +1,995 @@
+/*
+ * Raspberry Pi PIC Programmer using GPIO connector
+ * https://github.com/WallaceIT/picberry
+ * Copyright 2014 Francesco Valla
+ * Copyright 2016 Enric Balletbo i Serra
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PIC24FJ_ICSP_H_
+#define PIC24FJ_ICSP_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <iostream>
+
+#include "../common.h"
+#include "device.h"
+
+using namespace std;
+
+/*
+ * ICSP engine shared by the PIC24FJ (and PIC24FxxKA1xx) families, which
+ * differ only in the values below. Each family header defines a traits
+ * struct deriving from pic24fj_traits, overriding what differs, and each
+ * family .cpp holds the device table and the one instantiation of the
+ * engine for it.
+ */
+struct pic24fj_traits{
+	/* delays (in microseconds; nanoseconds are rounded to 1us) */
+	static constexpr unsigned int P4 = 1;		// 40ns
+	static constexpr unsigned int P4A = 1;		// 40ns
+	static constexpr unsigned int P5 = 1;		// 20ns
+	static constexpr unsigned int P6 = 1;		// 100ns
+	static constexpr unsigned int P7 = 25000;	// 25ms
+	static constexpr unsigned int P11 = 400000;	// 400ms, bulk erase
+	static constexpr unsigned int P13 = 2000;	// 2ms, row write
+	static constexpr unsigned int P16 = 0;		// 0s
+	static constexpr unsigned int P17 = 0;		// 0s
+	static constexpr unsigned int P18 = 1;		// 40ns
+	static constexpr unsigned int P19 = 1000;	// 1ms
+	static constexpr unsigned int P20 = 23;		// 23us, config write
+	static constexpr unsigned int P21 = 1;		// 8ns
+
+	static constexpr uint32_t enter_key = 0x4D434851;
+
+	static constexpr uint32_t tblpag = 0x880190;		// MOV W0, TBLPAG
+	static constexpr uint32_t erase_nvmcon = 0x404F;	// erase all program memory
+	static constexpr uint32_t row_nvmcon = 0x4001;		// program a row
+	static constexpr uint32_t row_words = 64;			// instruction words per row
+	static constexpr uint32_t config_nvmcon = 0x4003;	// program one word
+
+	/* Configuration words, from the lowest address */
+	static constexpr int config_words = 3;
+	static uint32_t config_addr(uint32_t code_memory_size){
+		return code_memory_size;
+	}
+};
+
+template<class T> class pic24fj_icsp : public Pic {
+
+	public:
+		void enter_program_mode(void);
+		void exit_program_mode(void);
+		bool setup_pe(void){return true;};
+		bool read_device_id(void);
+		void bulk_erase(void);
+		void dump_configuration_registers(void);
+		void read(char *outfile, uint32_t start, uint32_t count);
+		void write(char *infile);
+		uint8_t blank_check(void);
+		uint16_t erased_value(uint32_t addr){
+			return (addr < mem.code_memory_size && (addr & 1)) ? 0x00FF : 0xFFFF;
+		};
+
+	protected:
+		void send_cmd(uint32_t cmd);
+		uint16_t read_data(void);
+		void reset_pc(void){send_cmd(0x040200);};
+		void send_nop(void){send_cmd(0x000000);};
+		bool nvm_busy(void);
+		bool verify_group(uint32_t addr);
+
+		unsigned int	counter = 0;
+		uint16_t		nvmcon;
+};
+
+/* Send a 24-bit command to the PIC (LSB first) through a SIX instruction */
+template<class T>
+void pic24fj_icsp<T>::send_cmd(uint32_t cmd)
+{
+	uint8_t i;
+
+	GPIO_CLR(pic_data);
+
+	/* send the SIX = 0x0000 instruction */
+	for (i = 0; i < 4; i++) {
+		GPIO_SET(pic_clk);
+		delay_clk();
+		GPIO_CLR(pic_clk);
+		delay_clk();
+	}
+
+	delay_us(T::P4);
+
+	/* send the 24-bit command */
+	for (i = 0; i < 24; i++) {
+		if ( (cmd >> i) & 0x00000001 )
+			GPIO_SET(pic_data);
+		else
+			GPIO_CLR(pic_data);
+		delay_clk();
+		GPIO_SET(pic_clk);
+		delay_clk();
+		GPIO_CLR(pic_clk);
+	}
+
+	delay_us(T::P4A);
+}
+
+/* Read 16-bit data word from the PIC (LSB first) through a REGOUT inst */
+template<class T>
+uint16_t pic24fj_icsp<T>::read_data(void)
+{
+	uint8_t i;
+	uint16_t data = 0;
+
+	GPIO_CLR(pic_data);
+	GPIO_CLR(pic_clk);
+
+	/* send the REGOUT=0x0001 instruction */
+	for (i = 0; i < 4; i++) {
+		if ( (0x0001 >> i) & 0x001 )
+			GPIO_SET(pic_data);
+		else
+			GPIO_CLR(pic_data);
+		delay_clk();
+		GPIO_SET(pic_clk);
+		delay_clk();
+		GPIO_CLR(pic_clk);
+	}
+
+	delay_us(T::P4);
+
+	/* idle for 8 clock cycles, waiting for the data to be ready */
+	for (i = 0; i < 8; i++) {
+		GPIO_SET(pic_clk);
+		delay_clk();
+		GPIO_CLR(pic_clk);
+		delay_clk();
+	}
+
+	delay_us(T::P5);
+
+	GPIO_IN(pic_data);
+
+	/* read a 16-bit data word */
+	for (i = 0; i < 16; i++) {
+		GPIO_SET(pic_clk);
+		delay_clk();
+		data |= ( GPIO_LEV(pic_data) & 0x00000001 ) << i;
+		GPIO_CLR(pic_clk);
+		delay_clk();
+	}
+
+	delay_us(T::P4A);
+	GPIO_OUT(pic_data);
+	return data;
+}
+
+/* Read NVMCON; returns true while the WR bit is set */
+template<class T>
+bool pic24fj_icsp<T>::nvm_busy(void)
+{
+	reset_pc();
+	send_nop();
+	send_cmd(0x803B02); // MOV NVMCON, W2
+	send_cmd(0x883C22); // MOV W2, VISI
+	send_nop();
+	nvmcon = read_data(); // Clock out contents of the VISI register
+	send_nop();
+	return (nvmcon & 0x8000) == 0x8000;
+}
+
+/* Read back the 8 locations starting at addr and compare them with mem */
+template<class T>
+bool pic24fj_icsp<T>::verify_group(uint32_t addr)
+{
+	uint16_t i;
+	uint32_t data[8], raw_data[6];
+
+	send_cmd(0x200000 | ((addr & 0x00FF0000) >> 12) ); // MOV #<DestAddress23:16>, W0
+	send_cmd(T::tblpag); // MOV W0, TBLPAG
+	send_cmd(0x200006 | ((addr & 0x0000FFFF) << 4) ); // MOV #<DestAddress15:0>, W6
+
+	/* Fetch the next four memory locations and put them to W0:W5 */
+
+	/* Initialize the Write Pointer (w7) to point to the VISI register */
+	send_cmd(0x207847); // MOV #VISI, W7
+	send_nop();
+
+	send_cmd(0xEB0380); // CLR W7
+	send_nop();
+	send_cmd(0xBA1B96); // TBLRDL [W6], [W7++]
+	send_nop();
+	send_nop();
+	send_cmd(0xBADBB6); // TBLRDH.B [W6++], [W7++]
+	send_nop();
+	send_nop();
+	send_cmd(0xBADBD6); // TBLRDH.B [++W6], [W7++]
+	send_nop();
+	send_nop();
+	send_cmd(0xBA1BB6); // TBLRDL [W6++], [W7++]
+	send_nop();
+	send_nop();
+	send_cmd(0xBA1B96); // TBLRDL [W6], [W7++]
+	send_nop();
+	send_nop();
+	send_cmd(0xBADBB6); // TBLRDH.B [W6++], [W7++]
+	send_nop();
+	send_nop();
+	send_cmd(0xBADBD6); // TBLRDH.B [++W6], [W7++]
+	send_nop();
+	send_nop();
+	send_cmd(0xBA0BB6); // TBLRDL [W6++], [W7]
+	send_nop();
+	send_nop();
+
+	/* Read six data words (16 bits each) */
+	for (i = 0; i < 6; i++) {
+		send_cmd(0x883C20 + i); // MOV (W0 + i), VISI
+		send_nop();
+		raw_data[i] = read_data();
+		send_nop();
+	}
+
+	reset_pc();
+	send_nop();
+
+	/* store data correctly */
+	data[0] = raw_data[0];
+	data[1] = raw_data[1] & 0x00FF;
+	data[3] = (raw_data[1] & 0xFF00) >> 8;
+	data[2] = raw_data[2];
+	data[4] = raw_data[3];
+	data[5] = raw_data[4] & 0x00FF;
+	data[7] = (raw_data[4] & 0xFF00) >> 8;
+	data[6] = raw_data[5];
+
+	for (i = 0; i < 8; i++) {
+		if (flags.debug)
+			fprintf(stderr, "\n addr = 0x%06X data = 0x%04X", (addr+i), data[i]);
+
+		if (mem.filled[addr + i] && data[i] != mem.location[addr + i]) {
+			errors++;
+			fprintf(stderr,"\n\n ERROR at address %06X: written %04X but %04X read!\n\n",
+				addr + i, mem.location[addr + i], data[i]);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/* Enter program mode */
+template<class T>
+void pic24fj_icsp<T>::enter_program_mode(void)
+{
+	int i;
+
+	GPIO_OUT(pic_mclr);
+	GPIO_OUT(pic_data);
+
+	GPIO_CLR(pic_clk);
+
+	GPIO_CLR(pic_mclr);		/*  remove VDD from MCLR pin */
+	delay_us(T::P6);
+	GPIO_SET(pic_mclr);		/*  apply VDD to MCLR pin */
+	delay_us(T::P21);
+	GPIO_CLR(pic_mclr);		/* remove VDD from MCLR pin */
+	delay_us(T::P18);
+
+	/* Shift in the "enter program mode" key sequence (MSB first) */
+	for (i = 31; i > -1; i--) {
+		if ( (T::enter_key >> i) & 0x01 )
+			GPIO_SET(pic_data);
+		else
+			GPIO_CLR(pic_data);
+		delay_clk();
+		GPIO_SET(pic_clk);
+		delay_clk();
+		GPIO_CLR(pic_clk);
+
+	}
+
+	GPIO_CLR(pic_data);
+	delay_us(T::P19);
+	GPIO_SET(pic_mclr);
+	delay_us(T::P7);
+
+	/*
+	 * Coming out of Reset, ther first 4-bit control code is always forced
+	 * to SIX and a a forced NOP instruction is executed by the CPU. Five
+	 * additional PGCx clocks are needed on start-up, resulting in a 9-bit
+	 * SIX command instead of the normal 4-bit SIX command.
+	 */
+	for (i = 0; i < 5; i++) {
+		GPIO_SET(pic_clk);
+		delay_clk();
+		GPIO_CLR(pic_clk);
+		delay_clk();
+	}
+}
+
+/* Exit program mode */
+template<class T>
+void pic24fj_icsp<T>::exit_program_mode(void)
+{
+	GPIO_CLR(pic_clk);
+	GPIO_CLR(pic_data);
+	delay_us(T::P16);
+	GPIO_CLR(pic_mclr);	/* remove VDD from MCLR pin */
+	delay_us(T::P17);	/* wait (at least) P17 */
+	GPIO_IN(pic_mclr);
+}
+
+/* Read the device ID and revision; returns only the id */
+template<class T>
+bool pic24fj_icsp<T>::read_device_id(void)
+{
+	bool found = 0;
+
+	/* Exit Reset vector */
+	send_nop();
+	reset_pc();
+	send_nop();
+
+	/* Initialize TBLPAG and the Read Pointer (W6) for TBLRD instruction */
+	send_cmd(0x200FF0); // MOV #<SourceAddress23:16>, W0
+	send_cmd(T::tblpag); // MOV W0, TBLPAG
+	send_cmd(0x200006); // MOV #<SourceAddress15:0>, W6
+
+	/* Initialize the Write Pointer (W7) to point to the VISI register. */
+	send_cmd(0x207847); // MOV #VISI, W7
+	send_nop();
+
+	/*
+	 * Read and clock out the contents of the next two locations of code
+	 * memory (DEVID and DEVREV) through the VISI register, using the
+	 * REGOUT command.
+	 */
+	send_cmd(0xBA0BB6); // TBLRDL [W6++], [W7]
+	send_nop();
+	send_nop();
+	device_id = read_data(); // Clock out contents of VISI register
+	send_nop();
+
+	send_cmd(0xBA0BB6); // TBLRDL [W6++], [W7]
+	send_nop();
+	send_nop();
+	device_rev = read_data(); // Clock out contents of VISI register
+	send_nop();
+
+	/* Reset device internal PC */
+	reset_pc();
+	send_nop();
+
+	const pic_device *dev = devdb_lookup(T::db, device_id);
+	if (dev) {
+		strcpy(name, dev->name);
+		mem.code_memory_size = dev->code_memory_size;
+		mem.program_memory_size = 0x0F80018;
+		free(mem.location);	// left by a previous read_device_id()
+		free(mem.filled);
+		mem.location = (uint16_t*) calloc(mem.program_memory_size,sizeof(uint16_t));
+		mem.filled = (bool*) calloc(mem.program_memory_size,sizeof(bool));
+		found = 1;
+	}
+
+	return found;
+}
+
+/* Check if the device is blank */
+template<class T>
+uint8_t pic24fj_icsp<T>::blank_check(void)
+{
+	uint32_t addr;
+	unsigned short i;
+	uint16_t data[8], raw_data[6];
+	uint8_t ret = 0;
+
+	if(!flags.debug)
+	  cerr << "[ 0%]";
+
+	counter=0;
+
+	/* Exit Reset vector */
+	send_nop();
+	reset_pc();
+	send_nop();
+
+	/* Output data to W0:W5; repeat until all desired code memory is read. */
+	for (addr = 0; addr < mem.code_memory_size; addr = addr + 8) {
+		if ((addr & 0x0000FFFF) == 0) {
+			send_cmd(0x200000 | ((addr & 0x00FF0000) >> 12) ); // MOV #<DestAddress23:16>, W0
+			send_cmd(T::tblpag);	// MOV W0, TBLPAG
+			send_cmd(0x200006 | ((addr & 0x0000FFFF) << 4) ); // MOV #<DestAddress15:0>, W6
+		}
+
+		/* Fetch the next four memory locations and put them to W0:W5 */
+
+		/* Initialize the Write Pointer (w7) to point to the VISI register */
+		send_cmd(0x207847); // MOV #VISI, W7
+		send_nop();
+
+		send_cmd(0xEB0380); // CLR W7
+		send_nop();
+		send_cmd(0xBA1B96); // TBLRDL [W6], [W7++]
+		send_nop();
+		send_nop();
+		send_cmd(0xBADBB6); // TBLRDH.B [W6++], [W7++]
+		send_nop();
+		send_nop();
+		send_cmd(0xBADBD6); // TBLRDH.B [++W6], [W7++]
+		send_nop();
+		send_nop();
+		send_cmd(0xBA1BB6); // TBLRDL [W6++], [W7++]
+		send_nop();
+		send_nop();
+		send_cmd(0xBA1B96); // TBLRDL [W6], [W7++]
+		send_nop();
+		send_nop();
+		send_cmd(0xBADBB6); // TBLRDH.B [W6++], [W7++]
+		send_nop();
+		send_nop();
+		send_cmd(0xBADBD6); // TBLRDH.B [++W6], [W7++]
+		send_nop();
+		send_nop();
+		send_cmd(0xBA0BB6); // TBLRDL [W6++], [W7]
+		send_nop();
+		send_nop();
+
+		/* Read six data words (16 bits each) */
+		for (i = 0; i < 6; i++) {
+			send_cmd(0x883C20 + i); // MOV (W0 + i), VISI
+			send_nop();
+			raw_data[i] = read_data();
+			send_nop();
+		}
+
+		reset_pc();
+		send_nop();
+
+		/* store data correctly */
+		data[0] = raw_data[0];
+		data[1] = raw_data[1] & 0x00FF;
+		data[3] = (raw_data[1] & 0xFF00) >> 8;
+		data[2] = raw_data[2];
+		data[4] = raw_data[3];
+		data[5] = raw_data[4] & 0x00FF;
+		data[7] = (raw_data[4] & 0xFF00) >> 8;
+		data[6] = raw_data[5];
+
+		if(counter != addr * 100 / mem.code_memory_size){
+			counter = addr * 100 / mem.code_memory_size;
+			progress(counter);
+		}
+
+		for (i = 0; i < 8; i++) {
+			/* If we are at the end of code_memory_size just break */
+			if ((addr + i) > mem.code_memory_size)
+			  break;
+			if (flags.debug)
+				fprintf(stderr, "\n addr = 0x%06X data = 0x%04X", (addr + i), data[i]);
+			if ((i%2 == 0 && data[i] != 0xFFFF) || (i%2 == 1 && data[i] != 0x00FF)) {
+				if (!flags.debug)
+				  cerr << "\b\b\b\b\b";
+				ret = 1;
+				addr = mem.code_memory_size + 10;
+				break;
+			}
+		}
+	}
+
+	if (addr <= (mem.code_memory_size + 8)) {
+		if (!flags.debug)
+		  cerr << "\b\b\b\b\b";
+		ret = 0;
+	};
+
+	/* Exit Reset vector */
+	send_nop();
+	reset_pc();
+	send_nop();
+
+	return ret;
+}
+
+/* Bulk erase the chip */
+template<class T>
+void pic24fj_icsp<T>::bulk_erase(void)
+{
+	/* Exit the Reset vector */
+	send_nop();
+	reset_pc();
+	send_nop();
+
+	/* Set the NVMCON to erase all program memory */
+	send_cmd(0x20000A | (T::erase_nvmcon << 4)); // MOV #<NVMCON>, W10
+	send_cmd(0x883B0A); // MOV W10, NVMCON
+
+	/*
+	 * Set TBLPAG and perform dummy table write to select what portions
+	 * of memory are erased.
+	 */
+	send_cmd(0x200000); // MOV #<PAGEVAL>, W0
+	send_cmd(T::tblpag); // MOV W0, TBLPAG
+	send_cmd(0x200000); // MOV #0x0000, W0
+	send_cmd(0xBB0800); // TBLWTL W0,[W0]
+	send_nop();
+	send_nop();
+
+	/* Initiate the erase cycle */
+	send_cmd(0xA8E761); // BSET NVMCON, #WR
+	nvm_begin();
+	send_nop();
+	send_nop();
+
+	/* Wait while the erase operation completes */
+	if(!nvm_wait(&erase_stats, T::P11)){
+		if(flags.client) fprintf(stdout, "@ERR");
+		return;
+	}
+
+	if(flags.client)
+		fprintf(stdout, "@FIN");
+}
+
+/* Read PIC memory and write the contents to a .hex file */
+template<class T>
+void pic24fj_icsp<T>::read(char *outfile, uint32_t start, uint32_t count)
+{
+	uint32_t addr, startaddr, stopaddr;
+	uint16_t data[8], raw_data[6];
+	int i = 0;
+
+	startaddr = start;
+	stopaddr = mem.code_memory_size;
+
+	if (count != 0 && count < stopaddr) {
+		stopaddr = startaddr + count;
+		fprintf(stderr, "Read only %d memory locations, from %06X to %06X\n",
+			count, startaddr, stopaddr);
+	}
+
+	if (!flags.debug) cerr << "[ 0%]";
+	if (flags.client) fprintf(stdout, "@000");
+
+	counter = 0;
+
+	/* Exit Reset vector */
+	send_nop();
+	reset_pc();
+	send_nop();
+
+	/* Output data to W0:W5; repeat until all desired code memory is read. */
+	for (addr = startaddr; addr < stopaddr; addr = addr + 8) {
+		if((addr & 0x0000FFFF) == 0 || startaddr != 0) {
+			send_cmd(0x200000 | ((addr & 0x00FF0000) >> 12) ); // MOV #<DestAddress23:16>, W0
+			send_cmd(T::tblpag); // MOV W0, TBLPAG
+			send_cmd(0x200006 | ((addr & 0x0000FFFF) << 4) ); // MOV #<DestAddress15:0>, W6
+			startaddr = 0;
+		}
+
+		/* Fetch the next four memory locations and put them to W0:W5 */
+
+		/* Initialize the Write Pointer (w7) to point to the VISI register */
+		send_cmd(0x207847); // MOV #VISI, W7
+		send_nop();
+
+		send_cmd(0xEB0380); // CLR W7
+		send_nop();
+		send_cmd(0xBA1B96); // TBLRDL [W6], [W7++]
+		send_nop();
+		send_nop();
+		send_cmd(0xBADBB6); // TBLRDH.B [W6++], [W7++]
+		send_nop();
+		send_nop();
+		send_cmd(0xBADBD6); // TBLRDH.B [++W6], [W7++]
+		send_nop();
+		send_nop();
+		send_cmd(0xBA1BB6); // TBLRDL [W6++], [W7++]
+		send_nop();
+		send_nop();
+		send_cmd(0xBA1B96); // TBLRDL [W6], [W7++]
+		send_nop();
+		send_nop();
+		send_cmd(0xBADBB6); // TBLRDH.B [W6++], [W7++]
+		send_nop();
+		send_nop();
+		send_cmd(0xBADBD6); // TBLRDH.B [++W6], [W7++]
+		send_nop();
+		send_nop();
+		send_cmd(0xBA0BB6); // TBLRDL [W6++], [W7]
+		send_nop();
+		send_nop();
+
+		/* Read six data words (16 bits each) */
+		for (i = 0; i < 6; i++) {
+			send_cmd(0x883C20 + i); // MOV (W0 + i), VISI
+			send_nop();
+			raw_data[i] = read_data();
+			send_nop();
+		}
+
+		reset_pc();
+		send_nop();
+
+		/* store data correctly */
+		data[0] = raw_data[0];
+		data[1] = raw_data[1] & 0x00FF;
+		data[3] = (raw_data[1] & 0xFF00) >> 8;
+		data[2] = raw_data[2];
+		data[4] = raw_data[3];
+		data[5] = raw_data[4] & 0x00FF;
+		data[7] = (raw_data[4] & 0xFF00) >> 8;
+		data[6] = raw_data[5];
+
+		for (i = 0; i < 8; i++) {
+			if (flags.debug)
+				fprintf(stderr, "\n addr = 0x%06X data = 0x%04X",
+					(addr + i), data[i]);
+
+			if (i % 2 == 0 && data[i] != 0xFFFF) {
+				mem.location[addr + i] = data[i];
+				mem.filled[addr + i] = 1;
+			}
+
+			if (i % 2 == 1 && data[i] != 0x00FF) {
+				mem.location[addr+i] = data[i];
+				mem.filled[addr+i] = 1;
+			}
+		}
+
+		if (counter != addr * 100 / stopaddr) {
+			counter = addr * 100 / stopaddr;
+			if (flags.client)
+				fprintf(stdout,"@%03d", counter);
+			if (!flags.debug)
+				progress(counter);
+		}
+
+		/* TODO: checksum */
+	}
+
+	/* READ CONFIGURATION REGISTERS */
+	addr = T::config_addr(mem.code_memory_size);
+
+	/* Exit Reset vector */
+	send_nop();
+	reset_pc();
+	send_nop();
+
+	/*
+	 * Initialize TBLPAG, the Read Pointer (W6) and the Write Pointer (W7)
+	 * for TBLRD instruction
+	 */
+	send_cmd(0x200000 | ((addr & 0x00FF0000) >> 12) ); // MOV #<DestAddress23:16>, W0
+	send_cmd(T::tblpag); // MOV W0, TBLPAG
+	send_cmd(0x200006 | ((addr & 0x0000FFFF) << 4) ); // MOV #<DestAddress15:0>, W6
+	send_cmd(0x207847); // MOV #VISI, W7
+	send_nop();
+
+	for (i = 0; i < T::config_words; i++) {
+		send_cmd(0xBA0BB6); // TBLRDL [W6++], [W7]
+		send_nop();
+		send_nop();
+		data[0] = read_data();
+
+		if (data[0] != 0xFFFF) {
+			mem.location[addr + 2 * i] = data[0];
+			mem.filled[addr + 2 * i] = 1;
+		}
+	}
+
+	reset_pc();
+	send_nop();
+
+	if(!flags.debug) cerr << "\b\b\b\b\b";
+	if(flags.client) fprintf(stdout, "@FIN");
+	if(outfile)
+		write_inhx(&mem, outfile);
+}
+
+/* Write contents of the .hex file to the PIC */
+template<class T>
+void pic24fj_icsp<T>::write(char *infile)
+{
+	uint16_t i,j,p;
+	uint32_t k, row;
+	bool skip;
+	uint32_t data[8];
+	uint32_t addr = 0, erase_errors;
+
+	unsigned int filled_locations=1;
+
+	filled_locations = load_image(infile);
+	if (!filled_locations) return;
+
+	erase_errors = errors;
+	bulk_erase();
+	if(errors != erase_errors)
+		return;		// bulk_erase() has sent @ERR
+
+	/* WRITE CODE MEMORY */
+
+	/* Exit Reset vector */
+	send_nop();
+	reset_pc();
+	send_nop();
+
+	/* Set the NVMCON to program a row */
+	send_cmd(0x20000A | (T::row_nvmcon << 4)); // MOV #<NVMCON>, W10
+	send_cmd(0x883B0A); // MOV W10, NVMCON
+
+	if (!flags.debug) cerr << "[ 0%]";
+	if (flags.client) fprintf(stdout, "@000");
+
+	counter = 0;
+
+	for (addr = 0; addr < mem.code_memory_size; ){
+
+		skip = 1;
+
+		for (k = 0; k < 2 * T::row_words; k += 2)
+			if (mem.filled[addr + k]) skip = 0;
+
+		if (skip) {
+			addr = addr + 2 * T::row_words;
+			continue;
+		}
+
+		row = addr;
+
+		/* Initialize the Write Pointer (W7) for TBLWT instruction */
+		send_cmd(0x200000 | ((addr & 0x00FF0000) >> 12) ); // MOV #<DestinationAddress23:16>, W0
+		send_cmd(T::tblpag);
+		send_cmd(0x200007 | ((addr & 0x0000FFFF) << 4) ); // MOV #<DestinationAddress15:0>, W7
+
+		for (p = 0; p < T::row_words / 4; p++) {
+			for (j = 0; j < 8; j++) {
+				if (mem.filled[addr + j])
+					data[j] = mem.location[addr + j];
+				else
+					data[j] = 0xFFFF;
+				if (flags.debug)
+					fprintf(stderr,"\n  Writing 0x%04X to address 0x%06X ", data[j], addr + j);
+			}
+
+			send_cmd(0x200000 | (data[0] << 4)); // MOV #<LSW0>, W0
+			send_cmd(0x200001 | (0x00FFFF & ((data[3] << 8) | (data[1] & 0x00FF))) <<4); // MOV #<MSB1:MSB0>, W1
+			send_cmd(0x200002 | (data[2] << 4)); // MOV #<LSW1>, W2
+			send_cmd(0x200003 | (data[4] << 4)); // MOV #<LSW2>, W3
+			send_cmd(0x200004 | (0x00FFFF & ((data[7] << 8) | (data[5] & 0x00FF))) <<4); // MOV #<MSB3:MSB2>, W4
+			send_cmd(0x200005 | (data[6] << 4)); // MOV #<LSW3>, W5
+
+			/* Set the Read Pointer (W6) and load the (next set of) write latches */
+			send_cmd(0xEB0300); // CLR W6
+			send_nop();
+			send_cmd(0xBB0BB6); // TBLWTL [W6++], [W7]
+			send_nop();
+			send_nop();
+			send_cmd(0xBBDBB6); // TBLWTH.B [W6++], [W7++]
+			send_nop();
+			send_nop();
+			send_cmd(0xBBEBB6); // TBLWTH.B [W6++], [++W7]
+			send_nop();
+			send_nop();
+			send_cmd(0xBB1BB6); // TBLWTL [W6++], [W7++]
+			send_nop();
+			send_nop();
+			send_cmd(0xBB0BB6); // TBLWTL [W6++], [W7]
+			send_nop();
+			send_nop();
+			send_cmd(0xBBDBB6); // TBLWTH.B [W6++], [W7++]
+			send_nop();
+			send_nop();
+			send_cmd(0xBBEBB6); // TBLWTH.B [W6++], [++W7]
+			send_nop();
+			send_nop();
+			send_cmd(0xBB1BB6); // TBLWTL [W6++], [W7++]
+			send_nop();
+			send_nop();
+
+			addr = addr + 8;
+		}
+
+		/* Initiate the write cycle */
+		send_cmd(0xA8E761); // BSET NVMCON, #WR
+		nvm_begin();
+		send_nop();
+		send_nop();
+
+		/* Wait while the erase operation completes */
+		if(!nvm_wait(&row_stats, T::P13)){
+			if(flags.client) fprintf(stdout, "@ERR");
+			return;
+		}
+
+		reset_pc();
+		send_nop();
+
+		/* Verify the row while its address is fresh, abort on mismatch */
+		if (flags.row_verify) {
+			for (k = row; k < addr; k += 8) {
+				if (!mem.filled[k] && !mem.filled[k + 2] &&
+					!mem.filled[k + 4] && !mem.filled[k + 6])
+					continue;
+				if (!verify_group(k)) {
+					if (flags.client) fprintf(stdout, "@ERR");
+					return;
+				}
+			}
+		}
+
+		if (counter != addr * 100 / filled_locations) {
+			if (flags.client)
+				fprintf(stdout,"@%03d", (addr * 100 / (filled_locations + 0x80)));
+			if (!flags.debug)
+				progress(addr * 100 / (filled_locations + 0x80));
+			counter = addr * 100 / filled_locations;
+		}
+	};
+
+	if (!flags.debug) cerr << "\b\b\b\b\b\b";
+	if (flags.client) fprintf(stdout, "@100");
+
+	delay_us(100000);
+
+	/* WRITE CONFIGURATION REGISTERS */
+	if (flags.debug)
+		cerr << endl << "Writing Configuration registers..." << endl;
+
+	/* Exit the Reset vector */
+	send_nop();
+	reset_pc();
+	send_nop();
+
+	/*
+	 * The Configuration registers are the last implemented program memory
+	 * locations (the configuration space on the PIC24FxxKA1xx), see the
+	 * register table in each family header
+	 */
+	addr = T::config_addr(mem.code_memory_size);
+
+	/* Initialize the Write Pointer (W7) for TBLWT instruction */
+
+	/* Set the NVMCON to program 1 instruction word */
+	send_cmd(0x20000A | (T::config_nvmcon << 4)); // MOV #<NVMCON>, W10
+	send_cmd(0x883B0A); // MOV W10, NVMCON
+
+	for (i = 0; i < T::config_words; i++) {
+		if (mem.filled[addr]) {
+			/* Initialize the Write Pointer (W7) for TBLWT instruction */
+			send_cmd(0x200000 | ((addr & 0x00FF0000) >> 12) ); // MOV #<CWxAddress23:16>, W0
+			send_cmd(T::tblpag);
+			send_cmd(0x200007 | ((addr & 0x0000FFFF) << 4) ); // MOV #<CWxAddress15:0>, W7
+
+			/* Load the Configuration register data to W6 */
+			send_cmd(0x200006 | ((0x0000FFFF & mem.location[addr]) << 4));
+
+			/*
+			 * Write the Configuration register data to the write
+			 * latch and increment the Write Pointer
+			 */
+			send_nop();
+			send_cmd(0xBB1B86); // TBLWTL W6, [W7++]
+			send_nop();
+			send_nop();
+
+			/* Initiate the write cycle */
+			send_cmd(0xA8E761);
+			nvm_begin();
+			send_nop();
+			send_nop();
+
+			/* Wait while the erase operation completes */
+			if(!nvm_wait(&config_stats, T::P20)){
+				if(flags.client) fprintf(stdout, "@ERR");
+				return;
+			}
+
+			if(flags.debug)
+				fprintf(stderr,"\n - %s set to 0x%01x",
+						T::regname[i], mem.location[addr]);
+		} else if(flags.debug) {
+			fprintf(stderr,"\n - %s left unchanged", T::regname[i]);
+		}
+
+		addr = addr + 2;
+	}
+
+	if (flags.debug) cerr << endl;
+
+	delay_us(100000);
+
+	/* VERIFY CODE MEMORY */
+	if (!flags.noverify && !flags.row_verify){
+		if (!flags.debug) cerr << "[ 0%]";
+		if (flags.client) fprintf(stdout, "@000");
+
+		counter = 0;
+
+		send_nop();
+		reset_pc();
+		send_nop();
+
+		for (addr = 0; addr < mem.code_memory_size; addr = addr + 8) {
+			skip = 1;
+
+			for(k = 0; k < 8; k += 2)
+				if (mem.filled[addr + k])
+					skip = 0;
+
+			if (skip) continue;
+
+			if (!verify_group(addr)) return;
+
+			if (counter != addr * 100 / filled_locations) {
+				if (flags.client)
+					fprintf(stdout,"@%03d", (addr*100/(filled_locations+0x100)));
+				if (!flags.debug)
+					progress(addr*100/(filled_locations+0x100));
+				counter = addr * 100 / filled_locations;
+			}
+		}
+
+		if (!flags.debug) cerr << "\b\b\b\b\b";
+		if (flags.client) fprintf(stdout, "@FIN");
+	} else {
+		if (flags.client) fprintf(stdout, "@FIN");
+	}
+}
+
+/* Write to screen the configuration registers, without saving them anywhere */
+template<class T>
+void pic24fj_icsp<T>::dump_configuration_registers(void)
+{
+	uint32_t addr = T::config_addr(mem.code_memory_size);
+
+	cerr << endl << "Configuration registers:" << endl << endl;
+
+	/* Exit Reset vector */
+	send_nop();
+	reset_pc();
+	send_nop();
+
+	/*
+	 * Initialize TBLPAG, the Read Pointer (W6) and the Write Pointer (W7)
+	 * for TBLRD instruction
+	 */
+
+	send_cmd(0x200000 | ((addr & 0x00FF0000) >> 12) ); // MOV #<DestAddress23:16>, W0
+	send_cmd(T::tblpag); // MOV W0, TBLPAG
+	send_cmd(0x200006 | ((addr & 0x0000FFFF) << 4) ); // MOV #<DestAddress15:0>, W6
+	send_cmd(0x207847); // MOV #VISI, W7
+	send_nop();
+
+	for (unsigned short i = 0; i < T::config_words; i++) {
+		send_cmd(0xBA0BB6); // TBLRDL [W6++], [W7]
+		send_nop();
+		send_nop();
+		fprintf(stderr," - %s: 0x%04x\n", T::regname[i], read_data());
+		send_nop();
+	}
+
+	cerr << endl;
+
+	reset_pc();
+	send_nop();
+}
+
+#endif
@@ -18,39 +18,25 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-#include <iostream>
+#include "pic24fj_icsp.h"
 
-#include "../common.h"
-#include "device.h"
-
-using namespace std;
-
-class pic24fjxxga1xx_gb0xx : public Pic {
-
-	public:
-		void enter_program_mode(void);
-		void exit_program_mode(void);
-		bool setup_pe(void){return true;};
-		bool read_device_id(void);
-		void bulk_erase(void);
-		void dump_configuration_registers(void);
-		void read(char *outfile, uint32_t start, uint32_t count);
-		void write(char *infile);
-		uint8_t blank_check(void);
-
-	protected:
-		void send_cmd(uint32_t cmd);
-		uint16_t read_data(void);
+/*
+ * The last four implemented program memory locations are reserved for the
+ * device Configuration registers
+ *
+ * +----------------+---------+---------+---------+---------+
+ * |   Device       |   CW1   |   CW2   |   CW3   |   CW4   |
+ * +----------------+---------+---------+---------+---------+
+ * | PIC24FJ32Gxxx  | 0057FEh | 0057FCh | 0057FAh | 0057F8h |
+ * | PIC24FJ64Gxxx  | 00ABFEh | 00ABFCh | 00ABFAh | 00ABF8h |
+ * +--------------------------------------------------------+
+ */
+struct pic24fjxxga1xx_gb0xx_traits : pic24fj_traits{
+	static constexpr int config_words = 4;
 
-		/*
-		 *                         ID       NAME             MEMSIZE
-		 */
-		pic_device piclist[8] = {{0x4202, "PIC24FJ32GA102", 0x0057F8},
-					  {0x420A, "PIC24FJ32GA104", 0x0057F8},
-					  {0x4203, "PIC24FJ32GB002", 0x0057F8},
-					  {0x420B, "PIC24FJ32GB004", 0x0057F8},
-					  {0x4206, "PIC24FJ64GA102", 0x00ABF8},
-					  {0x420E, "PIC24FJ64GA104", 0x00ABF8},
-					  {0x4207, "PIC24FJ64GB002", 0x00ABF8},
-					  {0x420F, "PIC24FJ64GB004", 0x00ABF8}};
+	static constexpr devdb db = DB_PIC24FJXXGA1XX_GB0XX;
+	static const char *const regname[];	// configuration words, from the lowest
 };
+
+typedef pic24fj_icsp<pic24fjxxga1xx_gb0xx_traits> pic24fjxxga1xx_gb0xx;
+extern template class pic24fj_icsp<pic24fjxxga1xx_gb0xx_traits>;
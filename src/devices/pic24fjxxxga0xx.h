@@ -18,48 +18,29 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-#include <iostream>
+#include "pic24fj_icsp.h"
 
-#include "../common.h"
-#include "device.h"
-
-using namespace std;
-
-class pic24fjxxxga0xx : public Pic {
-
-	public:
-		void enter_program_mode(void);
-		void exit_program_mode(void);
-		bool setup_pe(void){return true;};
-		bool read_device_id(void);
-		void bulk_erase(void);
-		void dump_configuration_registers(void);
-		void read(char *outfile, uint32_t start, uint32_t count);
-		void write(char *infile);
-		uint8_t blank_check(void);
-
-	protected:
-		void send_cmd(uint32_t cmd);
-		uint16_t read_data(void);
+/*
+ * The last two implemented program memory locations are reserved for the
+ * device Configuration registers
+ *
+ * +--------------+---------+---------+
+ * |   Device     |   CW1   |   CW2   |
+ * +--------------+---------+---------+
+ * | PIC24FJ16GA  | 002BFEh | 002BFCh |
+ * | PIC24FJ32GA  | 0057FEh | 0053FCh |
+ * | PIC24FJ48GA  | 0083FEh | 0083FCh |
+ * | PIC24FJ64GA  | 00ABFEh | 00ABFCh |
+ * | PIC24FJ96GA  | 00FFFEh | 00FFFCh |
+ * | PIC24FJ128GA | 0157FEh | 0157FCh |
+ * +----------------------------------+
+ */
+struct pic24fjxxxga0xx_traits : pic24fj_traits{
+	static constexpr int config_words = 2;
 
-		/*
-		 *                         ID       NAME             MEMSIZE
-		 */
-		pic_device piclist[17] = {{0x0444, "PIC24FJ16GA002", 0x002BFC},
-					  {0x044C, "PIC24FJ16GA004", 0x002BFC},
-					  {0x0445, "PIC24FJ32GA002", 0x0057FC},
-					  {0x044D, "PIC24FJ32GA004", 0x0057FC},
-					  {0x0446, "PIC24FJ48GA002", 0x0083FC},
-					  {0x044E, "PIC24FJ48GA004", 0x0083FC},
-					  {0x0447, "PIC24FJ64GA002", 0x00ABFC},
-					  {0x044F, "PIC24FJ64GA004", 0x00ABFC},
-					  {0x0405, "PIC24FJ64GA006", 0x00ABFC},
-					  {0x0408, "PIC24FJ64GA008", 0x00ABFC},
-					  {0x040B, "PIC24FJ64GA010", 0x00ABFC},
-					  {0x0406, "PIC24FJ96GA006", 0x00FFFC},
-					  {0x0409, "PIC24FJ96GA008", 0x00FFFC},
-					  {0x040C, "PIC24FJ96GA010", 0x00FFFC},
-					  {0x0407, "PIC24FJ128GA006", 0x0157FC},
-					  {0x040A, "PIC24FJ128GA008", 0x0157FC},
-					  {0x040D, "PIC24FJ128GA010", 0x0157FC}};
+	static constexpr devdb db = DB_PIC24FJXXXGA0XX;
+	static const char *const regname[];	// configuration words, from the lowest
 };
+
+typedef pic24fj_icsp<pic24fjxxxga0xx_traits> pic24fjxxxga0xx;
+extern template class pic24fj_icsp<pic24fjxxxga0xx_traits>;
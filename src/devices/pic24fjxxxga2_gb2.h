@@ -18,39 +18,33 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-#include <iostream>
+#include "pic24fj_icsp.h"
 
-#include "../common.h"
-#include "device.h"
-
-using namespace std;
-
-class pic24fjxxxga2_gb2 : public Pic {
+/*
+ * The last four implemented program memory locations are reserved for the
+ * device Configuration registers
+ *
+ * +-----------------+---------+---------+---------+---------+
+ * |   Device        |   CW1   |   CW2   |   CW3   |   CW4   |
+ * +-----------------+---------+---------+---------+---------+
+ * | PIC24FJ64GA2XX  | 00ABFEh | 00ABFCh | 00ABFAh | 00ABF8h |
+ * | PIC24FJ64GB2XX  | 00ABFEh | 00ABFCh | 00ABFAh | 00ABF8h |
+ * | PIC24FJ128GA2XX | 0157FEh | 0157FCh | 0157FAh | 0157F8h |
+ * | PIC24FJ128GB2XX | 0157FEh | 0157FCh | 0157FAh | 0157F8h |
+ * +---------------------------------------------------------+
+ */
+struct pic24fjxxxga2_gb2_traits : pic24fj_traits{
+	static constexpr unsigned int P11 = 20000;	// 20ms
+	static constexpr unsigned int P17 = 1;		// 100ns
+	static constexpr unsigned int P18 = 10000;	// 10ms
 
-	public:
-		void enter_program_mode(void);
-		void exit_program_mode(void);
-		bool setup_pe(void){return true;};
-		bool read_device_id(void);
-		void bulk_erase(void);
-		void dump_configuration_registers(void);
-		void read(char *outfile, uint32_t start, uint32_t count);
-		void write(char *infile);
-		uint8_t blank_check(void);
+	static constexpr uint32_t tblpag = 0x8802A0;		// MOV W0, TBLPAG
 
-	protected:
-		void send_cmd(uint32_t cmd);
-		uint16_t read_data(void);
+	static constexpr int config_words = 4;
 
-		/*
-		 *                         ID       NAME             MEMSIZE
-		 */
-		pic_device piclist[8] = {{0x4C5B, "PIC24FJ128GB204", 0x0157F8},
-					 {0x4C5A, "PIC24FJ128GB202", 0x0157F8},
-					 {0x4C59, "PIC24FJ64GB204",  0x00ABF8},
-					 {0x4C58, "PIC24FJ64GB202",  0x00ABF8},
-					 {0x4C53, "PIC24FJ128GA204", 0x0157F8},
-					 {0x4C52, "PIC24FJ128GA202", 0x0157F8},
-					 {0x4C51, "PIC24FJ64GA204",  0x00ABF8},
-					 {0x4C50, "PIC24FJ64GA202",  0x00ABF8}};
+	static constexpr devdb db = DB_PIC24FJXXXGA2_GB2;
+	static const char *const regname[];	// configuration words, from the lowest
 };
+
+typedef pic24fj_icsp<pic24fjxxxga2_gb2_traits> pic24fjxxxga2_gb2;
+extern template class pic24fj_icsp<pic24fjxxxga2_gb2_traits>;
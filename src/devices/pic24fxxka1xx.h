@@ -18,47 +18,31 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-#include <iostream>
+#include "pic24fj_icsp.h"
 
-#include "../common.h"
-#include "device.h"
-
-using namespace std;
-
-class pic24fxxka1xx : public Pic {
+/*
+ * The Configuration registers are not in program memory but in the
+ * configuration space, one word each from 0xF80000:
+ * FBS, FGS, FOSCSEL, FOSC, FWDT, FPOR, FICD, FDS
+ */
+struct pic24fxxka1xx_traits : pic24fj_traits{
+	static constexpr unsigned int P11 = 2500;	// 2.5ms
+	static constexpr unsigned int P13 = 1250;	// 1.25ms
+	static constexpr unsigned int P18 = 1000;	// 1ms
 
-	public:
-		void enter_program_mode(void);
-		void exit_program_mode(void);
-		bool setup_pe(void){return true;};
-		bool read_device_id(void);
-		void bulk_erase(void);
-		void dump_configuration_registers(void);
-		void read(char *outfile, uint32_t start, uint32_t count);
-		void write(char *infile);
-		uint8_t blank_check(void);
+	static constexpr uint32_t erase_nvmcon = 0x4064;	// erase all program memory
+	static constexpr uint32_t row_nvmcon = 0x4004;		// program a row
+	static constexpr uint32_t row_words = 32;			// instruction words per row
+	static constexpr uint32_t config_nvmcon = 0x4004;	// program one word
 
-	protected:
-		void send_cmd(uint32_t cmd);
-		uint16_t read_data(void);
+	static constexpr int config_words = 8;
+	static uint32_t config_addr(uint32_t){
+		return 0xF80000;
+	}
 
-		/*
-		 *                         ID       NAME             MEMSIZE
-		 */
-		pic_device piclist[16] = {{0x0D08, "PIC24F08KA101", 0x0015FF},
-					  {0x0D01, "PIC24F16KA101", 0x002BFF},
-					  {0x0D0A, "PIC24F08KA102", 0x0015FF},
-					  {0x0D03, "PIC24F16KA102", 0x002BFF},
-					  {0x4509, "PIC24FV16KA301", 0x002BFF},
-					  {0x4508, "PIC24F16KA301", 0x002BFF},
-					  {0x4503, "PIC24FV16KA302", 0x002BFF},
-					  {0x4502, "PIC24F16KA302", 0x002BFF},
-					  {0x4507, "PIC24FV16KA304", 0x002BFF},
-					  {0x4506, "PIC24F16KA304", 0x002BFF},
-					  {0x4519, "PIC24FV32KA301", 0x0057FF},
-					  {0x4518, "PIC24F32KA301", 0x0057FF},
-					  {0x4513, "PIC24FV32KA302", 0x0057FF},
-					  {0x4512, "PIC24F32KA302", 0x0057FF},
-					  {0x4517, "PIC24FV32KA304", 0x0057FF},
-					  {0x4516, "PIC24F32KA304", 0x0057FF} };
+	static constexpr devdb db = DB_PIC24FXXKA1XX;
+	static const char *const regname[];	// configuration words, from the lowest
 };
+
+typedef pic24fj_icsp<pic24fxxka1xx_traits> pic24fxxka1xx;
+extern template class pic24fj_icsp<pic24fxxka1xx_traits>;
@@ -28,8 +28,6 @@
 
 /* delays (in microseconds) */
 #define DELAY_P1   	1
-#define DELAY_P1A  	1
-#define DELAY_P1B  	1
 #define DELAY_P6   	1
 #define DELAY_P7   	1
 #define DELAY_P9A  	40
@@ -80,6 +78,8 @@
 #define PE_CMD_GET_CHECKSUM		0x000C0000
 #define PE_CMD_QUAD_WORD_PGRM	0x000D0000
 
+#define PE_POLL_TRIES			1000	// bounded waits, when the PE may be gone
+
 #define PE_RESPONSE_CODE_PASS	0x00
 #define PE_RESPONSE_CODE_FAIL	0x02
 #define PE_RESPONSE_CODE_NACK	0x03
@@ -110,9 +110,9 @@ void pic32::enter_program_mode(void)
 			GPIO_SET(pic_data);
 		else
 			GPIO_CLR(pic_data);
-		delay_us(DELAY_P1A);	/* Setup time */
+		delay_clk();	/* Setup time */
 		GPIO_SET(pic_clk);
-		delay_us(DELAY_P1B);	/* Hold time */
+		delay_clk();	/* Hold time */
 		GPIO_CLR(pic_clk);
 
 	}
@@ -149,9 +149,9 @@ uint8_t pic32::Data4Phase(uint8_t tdi, uint8_t tms){
 		GPIO_CLR(pic_data);	
 	
 	GPIO_SET(pic_clk);
-	delay_us(DELAY_P1B);
+	delay_clk();
 	GPIO_CLR(pic_clk);
-	delay_us(DELAY_P1A);
+	delay_clk();
 	
 	// write TMS - sampling is on the falling edge
 	if(tms & 0x01)
@@ -160,9 +160,9 @@ uint8_t pic32::Data4Phase(uint8_t tdi, uint8_t tms){
 		GPIO_CLR(pic_data);	
 	
 	GPIO_SET(pic_clk);
-	delay_us(DELAY_P1B);
+	delay_clk();
 	GPIO_CLR(pic_clk);
-	delay_us(DELAY_P1A);
+	delay_clk();
 	
 	// data pin to input
 	GPIO_CLR(pic_data);
@@ -170,16 +170,16 @@ uint8_t pic32::Data4Phase(uint8_t tdi, uint8_t tms){
 	
 	// "empty" clock pulse
 	GPIO_SET(pic_clk);
-	delay_us(DELAY_P1B);
+	delay_clk();
 	GPIO_CLR(pic_clk);
-	delay_us(DELAY_P1A);
+	delay_clk();
 	
 	// read TDO, sampling on the rising edge
 	GPIO_SET(pic_clk);
 	tdo = GPIO_LEV(pic_data);
-	delay_us(DELAY_P1B);
+	delay_clk();
 	GPIO_CLR(pic_clk);
-	delay_us(DELAY_P1A);
+	delay_clk();
 	
 	return (tdo & 0x01);
 }
@@ -195,9 +195,9 @@ void pic32::Data2Phase(uint8_t tdi, uint8_t tms){
 		GPIO_CLR(pic_data);	
 	
 	GPIO_SET(pic_clk);
-	delay_us(DELAY_P1B);
+	delay_clk();
 	GPIO_CLR(pic_clk);
-	delay_us(DELAY_P1A);
+	delay_clk();
 	
 	// write TMS - sampling is on the falling edge
 	if(tms & 0x01)
@@ -206,9 +206,9 @@ void pic32::Data2Phase(uint8_t tdi, uint8_t tms){
 		GPIO_CLR(pic_data);	
 	
 	GPIO_SET(pic_clk);
-	delay_us(DELAY_P1B);
+	delay_clk();
 	GPIO_CLR(pic_clk);
-	delay_us(DELAY_P1A);
+	delay_clk();
 }
 
 void pic32::SetMode(uint8_t length, uint8_t mode){
@@ -282,15 +282,23 @@ void pic32::XferFastData2P(uint32_t iData){
 	Data2Phase(0, 0);	
 }
 
-uint32_t pic32::XferFastData4P(uint32_t iData){
+uint32_t pic32::XferFastData4P(uint32_t iData, bool *timeout){
 	uint8_t i = 0;
-	uint32_t oData = 0;
+	uint32_t oData = 0, tries = 0;
 
 	do{
 		// TMS header 100 (TDI set to 0)
 		Data4Phase(0, 1);
 		Data4Phase(0, 0);
 		i = Data4Phase(0, 0);
+		if(!i && timeout && ++tries == PE_POLL_TRIES){
+			// back to Run-Test/Idle through Exit1-DR and Update-DR
+			Data4Phase(0, 1);
+			Data4Phase(0, 1);
+			Data4Phase(0, 0);
+			*timeout = true;
+			return 0;
+		}
 	} while(!i);
 	
 	// prAcc
@@ -353,8 +361,8 @@ uint32_t pic32::ReadFromAddress(uint32_t address){
 	return oData;
 }
 
-uint32_t pic32::GetPEResponse(void){
-	uint32_t response;
+uint32_t pic32::GetPEResponse(bool *timeout){
+	uint32_t response, tries = 0;
 
 	// Wait until CPU is ready
 	SendCommand(ETAP_CONTROL);
@@ -362,6 +370,10 @@ uint32_t pic32::GetPEResponse(void){
 	// Check if Processor Access bit (bit 18) is set
 	do {
 		response = XferData(32, 0x0004c000);
+		if(timeout && !((response >> 18) & 0x01) && ++tries == PE_POLL_TRIES){
+			*timeout = true;
+			return 0;
+		}
 	} while(!( (response >> 18) & 0x01 ));
 	
 	// Select Data Register
@@ -521,6 +533,40 @@ bool pic32::setup_pe(void){
 	return true;
 }
 
+/*
+ * Check whether the PE downloaded by a previous session is still running,
+ * asking for its version with bounded waits: a device which was reset or
+ * left programming mode does not answer, and needs a full setup_pe().
+ */
+bool pic32::pe_resident(void){
+	bool timeout = false;
+	uint32_t rxp;
+
+	SendCommand(ETAP_FASTDATA);
+	XferFastData4P(PE_CMD_EXEC_VERSION, &timeout);
+	if(timeout)
+		return false;
+	rxp = GetPEResponse(&timeout);
+	if(timeout || (rxp >> 16) != (PE_CMD_EXEC_VERSION >> 16))
+		return false;
+
+	if(flags.debug)
+		fprintf(stderr, "PE version %02x still running\n", rxp & 0xFF);
+	return true;
+}
+
+/* IDCODE straight from the MTAP, without downloading the PE */
+void pic32::probe_device_id(void){
+	uint32_t idcode;
+
+	SetMode(6, 0b011111);
+	SendCommand(MTAP_SW_MTAP);
+	SendCommand(MTAP_IDCODE);
+	idcode = XferData(32, 0);
+	device_id = (idcode & 0x0FFFFFFF);
+	device_rev = (uint16_t)(idcode >> 28);
+}
+
 bool pic32::read_device_id(void){
 	uint32_t rxp;
 	
@@ -548,38 +594,42 @@ bool pic32::read_device_id(void){
 	device_id = (rxp & 0x0FFFFFFF);
 	device_rev = (uint16_t)(rxp >> 28);
 	
-	for (unsigned short i=0;i < sizeof(piclist)/sizeof(piclist[0]);i++){
-
-		if (piclist[i].device_id == device_id){
-			strcpy(name, piclist[i].name);
-			mem.code_memory_size = piclist[i].code_memory_size;
-			mem.program_memory_size = 0x03000000;
-			mem.location = (uint16_t*) calloc(mem.program_memory_size,sizeof(uint16_t));
-			mem.filled = (bool*) calloc(mem.program_memory_size,sizeof(bool));
-			found = true;
-			break;
-		}
+	const pic_device *dev = devdb_lookup(DB_PIC32, device_id);
+	if(dev){
+		strcpy(name, dev->name);
+		mem.code_memory_size = dev->code_memory_size;
+		mem.program_memory_size = 0x03000000;
+		free(mem.location);	// left by a previous read_device_id()
+		free(mem.filled);
+		mem.location = (uint16_t*) calloc(mem.program_memory_size,sizeof(uint16_t));
+		mem.filled = (bool*) calloc(mem.program_memory_size,sizeof(bool));
+		found = true;
 	}
 	
 	switch(subfamily){
 		case SF_PIC32MX1:
 		case SF_PIC32MX2:
+			pagesize = 1024;
 			rowsize  = 128;
 			bootsize = 0x00000C00;
 			break;
 		case SF_PIC32MX3:
+			pagesize = 4096;
 			rowsize  = 512;
 			bootsize = 0x00003000;
 			break;
 		case SF_PIC32MK:
+			pagesize = 0;
 			rowsize  = 2048;
 			bootsize = 0x00005000;
 			break;
 		case SF_PIC32MZ:
+			pagesize = 16384;
 			rowsize  = 2048;
 			bootsize = 0x00014000;
 			break;
 		default:
+			pagesize = 1024;
 			rowsize  = 128;
 			bootsize = 0x00000C00;
 			break;
@@ -684,7 +734,7 @@ void pic32::read(char *outfile, uint32_t start, uint32_t count){
 						if(flags.client)
 							fprintf(stdout,"@%03d", counter);
 						if(!flags.debug)
-							fprintf(stderr,"\b\b\b\b\b[%2d%%]", counter);
+							progress(counter);
 					}	
 				}
 			}
@@ -694,19 +744,211 @@ void pic32::read(char *outfile, uint32_t start, uint32_t count){
 
 	if(!flags.debug) cerr << "\b\b\b\b\b";
 	if(flags.client) fprintf(stdout, "@FIN");
-	write_inhx(&mem, outfile, PROGRAM_FLASH_BASEADDR);
+	if(outfile)
+		write_inhx(&mem, outfile, PROGRAM_FLASH_BASEADDR);
 };
 
+/* True if no word of the row at addr is in the image */
+bool pic32::row_empty(uint32_t addr){
+	for(uint32_t i=0; i<rowsize; i++)
+		if(mem.filled[(addr+i)/2])
+			return false;
+	return true;
+}
+
+/* Bytes of the row at addr covered by the checksums: the last 16 bytes
+ * of boot flash hold the configuration words and are left out */
+uint32_t pic32::row_len(uint32_t addr){
+	uint32_t end = BOOTFLASH_OFFSET+bootsize-16;
+
+	if(addr < BOOTFLASH_OFFSET || addr+rowsize <= end)
+		return rowsize;
+	return addr < end ? end-addr : 0;
+}
+
+/* Byte sum the PE should return for the row at addr, 0xFF where unfilled */
+uint32_t pic32::row_sum(uint32_t addr){
+	uint32_t sum = 0;
+
+	for(uint32_t i=0; i<row_len(addr); i+=4){
+		if(mem.filled[(addr+i)/2])
+			sum += (mem.location[(addr+i)/2] & 0x00FF) +
+					(mem.location[(addr+i)/2] >> 8) +
+					(mem.location[(addr+i)/2+1] & 0x00FF) +
+					(mem.location[(addr+i)/2+1] >> 8);
+		else
+			sum += 0x000000FF*4;
+	}
+	return sum;
+}
+
+/* Byte sum of len bytes of flash at addr, computed by the PE */
+uint32_t pic32::device_sum(uint32_t addr, uint32_t len){
+	uint32_t rxp;
+
+	SendCommand(ETAP_FASTDATA);
+	XferFastData4P(PE_CMD_GET_CHECKSUM);
+	XferFastData4P(PROGRAM_FLASH_BASEADDR+addr);
+	XferFastData4P(len);
+	rxp = GetPEResponse();
+	if(rxp != PE_CMD_GET_CHECKSUM)
+		fprintf(stderr, "___ERR___: %08x\n", rxp);
+	return GetPEResponse();
+}
+
+/* Returns the number of filled words sent */
+uint32_t pic32::program_row(uint32_t addr){
+	uint32_t rxp, words = 0;
+
+	SendCommand(ETAP_FASTDATA);
+	XferFastData4P(PE_CMD_ROW_PROGRAM);
+	XferFastData4P(PROGRAM_FLASH_BASEADDR+addr);
+
+	for(uint32_t i=0; i<rowsize; i+=4){
+		if(mem.filled[(addr+i)/2]){
+			XferFastData4P((uint32_t)mem.location[(addr+i)/2] |
+						((uint32_t)mem.location[(addr+i)/2+1] << 16));
+			words += 2;
+		}
+		else
+			XferFastData4P(0xFFFFFFFF);
+	}
+	rxp = GetPEResponse();
+	if(rxp != PE_CMD_ROW_PROGRAM){
+		errors++;
+		fprintf(stderr, "___ERR___: %08x\n", rxp);
+	}
+	return words;
+}
+
+bool pic32::erase_page(uint32_t addr){
+	uint32_t rxp;
+
+	SendCommand(ETAP_FASTDATA);
+	XferFastData4P(PE_CMD_PAGE_ERASE | 1);
+	XferFastData4P(PROGRAM_FLASH_BASEADDR+addr);
+	rxp = GetPEResponse();
+	if(rxp != PE_CMD_PAGE_ERASE){
+		fprintf(stderr, "___ERR___: %08x\n", rxp);
+		return false;
+	}
+	return true;
+}
+
+bool pic32::row_ok(uint32_t addr){
+	return device_sum(addr, row_len(addr)) == row_sum(addr);
+}
+
+/*
+ * Row at addr does not match the image: check it again and, if it is
+ * really wrong, erase its page and program the rows of the page again.
+ * Without a known page size (PIC32MK) it is only checked again.
+ */
+bool pic32::recover_row(uint32_t addr){
+	uint32_t page, r;
+	bool ok = false;
+
+	retry_begin();
+	for(int attempt=0; attempt<flags.retries && !ok; attempt++){
+		if(row_ok(addr)){
+			retries.reread++;
+			ok = true;
+			break;
+		}
+		if(!pagesize || !erase_page(page = addr & ~(pagesize-1)))
+			continue;
+		for(r=page; r<page+pagesize; r+=rowsize)
+			if(!row_empty(r))
+				program_row(r);
+		ok = true;
+		for(r=page; r<page+pagesize && ok; r+=rowsize)
+			ok = row_ok(r);
+		if(ok)
+			retries.rewritten++;
+	}
+	if(!ok){
+		retries.failed++;
+		fprintf(stderr, "row %08X still does not verify after %d retries\n",
+				PROGRAM_FLASH_BASEADDR+addr, flags.retries);
+	}
+	retry_end();
+	return ok;
+}
+
+/* CRC-16/CCITT (0x1021, MSB first), as computed by the PE GET_CRC command */
+static uint16_t crc16_ccitt(uint16_t crc, uint8_t b){
+	crc ^= b << 8;
+	for(int k=0; k<8; k++)
+		crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+	return crc;
+}
+
+/* Compare len bytes of the image at addr with the PE CRC of the same span */
+bool pic32::span_matches(uint32_t addr, uint32_t len){
+	uint32_t rxp, word;
+	uint16_t crc = 0xFFFF;
+
+	for(uint32_t i=0; i<len; i+=4){
+		if(mem.filled[(addr+i)/2])
+			word = (uint32_t)mem.location[(addr+i)/2] |
+					((uint32_t)mem.location[(addr+i)/2+1] << 16);
+		else
+			word = 0xFFFFFFFF;
+		for(int b=0; b<4; b++)
+			crc = crc16_ccitt(crc, word >> (8*b));
+	}
+
+	SendCommand(ETAP_FASTDATA);
+	XferFastData4P(PE_CMD_GET_CRC);
+	XferFastData4P(PROGRAM_FLASH_BASEADDR+addr);
+	XferFastData4P(len);
+	rxp = GetPEResponse();
+	if(rxp != PE_CMD_GET_CRC){
+		fprintf(stderr, "___ERR___: %08x\n", rxp);
+		return false;
+	}
+	return (GetPEResponse() & 0xFFFF) == crc;
+}
+
+/* Each run of rows holding data is checked with one GET_CRC */
+bool pic32::already_programmed(void){
+	uint8_t area;
+	uint32_t addr, startaddr = 0, stopaddr = 0, span = 0, len = 0;
+	bool found = false;
+
+	for(area = PROGRAM_AREA; area <= BOOT_AREA; area++){
+		if(((area == PROGRAM_AREA) & flags.boot_only) || ((area == BOOT_AREA) & flags.program_only))
+			continue;
+		area_bounds(area, &startaddr, &stopaddr);
+		for(addr = startaddr; addr < stopaddr; addr += rowsize){
+			if(!row_empty(addr)){
+				if(!len)
+					span = addr;
+				len += rowsize;
+				continue;
+			}
+			if(len && !span_matches(span, len))
+				return false;
+			found |= len != 0;
+			len = 0;
+		}
+		if(len && !span_matches(span, len))
+			return false;
+		found |= len != 0;
+		len = 0;
+	}
+	return found;
+}
+
 void pic32::write(char *infile){
-	uint32_t rxp = 0;
 	uint8_t area = PROGRAM_AREA;
 	uint32_t addr = 0, startaddr = 0, stopaddr = 0;
 	uint32_t filled_locations = 0, programmed_locations = 0;
-	bool skip = true;
 	uint32_t counter = 0;
 	uint32_t device_checksum = 0, calculated_checksum = 0;
+	bool recovered;
 	
-	filled_locations = read_inhx(infile, &mem, PROGRAM_FLASH_BASEADDR);
+	filled_locations = load_image(infile);
 	if(!filled_locations) return;
 	
 	bulk_erase();
@@ -716,67 +958,26 @@ void pic32::write(char *infile){
 	
 	do{
 
-		switch(area){
-			case PROGRAM_AREA:	// Write Program Flash
-				startaddr = 0;
-				stopaddr = (mem.code_memory_size*2)-1;
-				break;
-			case BOOT_AREA:	// Write bootflash+configuration
-				startaddr = BOOTFLASH_OFFSET;
-				stopaddr = startaddr+bootsize-1;
-				break;
-			default:
-				break;
-		}
+		area_bounds(area, &startaddr, &stopaddr);
 		
 		if(((area == PROGRAM_AREA) & !flags.boot_only) || ((area == BOOT_AREA) & !flags.program_only)){
 	
 			for (addr = startaddr; addr < stopaddr; addr += rowsize){
 				
-				skip = true;
-				for(uint32_t i=0; i<rowsize; i++){
-					if(mem.filled[(addr+i)/2]){
-						skip = false;
-						break;
-					}
-				}
-				if(skip){
+				if(row_empty(addr)){
 					calculated_checksum += 0x000000FF*rowsize;
 					continue;
 				}
 				
-				SendCommand(ETAP_FASTDATA);
-				XferFastData4P(PE_CMD_ROW_PROGRAM);
-				XferFastData4P(PROGRAM_FLASH_BASEADDR+addr);
-				
-				for(uint32_t i=0; i<rowsize; i+=4){
-					if(mem.filled[(addr+i)/2]){
-						XferFastData4P((uint32_t)mem.location[(addr+i)/2] |
-									((uint32_t)mem.location[(addr+i)/2+1] << 16));
-						programmed_locations += 2;
-						if((addr+i) < (BOOTFLASH_OFFSET+bootsize-16)){
-							calculated_checksum += (mem.location[(addr+i)/2] & 0x00FF) +
-												(mem.location[(addr+i)/2] >> 8) +
-												(mem.location[(addr+i)/2+1] & 0x00FF) +
-												(mem.location[(addr+i)/2+1] >> 8);
-						}
-					}
-					else{
-						XferFastData4P(0xFFFFFFFF);
-						if((addr+i) < (BOOTFLASH_OFFSET+bootsize-16))
-							calculated_checksum += 0x000000FF*4;
-					}
-				}
-				rxp = GetPEResponse();
-				if(rxp != PE_CMD_ROW_PROGRAM)
-					fprintf(stderr, "___ERR___: %08x\n", rxp);
+				calculated_checksum += row_sum(addr);
+				programmed_locations += program_row(addr);
 					
 				if(counter != programmed_locations*100/filled_locations){
 					counter = programmed_locations*100/filled_locations;
 					if(flags.client)
 						fprintf(stdout,"@%03d", counter);
 					if(!flags.debug)
-						fprintf(stderr,"\b\b\b\b\b[%2d%%]", counter);
+						progress(counter);
 				}
 			}
 		}
@@ -784,39 +985,144 @@ void pic32::write(char *infile){
 	} while(area<=BOOT_AREA);
 	
 	if(!flags.debug) cerr << "\b\b\b\b\b\b";
-	if(flags.client) fprintf(stdout, "@FIN");
 	
-	// Checksum verification
-	// Program area checksum
-	SendCommand(ETAP_FASTDATA);
-	XferFastData4P(PE_CMD_GET_CHECKSUM);
-	XferFastData4P(PROGRAM_FLASH_BASEADDR);
-	XferFastData4P(mem.code_memory_size*2);
-	rxp = GetPEResponse();
-	if(rxp != PE_CMD_GET_CHECKSUM)
-		fprintf(stderr, "___ERR___: %08x\n", rxp);
-	device_checksum = GetPEResponse();
-	
-	// Boot area checksum
-	SendCommand(ETAP_FASTDATA);
-	XferFastData4P(PE_CMD_GET_CHECKSUM);
-	XferFastData4P(PROGRAM_FLASH_BASEADDR+BOOTFLASH_OFFSET);
-	XferFastData4P(bootsize-16);
-	rxp = GetPEResponse();
-	if(rxp != PE_CMD_GET_CHECKSUM)
-		fprintf(stderr, "___ERR___: %08x\n", rxp);
-	device_checksum += GetPEResponse();
+	// Checksum verification: program area, then boot area
+	device_checksum = device_sum(0, mem.code_memory_size*2);
+	device_checksum += device_sum(BOOTFLASH_OFFSET, bootsize-16);
 	
 	if(calculated_checksum != device_checksum){
 		fprintf(stderr, "___CHECKSUM ERROR!___\n");
 		fprintf(stderr, "DEVICE CHECKSUM: %08x\n", device_checksum);
 		fprintf(stderr, "CALCULATED CHECKSUM: %08x\n", calculated_checksum);
-		if(flags.client) fprintf(stdout, "@ERR");
-		return;
+
+		// Look for the rows which differ and try to recover them
+		recovered = flags.retries > 0;
+		for(area = PROGRAM_AREA; area <= BOOT_AREA && recovered; area++){
+			if(((area == PROGRAM_AREA) & flags.boot_only) || ((area == BOOT_AREA) & flags.program_only))
+				continue;
+			area_bounds(area, &startaddr, &stopaddr);
+			for(addr = startaddr; addr < stopaddr; addr += rowsize){
+				if(row_ok(addr))
+					continue;
+				if(!recover_row(addr))
+					recovered = false;
+			}
+		}
+		if(!recovered){
+			errors++;
+			if(flags.client) fprintf(stdout, "@ERR");
+			return;
+		}
+		fprintf(stderr, "All the rows differing were recovered\n");
 	}
 	
 	if(flags.client) fprintf(stdout, "@FIN");
 };
+
+void pic32::area_bounds(uint8_t area, uint32_t *startaddr, uint32_t *stopaddr){
+	switch(area){
+		case PROGRAM_AREA:	// Program Flash
+			*startaddr = 0;
+			*stopaddr = (mem.code_memory_size*2)-1;
+			break;
+		case BOOT_AREA:	// Bootflash+configuration
+			*startaddr = BOOTFLASH_OFFSET;
+			*stopaddr = *startaddr+bootsize-1;
+			break;
+		default:
+			break;
+	}
+}
+/* Read n words of flash at addr through the PE */
+void pic32::read_block(uint32_t addr, uint32_t n, uint32_t *buf){
+	uint32_t rxp;
+
+	SendCommand(ETAP_FASTDATA);
+	XferFastData4P(PE_CMD_READ | n);
+	XferFastData4P(PROGRAM_FLASH_BASEADDR+addr);
+	rxp = GetPEResponse();
+	if(rxp != PE_CMD_READ)
+		fprintf(stderr, "___ERR___: %08x\n", rxp);
+	for(uint32_t i=0; i<n; i++)
+		buf[i] = GetPEResponse();
+}
+
+/*
+ * The DEVCFG words share the last page of boot flash with boot code: the
+ * page is read, the words of the image which differ are patched in, then
+ * the page is erased and programmed again. Program flash is not touched.
+ */
+void pic32::write_configuration(char *infile){
+	uint32_t cfg = BOOTFLASH_OFFSET+bootsize-16, page, addr, i;
+	uint32_t dev[4], *buf;
+	int changed = 0;
+
+	if(!load_image(infile)) return;
+	if(!pagesize){
+		fprintf(stderr, "The page size of this part is not known, use -w\n");
+		errors++;
+		return;
+	}
+
+	read_block(cfg, 4, dev);
+	for(i=0; i<4; i++){
+		addr = (cfg+4*i)/2;
+		if(!mem.filled[addr]){
+			mem.location[addr] = dev[i] & 0xFFFF;
+			mem.location[addr+1] = dev[i] >> 16;
+		}
+		else if(((uint32_t)mem.location[addr] | ((uint32_t)mem.location[addr+1] << 16)) != dev[i]){
+			fprintf(stderr, " - DEVCFG%d: %08x -> %04x%04x\n", 3-i, dev[i],
+					mem.location[addr+1], mem.location[addr]);
+			changed++;
+		}
+		mem.filled[addr] = mem.filled[addr+1] = 1;
+	}
+	if(!changed){
+		fprintf(stderr, "Configuration words already up to date\n");
+		if(flags.client) fprintf(stdout, "@FIN");
+		return;
+	}
+
+	/* keep what the device holds in the rest of the page */
+	page = cfg & ~(pagesize-1);
+	buf = new uint32_t[pagesize/4];
+	read_block(page, pagesize/4, buf);
+	for(addr=page, i=0; addr<cfg; addr+=4, i++){
+		mem.location[addr/2] = buf[i] & 0xFFFF;
+		mem.location[addr/2+1] = buf[i] >> 16;
+		mem.filled[addr/2] = mem.filled[addr/2+1] = buf[i] != 0xFFFFFFFF;
+	}
+	delete[] buf;
+
+	if(!erase_page(page)){
+		errors++;
+		if(flags.client) fprintf(stdout, "@ERR");
+		return;
+	}
+	for(addr=page; addr<page+pagesize; addr+=rowsize)
+		if(!row_empty(addr))
+			program_row(addr);
+
+	read_block(cfg, 4, dev);
+	for(i=0; i<4; i++){
+		addr = (cfg+4*i)/2;
+		if(((uint32_t)mem.location[addr] | ((uint32_t)mem.location[addr+1] << 16)) != dev[i]){
+			errors++;
+			fprintf(stderr, "ERROR: DEVCFG%d is %08x, written %04x%04x\n", 3-i, dev[i],
+					mem.location[addr+1], mem.location[addr]);
+		}
+	}
+	for(addr=page; addr<page+pagesize; addr+=rowsize)
+		if(!row_ok(addr)){
+			errors++;
+			fprintf(stderr, "ERROR: boot flash row %08x does not verify\n", PROGRAM_FLASH_BASEADDR+addr);
+		}
+
+	fprintf(stderr, "%d configuration words written\n", changed);
+	if(flags.client) fprintf(stdout, errors ? "@ERR" : "@FIN");
+}
+
 void pic32::dump_configuration_registers(void){
 	SendCommand(ETAP_FASTDATA);
 	XferFastData4P(PE_CMD_READ | 0x04);
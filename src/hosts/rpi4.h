@@ -26,13 +26,23 @@
 #define PORTOFFSET         0
 
 /* GPIO setup macros. Always use GPIO_IN(x) before using GPIO_OUT(x) */
-#define GPIO_IN(g)    *(gpio+((g&0xFF)/10))   &= ~(7<<(((g&0xFF)%10)*3))
-#define GPIO_OUT(g)   *(gpio+((g&0xFF)/10))   |=  (1<<(((g&0xFF)%10)*3))
+#define GPIO_FSEL_IN(g)    *(gpio+((g&0xFF)/10))   &= ~(7<<(((g&0xFF)%10)*3))
+#define GPIO_FSEL_OUT(g)   *(gpio+((g&0xFF)/10))   |=  (1<<(((g&0xFF)%10)*3))
+
+/* FSEL registers are shared by several pins: serialize the read-modify-write
+ * when more channels are driven at once (see gpio_dir()) */
+#define GPIO_IN(g)    gpio_dir(g, false)
+#define GPIO_OUT(g)   gpio_dir(g, true)
 
 #define GPIO_SET(g)   *(gpio+7)  = 1<<(g&0xFF)
 #define GPIO_CLR(g)   *(gpio+10) = 1<<(g&0xFF)
 #define GPIO_LEV(g)   (*(gpio+13) >> (g&0xFF)) & 0x1 /* reads pin level */
 
+/* Whole-bank access, used to drive and sample several PGD lines at once */
+#define GPIO_SET_MASK(m)   *(gpio+7)  = (m)
+#define GPIO_CLR_MASK(m)   *(gpio+10) = (m)
+#define GPIO_LEV_ALL()     (*(gpio+13))
+
 /* default GPIO <-> PIC connections */
 #define DEFAULT_PIC_CLK    23    /* PGC - Output */
 #define DEFAULT_PIC_DATA   24   /* PGD - I/O */
@@ -34,9 +34,51 @@ using namespace std;
  * Returns the number of filled locations
  *
  */
-unsigned int read_inhx(char *infile, memory *mem, uint32_t offset)
+unsigned int read_inhx(char *infile, memory *mem, uint32_t offset, uint32_t shift)
 {
     FILE *fp;
+    unsigned int filled_locations;
+
+    fp = fopen(infile, "r");
+    if (fp == NULL) {
+        cerr << "Error: cannot open source file " << infile << " : " << errno << endl;
+        return 0;
+    }
+
+    if(flags.debug) cerr << "Reading hex file..." << endl;
+
+    filled_locations = read_inhx_fp(fp, mem, offset, shift);
+    fclose(fp);
+
+    return filled_locations;
+}
+
+/* Put a word of an image in mem, checking it fits and does not clash */
+static bool store_word(memory *mem, uint32_t word, uint32_t offset, uint16_t data)
+{
+    uint32_t index = word - offset/2;
+
+    if (word < offset/2 || index >= mem->program_memory_size) {
+        fprintf(stderr, "Error: address 0x%08X is outside the device memory.\n", 2*word);
+        return false;
+    }
+    if (mem->filled[index] && mem->location[index] != data) {
+        fprintf(stderr, "Error: address 0x%08X is set to 0x%04X and to 0x%04X.\n",
+                2*word, mem->location[index], data);
+        return false;
+    }
+
+    mem->location[index] = data;
+    mem->filled[index] = 1;
+    return true;
+}
+
+/* Parse Intel HEX records from an open stream (a file, or a buffer through
+ * fmemopen) up to the end-of-file record. shift is added to the addresses
+ * of the file; locations outside mem, or already filled with a different
+ * value, are errors */
+unsigned int read_inhx_fp(FILE *fp, memory *mem, uint32_t offset, uint32_t shift)
+{
     int linenum;
     char line[256], *ptr;
     size_t linelen;
@@ -54,14 +96,6 @@ unsigned int read_inhx(char *infile, memory *mem, uint32_t offset)
     uint8_t  checksum_calculated;
     uint8_t  checksum_read;
 
-    fp = fopen(infile, "r");
-    if (fp == NULL) {
-        cerr << "Error: cannot open source file " << infile << " : " << errno << endl;
-        return 0;
-    }
-
-    if(flags.debug) cerr << "Reading hex file..." << endl;
-
     linenum = 0;
     while (1) {
         ptr = fgets(line, 256, fp);
@@ -143,12 +177,12 @@ unsigned int read_inhx(char *infile, memory *mem, uint32_t offset)
                     checksum_calculated += (data >> 8) & 0xFF;
                     checksum_calculated += data & 0xFF;
 
-                    extended_address = ( ((uint32_t)base_address << 16) | address);
+                    extended_address = ( ((uint32_t)base_address << 16) | address) + shift;
                     if (flags.debug)
                         fprintf(stderr, " @0x%08X\n", extended_address/2+i);
 
-                    mem->location[extended_address/2 + i - offset/2] = data;
-                    mem->filled[extended_address/2 + i - offset/2] = 1;
+                    if (!store_word(mem, extended_address/2 + i, offset, data))
+                        return 0;
                     filled_locations++;
                 }
               if (byte_count % 2) {
@@ -160,12 +194,12 @@ unsigned int read_inhx(char *infile, memory *mem, uint32_t offset)
                     if (flags.debug) fprintf(stderr, "  data        = 0x%04X", data);
                     checksum_calculated += data & 0xFF;
 
-                    extended_address = ( ((uint32_t)base_address << 16) | address);
+                    extended_address = ( ((uint32_t)base_address << 16) | address) + shift;
                     if (flags.debug)
                         fprintf(stderr, " @0x%08X\n", extended_address/2+i);
 
-                    mem->location[extended_address/2 + i - offset/2] = data;
-                    mem->filled[extended_address/2 + i - offset/2] = 1;
+                    if (!store_word(mem, extended_address/2 + i, offset, data))
+                        return 0;
                     filled_locations++;
               }
             }
@@ -201,26 +235,64 @@ unsigned int read_inhx(char *infile, memory *mem, uint32_t offset)
         }
     }
 
-    fclose(fp);
-
     if(flags.debug)
         cerr << "DONE! " << filled_locations << " memory locations read." << endl;
 
     return filled_locations;
 }
 
+/*
+ * Load one or more images, given as "file[@offset],file[@offset],...",
+ * into an empty mem. Each offset is added to the addresses of its file.
+ * Returns the number of filled locations, 0 on errors: nothing is
+ * written to the device unless all the images fit together.
+ */
+unsigned int read_images(const char *spec, memory *mem, uint32_t offset)
+{
+    string list(spec), file;
+    size_t pos = 0, next, at;
+    uint32_t shift, i;
+    unsigned int filled = 0;
+    char *end;
+
+    clear_image(mem);
+
+    while (pos <= list.size()) {
+        next = list.find(',', pos);
+        if (next == string::npos)
+            next = list.size();
+        file = list.substr(pos, next - pos);
+        pos = next + 1;
+
+        shift = 0;
+        at = file.rfind('@');
+        if (at != string::npos) {
+            shift = strtoul(file.c_str() + at + 1, &end, 0);
+            if (*end || end == file.c_str() + at + 1 || shift % 2) {
+                cerr << "Error: bad offset in " << file << endl;
+                return 0;
+            }
+            file.resize(at);
+        }
+
+        if (!read_inhx(&file[0], mem, offset, shift)) {
+            cerr << "Error: cannot load " << file << endl;
+            return 0;
+        }
+    }
+
+    for (i = 0; i < mem->program_memory_size; i++)
+        if (mem->filled[i])
+            filled++;
+
+    return filled;
+}
+
 /* Write the filled cells in given memory struct
  * to an Intel HEX8M or HEX32 file */
 void write_inhx(memory *mem, char *outfile, uint32_t offset)
 {
     FILE *fp;
-    uint32_t base, j, k, start, stop;
-    uint8_t  byte_count;
-    uint32_t address;
-    uint16_t base_address = 0x0000;
-    uint8_t  record_type;
-    uint16_t data, tmp;
-    uint8_t  checksum;
 
     fp = fopen(outfile?outfile:"ofile.hex", "w");
     if (fp == NULL) {
@@ -231,6 +303,24 @@ void write_inhx(memory *mem, char *outfile, uint32_t offset)
     if(flags.debug)
         cerr << "Writing hex file...";
 
+    write_inhx_fp(mem, fp, offset);
+    fclose(fp);
+
+    if(flags.debug)
+        cerr << "DONE!" << endl;
+}
+
+/* Write the filled cells to an open stream */
+void write_inhx_fp(memory *mem, FILE *fp, uint32_t offset)
+{
+    uint32_t base, j, k, start, stop;
+    uint8_t  byte_count;
+    uint32_t address;
+    uint16_t base_address = 0x0000;
+    uint8_t  record_type;
+    uint16_t data, tmp;
+    uint8_t  checksum;
+
     /* Write the program memory bytes */
 
     for (base = 0; base < mem -> program_memory_size; ){
@@ -283,7 +373,10 @@ void write_inhx(memory *mem, char *outfile, uint32_t offset)
     }
 
     fprintf(fp, ":00000001FF\n");
-    fclose(fp);
-    if(flags.debug)
-        cerr << "DONE!" << endl;
+}
+
+/* Mark every location as empty, before loading a new image */
+void clear_image(memory *mem)
+{
+    memset(mem->filled, 0, mem->program_memory_size * sizeof(bool));
 }
@@ -0,0 +1,134 @@
+/*
+ * Raspberry Pi PIC Programmer using GPIO connector
+ * https://github.com/WallaceIT/picberry
+ * Copyright 2016 Francesco Valla
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "common.h"
+
+/*
+ * Write journal: while a write is running, one line per fixture records the
+ * device, the image and the first row not programmed yet:
+ *
+ *	device_id device_rev image_crc next_address
+ *
+ * The line has a fixed width and is rewritten in place after every row, so
+ * it costs one pwrite(). It is removed when the write completes; --resume
+ * uses it to go on with an interrupted write of the same image to the same
+ * device instead of starting over. Writes are journaled only with --resume
+ * or --journal.
+ *
+ * The journal is not synced: it survives the target losing power or the
+ * programmer being killed, not the host itself losing power.
+ */
+
+#define JOURNAL_LINE	"%08x %04x %08x %08x\n"
+#define JOURNAL_LEN		36
+
+const char *journal_dir = JOURNAL_DIR;
+
+/* CRC-32 (IEEE 802.3), bitwise: images are hashed once per write */
+uint32_t crc32(uint32_t crc, const void *buf, size_t len)
+{
+	const uint8_t *p = (const uint8_t *) buf;
+	int k;
+
+	crc = ~crc;
+	while(len--){
+		crc ^= *p++;
+		for(k = 0; k < 8; k++)
+			crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+	}
+	return ~crc;
+}
+
+/* Hash of the filled words of an image and of their addresses */
+uint32_t image_crc(memory *mem)
+{
+	uint32_t i, crc = 0;
+
+	for(i = 0; i < mem->program_memory_size; i++)
+		if(mem->filled[i]){
+			crc = crc32(crc, &i, sizeof(i));
+			crc = crc32(crc, &mem->location[i], sizeof(mem->location[i]));
+		}
+	return crc;
+}
+
+/* Journal of the fixture driven by the calling thread */
+static void journal_path(char *path, size_t len)
+{
+	snprintf(path, len, "%s/picberry-%d-%d-%d.journal", journal_dir,
+			 pic_clk, pic_data, pic_mclr);
+}
+
+/* Next address to write for this device and image, 0 if there is none */
+uint32_t journal_load(Pic *pic, uint32_t crc)
+{
+	FILE *fp;
+	char path[256];
+	unsigned int id, rev, jcrc, next;
+	int n;
+
+	journal_path(path, sizeof(path));
+	fp = fopen(path, "r");
+	if(!fp)
+		return 0;
+	n = fscanf(fp, "%x %x %x %x", &id, &rev, &jcrc, &next);
+	fclose(fp);
+
+	if(n != 4 || id != pic->device_id || rev != pic->device_rev || jcrc != crc)
+		return 0;
+	return next;
+}
+
+/* Record the next address to write; false, reported, if that failed */
+bool journal_save(Pic *pic, uint32_t crc, uint32_t next)
+{
+	char path[256], line[JOURNAL_LEN + 1];
+	bool ok;
+	int fd;
+
+	journal_path(path, sizeof(path));
+	fd = open(path, O_WRONLY | O_CREAT, 0644);
+	if(fd < 0){
+		fprintf(stderr, "\nWarning: cannot journal the write, --resume will start over: ");
+		perror(path);
+		return false;
+	}
+	snprintf(line, sizeof(line), JOURNAL_LINE, pic->device_id,
+			 pic->device_rev, crc, next);
+	ok = pwrite(fd, line, JOURNAL_LEN, 0) == JOURNAL_LEN;
+	if(!ok){
+		fprintf(stderr, "\nWarning: cannot journal the write, --resume will start over: ");
+		perror(path);
+	}
+	close(fd);
+	return ok;
+}
+
+void journal_clear(void)
+{
+	char path[256];
+
+	journal_path(path, sizeof(path));
+	unlink(path);
+}
@@ -0,0 +1,381 @@
+/*
+ * Raspberry Pi PIC Programmer using GPIO connector
+ * https://github.com/WallaceIT/picberry
+ * Copyright 2016 Francesco Valla
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "common.h"
+#include "libpicberry.h"
+
+/* The GPIO mapping is shared by all the programmers of the process */
+static pthread_mutex_t io_lock = PTHREAD_MUTEX_INITIALIZER;
+static int io_users = 0;
+
+/* Copy the filled words of an image into mem; false if one is outside it */
+static bool image_to_mem(const pb_image &img, memory *mem, uint32_t offset)
+{
+	uint32_t i, addr;
+
+	clear_image(mem);
+	for(i = 0; i < img.words.size(); i++){
+		if(!img.filled[i])
+			continue;
+		addr = img.base + 2 * i;
+		if(addr < offset || (addr - offset) / 2 >= mem->program_memory_size){
+			fprintf(stderr, "Error: image word at 0x%08x is outside the device memory\n", addr);
+			return false;
+		}
+		mem->location[(addr - offset) / 2] = img.words[i];
+		mem->filled[(addr - offset) / 2] = 1;
+	}
+	return true;
+}
+
+static void mem_to_image(memory *mem, uint32_t offset, pb_image &img)
+{
+	uint32_t i;
+
+	img.base = offset;
+	img.words.assign(mem->location, mem->location + mem->program_memory_size);
+	img.filled.resize(mem->program_memory_size);
+	for(i = 0; i < mem->program_memory_size; i++)
+		img.filled[i] = mem->filled[i];
+}
+
+/* Scratch memory with the size of the detected device */
+static bool scratch_alloc(Pic *pic, memory *mem)
+{
+	mem->program_memory_size = pic->mem.program_memory_size;
+	mem->code_memory_size = pic->mem.code_memory_size;
+	mem->location = (uint16_t*) calloc(mem->program_memory_size, sizeof(uint16_t));
+	mem->filled = (bool*) calloc(mem->program_memory_size, sizeof(bool));
+	if(mem->location && mem->filled)
+		return true;
+	free(mem->location);
+	free(mem->filled);
+	return false;
+}
+
+static void scratch_free(memory *mem)
+{
+	free(mem->location);
+	free(mem->filled);
+}
+
+PicProgrammer::PicProgrammer()
+{
+	pic = NULL;
+	io_open = false;
+	program_mode = false;
+	op = "";
+	progress_fn = NULL;
+	progress_ctx = NULL;
+	telemetry_fn = NULL;
+	telemetry_ctx = NULL;
+	memset(&op_start, 0, sizeof(op_start));
+}
+
+PicProgrammer::~PicProgrammer()
+{
+	close();
+}
+
+bool PicProgrammer::open(const char *family, const char *pins)
+{
+	close();
+
+	pic = pic_create(family);
+	if(!pic){
+		fprintf(stderr, "Error: unknown PIC family %s\n", family);
+		return false;
+	}
+	pic->progress_cb = progress_hook;
+	pic->progress_ctx = this;
+
+	if(pins && sscanf(pins, "%d,%d,%d", &pic_clk, &pic_data, &pic_mclr) != 3){
+		fprintf(stderr, "Error: pins must be given as PGC,PGD,MCLR\n");
+		delete pic;
+		pic = NULL;
+		return false;
+	}
+	timing_load(family);
+
+	/* map_io() exits on errors, which a library must not do */
+	if(access("/dev/mem", R_OK | W_OK)){
+		perror("Cannot open /dev/mem");
+		delete pic;
+		pic = NULL;
+		return false;
+	}
+
+	pthread_mutex_lock(&io_lock);
+	if(io_users++ == 0)
+		map_io();
+	pthread_mutex_unlock(&io_lock);
+	setup_pins();
+	io_open = true;
+
+	return true;
+}
+
+void PicProgrammer::close(void)
+{
+	if(program_mode)
+		pic->exit_program_mode();
+	program_mode = false;
+
+	if(io_open){
+		pthread_mutex_lock(&io_lock);
+		if(--io_users == 0)
+			close_io();
+		else
+			GPIO_IN(pic_mclr);
+		pthread_mutex_unlock(&io_lock);
+		io_open = false;
+	}
+
+	if(pic){
+		free(pic->mem.location);
+		free(pic->mem.filled);
+		delete pic;
+		pic = NULL;
+	}
+}
+
+bool PicProgrammer::detect(void)
+{
+	bool ok;
+
+	if(!pic)
+		return false;
+	begin("detect");
+	if(program_mode)
+		pic->exit_program_mode();
+	pic->enter_program_mode();
+	program_mode = true;
+	pic->setup_pe();
+	ok = pic->read_device_id();
+	if(!ok){
+		pic->exit_program_mode();
+		program_mode = false;
+	}
+	return end(ok);
+}
+
+const char *PicProgrammer::device_name(void)
+{
+	return pic ? pic->name : "";
+}
+
+uint32_t PicProgrammer::device_id(void)
+{
+	return pic ? pic->device_id : 0;
+}
+
+uint16_t PicProgrammer::device_rev(void)
+{
+	return pic ? pic->device_rev : 0;
+}
+
+bool PicProgrammer::erase(void)
+{
+	if(!program_mode)
+		return false;
+	begin("erase");
+	pic->bulk_erase();
+	return end(pic->errors == 0);
+}
+
+bool PicProgrammer::blank(void)
+{
+	if(!program_mode)
+		return false;
+	begin("blankcheck");
+	return end(pic->blank_check() == 0);
+}
+
+bool PicProgrammer::program(const pb_image &img)
+{
+	if(!program_mode)
+		return false;
+	begin("program");
+	if(!image_to_mem(img, &pic->mem, pic->hex_offset))
+		return end(false);
+	pic->write(NULL);
+	return end(pic->errors == 0);
+}
+
+bool PicProgrammer::read(pb_image &img, uint32_t start, uint32_t count)
+{
+	if(!program_mode)
+		return false;
+	begin("read");
+	clear_image(&pic->mem);
+	pic->read(NULL, start, count);
+	mem_to_image(&pic->mem, pic->hex_offset, img);
+	return end(true);
+}
+
+/* read() leaves erased words unfilled: in program memory, an image word
+ * with nothing read back must be an erased one */
+bool PicProgrammer::verify(const pb_image &img)
+{
+	memory expected;
+	uint32_t i;
+	bool same;
+
+	if(!program_mode)
+		return false;
+	begin("verify");
+	if(!scratch_alloc(pic, &expected))
+		return end(false);
+	if(!image_to_mem(img, &expected, pic->hex_offset)){
+		scratch_free(&expected);
+		return end(false);
+	}
+
+	clear_image(&pic->mem);
+	pic->read(NULL);
+	for(i = 0; i < expected.program_memory_size; i++){
+		if(!expected.filled[i])
+			continue;
+		if(pic->mem.filled[i])
+			same = expected.location[i] == pic->mem.location[i];
+		else
+			same = i >= pic->mem.code_memory_size ||
+				   expected.location[i] == pic->erased_value(i);
+		if(!same){
+			if(!pic->errors)
+				fprintf(stderr, "Verify error at 0x%08x: read 0x%04x, expected 0x%04x\n",
+						pic->hex_offset + 2 * i,
+						pic->mem.filled[i] ? pic->mem.location[i] : pic->erased_value(i),
+						expected.location[i]);
+			pic->errors++;
+		}
+	}
+	scratch_free(&expected);
+
+	return end(pic->errors == 0);
+}
+
+bool PicProgrammer::parse_hex(const char *text, size_t len, pb_image &img)
+{
+	memory mem;
+	FILE *fp;
+	unsigned int filled = 0;
+
+	if(!program_mode || !scratch_alloc(pic, &mem)){
+		fprintf(stderr, "Error: no device detected to parse the image for\n");
+		return false;
+	}
+
+	fp = fmemopen((void *) text, len, "r");
+	if(fp){
+		filled = read_inhx_fp(fp, &mem, pic->hex_offset);
+		fclose(fp);
+	}
+	if(filled)
+		mem_to_image(&mem, pic->hex_offset, img);
+	scratch_free(&mem);
+
+	return filled > 0;
+}
+
+std::string PicProgrammer::format_hex(const pb_image &img)
+{
+	std::string hex;
+	memory mem;
+	FILE *fp;
+	char *buf = NULL;
+	size_t len = 0;
+
+	if(!program_mode || !scratch_alloc(pic, &mem))
+		return hex;
+
+	if(image_to_mem(img, &mem, pic->hex_offset)){
+		fp = open_memstream(&buf, &len);
+		if(fp){
+			write_inhx_fp(&mem, fp, pic->hex_offset);
+			fclose(fp);
+			hex.assign(buf, len);
+			free(buf);
+		}
+	}
+	scratch_free(&mem);
+
+	return hex;
+}
+
+void PicProgrammer::on_progress(pb_progress_fn fn, void *ctx)
+{
+	progress_fn = fn;
+	progress_ctx = ctx;
+}
+
+void PicProgrammer::on_telemetry(pb_telemetry_fn fn, void *ctx)
+{
+	telemetry_fn = fn;
+	telemetry_ctx = ctx;
+}
+
+/* Driver progress, tagged with the running operation; no terminal bar */
+void PicProgrammer::progress_hook(int percent, void *ctx)
+{
+	PicProgrammer *p = (PicProgrammer *) ctx;
+
+	if(p->progress_fn)
+		p->progress_fn(p->op, percent, p->progress_ctx);
+}
+
+void PicProgrammer::begin(const char *name)
+{
+	op = name;
+	pic->errors = 0;
+	gettimeofday(&op_start, 0);
+}
+
+bool PicProgrammer::end(bool ok)
+{
+	struct timeval now;
+	pb_telemetry t;
+
+	if(!telemetry_fn)
+		return ok;
+
+	gettimeofday(&now, 0);
+	t.op = op;
+	t.ok = ok;
+	t.ms = (now.tv_sec - op_start.tv_sec) * 1000 + (now.tv_usec - op_start.tv_usec) / 1000;
+	t.errors = pic->errors;
+	t.erases = pic->erase_stats.count;
+	t.rows = pic->row_stats.count;
+	t.configs = pic->config_stats.count;
+	t.nvm_timeouts = pic->erase_stats.timeouts + pic->row_stats.timeouts +
+					 pic->config_stats.timeouts;
+	t.nvm_total_us = pic->erase_stats.total_us + pic->row_stats.total_us +
+					 pic->config_stats.total_us;
+	t.retried = pic->retries.rows;
+	t.retry_failed = pic->retries.failed;
+	telemetry_fn(&t, telemetry_ctx);
+
+	return ok;
+}
@@ -0,0 +1,112 @@
+/*
+ * Raspberry Pi PIC Programmer using GPIO connector
+ * https://github.com/WallaceIT/picberry
+ * Copyright 2016 Francesco Valla
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBPICBERRY_H_
+#define LIBPICBERRY_H_
+
+/*
+ * libpicberry: the programmer as a library, for test executives which program
+ * and check many boards from a single process. Images are passed in memory,
+ * progress and timings are reported through callbacks.
+ *
+ * The GPIO pins are per thread: use each PicProgrammer from the thread which
+ * opened it.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/time.h>
+#include <string>
+#include <vector>
+
+class Pic;
+
+/* Program memory image: words[i] is the 16-bit word at byte address
+ * base + 2*i of the hex file, used only where filled[i] is set */
+struct pb_image{
+	uint32_t				base;
+	std::vector<uint16_t>	words;
+	std::vector<uint8_t>	filled;
+};
+
+/* Reported at the end of every operation */
+struct pb_telemetry{
+	const char	*op;			// "detect", "erase", "program", "read", "verify"
+	bool		ok;
+	uint32_t	ms;				// duration of the operation
+	uint32_t	errors;			// write/verify failures
+	uint32_t	erases, rows, configs;		// NVM operations so far
+	uint32_t	nvm_timeouts;
+	uint64_t	nvm_total_us;	// time spent waiting for the NVM controller
+	uint32_t	retried, retry_failed;		// rows failing to verify, not recovered
+};
+
+typedef void (*pb_progress_fn)(const char *op, int percent, void *ctx);
+typedef void (*pb_telemetry_fn)(const pb_telemetry *t, void *ctx);
+
+class PicProgrammer{
+
+	public:
+		PicProgrammer();
+		~PicProgrammer();
+
+		/* Map the GPIOs and create the driver of the given family;
+		 * pins as "PGC,PGD,MCLR", NULL for the build defaults. The
+		 * timing profile of those pins, if any, is applied */
+		bool open(const char *family, const char *pins=NULL);
+		void close(void);
+
+		/* Enter program mode and read the device ID */
+		bool detect(void);
+		const char *device_name(void);
+		uint32_t device_id(void);
+		uint16_t device_rev(void);
+
+		bool erase(void);
+		bool blank(void);
+		/* Bulk erase and write, verified by the driver */
+		bool program(const pb_image &img);
+		/* count 0: the whole program memory */
+		bool read(pb_image &img, uint32_t start=0, uint32_t count=0);
+		/* Read back and compare the filled words of img */
+		bool verify(const pb_image &img);
+
+		/* Intel HEX text from/to an image; parsing needs a detected device */
+		bool parse_hex(const char *text, size_t len, pb_image &img);
+		std::string format_hex(const pb_image &img);
+
+		void on_progress(pb_progress_fn fn, void *ctx);
+		void on_telemetry(pb_telemetry_fn fn, void *ctx);
+
+	private:
+		Pic				*pic;
+		bool			io_open, program_mode;
+		const char		*op;
+		pb_progress_fn	progress_fn;
+		void			*progress_ctx;
+		pb_telemetry_fn	telemetry_fn;
+		void			*telemetry_ctx;
+		struct timeval	op_start;
+
+		static void progress_hook(int percent, void *ctx);
+		void begin(const char *name);
+		bool end(bool ok);
+};
+
+#endif
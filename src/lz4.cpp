@@ -0,0 +1,89 @@
+/*
+ * Raspberry Pi PIC Programmer using GPIO connector
+ * https://github.com/WallaceIT/picberry
+ * Copyright 2016 Francesco Valla
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "common.h"
+
+/*
+ * Decode one LZ4 block (the raw block format, without the frame header)
+ * into dst. Every length and offset is checked against both buffers.
+ * Returns the number of decoded bytes, or -1 if the block is malformed.
+ */
+int lz4_decode(const uint8_t *src, uint32_t src_len, uint8_t *dst, uint32_t dst_len)
+{
+	const uint8_t *ip = src, *iend = src + src_len;
+	uint8_t *op = dst, *oend = dst + dst_len;
+	uint32_t len, offset;
+	uint8_t token, b;
+
+	while(ip < iend){
+		token = *ip++;
+
+		/* literals */
+		len = token >> 4;
+		if(len == 15){
+			do{
+				if(ip == iend)
+					return -1;
+				b = *ip++;
+				len += b;
+			}while(b == 255);
+		}
+		if(len > (uint32_t)(iend - ip) || len > (uint32_t)(oend - op))
+			return -1;
+		memcpy(op, ip, len);
+		ip += len;
+		op += len;
+
+		/* the last sequence has no match */
+		if(ip == iend)
+			break;
+
+		/* match */
+		if(iend - ip < 2)
+			return -1;
+		offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+		if(offset == 0 || offset > (uint32_t)(op - dst))
+			return -1;
+
+		len = token & 0x0F;
+		if(len == 15){
+			do{
+				if(ip == iend)
+					return -1;
+				b = *ip++;
+				len += b;
+			}while(b == 255);
+		}
+		len += 4;
+		if(len > (uint32_t)(oend - op))
+			return -1;
+
+		/* byte by byte: the match may overlap what it is copying */
+		while(len--){
+			*op = *(op - offset);
+			op++;
+		}
+	}
+
+	return op - dst;
+}
@@ -26,18 +26,17 @@
 #include <unistd.h>
 #include <errno.h>
 #include <string.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/wait.h>
 #include <sys/ioctl.h>
-#include <sys/socket.h>
-#include <netinet/in.h>
-#include <arpa/inet.h>
 
 #include <iostream>
 #include <fstream>
+#include <string>
 
 #include "common.h"
 #include "devices/dspic33f.h"
@@ -59,11 +58,17 @@ volatile uint32_t   *gpio;
 
 struct flags_struct flags;
 
-int pic_clk  = DEFAULT_PIC_CLK;
-int pic_data = DEFAULT_PIC_DATA;
-int pic_mclr = DEFAULT_PIC_MCLR;
+thread_local int pic_clk  = DEFAULT_PIC_CLK;
+thread_local int pic_data = DEFAULT_PIC_DATA;
+thread_local int pic_mclr = DEFAULT_PIC_MCLR;
+thread_local unsigned int clk_half_ns = 1000;	// PGC half period, ns
 char pic_clk_port=0, pic_data_port=0, pic_mclr_port=0;
 
+int gang_count = 0;             // 0: single target on pic_data
+int gang_pins[GANG_MAX];        // PGD line of each target
+uint32_t gang_mask = 0;         // all the gang PGD lines
+uint32_t gang_fail = 0;         // targets which failed so far
+
 #define FXN_NULL        0b00000000
 #define FXN_RESET       0b00000001
 #define FXN_SERVER      0b00000010
@@ -72,6 +77,8 @@ char pic_clk_port=0, pic_data_port=0, pic_mclr_port=0;
 #define FXN_ERASE       0b00010000
 #define FXN_BLANKCHEK   0b00100000
 #define FXN_REGDUMP     0b01000000
+#define FXN_DAEMON      0b10000000
+#define FXN_SCRIPT      0b100000000
 
 /* Hardware delay function by Gordon's Projects - WiringPi */
 void delay_us (unsigned int howLong)
@@ -87,15 +94,59 @@ void delay_us (unsigned int howLong)
 		gettimeofday (&tNow, 0);
 }
 
+/* Wait until howLong us have elapsed since start, which lets the caller do
+ * useful work inside a fixed device timing window */
+void delay_since (struct timeval *start, unsigned int howLong)
+{
+	struct timeval tNow, tLong, tEnd;
+
+	tLong.tv_sec  = howLong / 1000000;
+	tLong.tv_usec = howLong % 1000000;
+	timeradd (start, &tLong, &tEnd);
+
+	do
+		gettimeofday (&tNow, 0);
+	while (timercmp (&tNow, &tEnd, <));
+}
+
+/* Wait half a period of PGC: 1us, or what the timing profile says */
+void delay_clk(void)
+{
+	struct timespec tNow, tEnd;
+
+	if(clk_half_ns == 0)
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC, &tEnd);
+	tEnd.tv_nsec += clk_half_ns;
+	if(tEnd.tv_nsec >= 1000000000){
+		tEnd.tv_sec++;
+		tEnd.tv_nsec -= 1000000000;
+	}
+	do
+		clock_gettime(CLOCK_MONOTONIC, &tNow);
+	while(tNow.tv_sec < tEnd.tv_sec ||
+		  (tNow.tv_sec == tEnd.tv_sec && tNow.tv_nsec < tEnd.tv_nsec));
+}
+
+#ifndef LIBPICBERRY
 int main(int argc, char *argv[])
 {
 	int opt, function = 0;
     char *infile = 0;
-    char *outfile = 0;
+    std::string images;
+    char *outfile = (char *) "ofile.hex";
     bool log = false;
     char *logfile = 0;
     char *pins = 0;
     char *family = 0;
+    char *gang = 0;
+    char *script = 0;
+    char *plan = 0;
+    int production = 0;
+    int calibrate = 0;
+    char *channels[DAEMON_MAX_CHANNELS];
+    int nchannels = 0;
     uint32_t count = 0, start = 0;
     int option_index = 0;
     int server_port = 15000;
@@ -105,6 +156,13 @@ int main(int argc, char *argv[])
             {"help",        no_argument,       0,           'h'},
             {"server",      required_argument, 0,           'S'},
             {"gpio",        required_argument, 0,           'g'},
+            {"gang",        required_argument, 0,           'G'},
+            {"daemon",      no_argument,       0,           'D'},
+            {"channel",     required_argument, 0,           'C'},
+            {"script",      required_argument, 0,           'J'},
+            {"production",  no_argument,       &production, 1},
+            {"calibrate",   no_argument,       &calibrate,  1},
+            {"timing",      required_argument, 0,           'T'},
             {"family",      required_argument, 0,           'f'},
             {"read",        required_argument, 0,           'r'},
             {"write",       no_argument,       0,           'w'},
@@ -118,6 +176,15 @@ int main(int argc, char *argv[])
             {"boot-only",   no_argument,       &flags.boot_only,    1},
             {"program-only",no_argument,       &flags.program_only, 1},
 	    {"fulldump",    no_argument,       &flags.fulldump,     1},
+            {"stats",       no_argument,       &flags.stats,        1},
+            {"rowverify",   no_argument,       &flags.row_verify,   1},
+            {"retries",     required_argument, 0,           'Y'},
+            {"resume",      no_argument,       &flags.resume,       1},
+            {"skip-identical", no_argument,    &flags.skip_identical, 1},
+            {"config-only", no_argument,       &flags.config_only,  1},
+            {"serialize",   required_argument, 0,           'Z'},
+            {"journal",     required_argument, 0,           'K'},
+            {"plan",        required_argument, 0,           'P'},
             {0, 0, 0, 0}
     };
 
@@ -141,6 +208,40 @@ int main(int argc, char *argv[])
             case 'g':
                 pins = optarg;
                 break;
+            case 'G':
+                gang = optarg;
+                break;
+            case 'D':
+                function = FXN_DAEMON;
+                break;
+            case 'C':
+                if(nchannels == DAEMON_MAX_CHANNELS){
+                    cout << "Too many channels, max " << DAEMON_MAX_CHANNELS << endl;
+                    exit(1);
+                }
+                channels[nchannels++] = optarg;
+                break;
+            case 'Y':
+                flags.retries = atoi(optarg);
+                break;
+            case 'T':
+                timing_file = optarg;
+                break;
+            case 'K':
+                journal_dir = optarg;
+                flags.journal = 1;
+                break;
+            case 'P':
+                plan = optarg;
+                break;
+            case 'Z':
+                if(!serial_load(optarg))
+                    exit(1);
+                break;
+            case 'J':
+                script = optarg;
+                function |= FXN_SCRIPT;
+                break;
             case 'l':
                 log = true;
                 logfile = optarg;
@@ -156,7 +257,11 @@ int main(int argc, char *argv[])
                 start = atoi(optarg);
                 break;
             case 'w':
-                infile = optarg;
+                /* several -w: one image merged from all of them */
+                if(!images.empty())
+                    images += ',';
+                images += optarg;
+                infile = &images[0];
                 function |= FXN_WRITE;
                 break;
             case 'e':
@@ -183,6 +288,26 @@ int main(int argc, char *argv[])
         exit(1);
     }
 
+    if (production && (function != FXN_WRITE || gang)) {
+        cout << "Production mode needs -w file.hex, no other operation and no --gang!" << endl;
+        exit(1);
+    }
+
+    if (calibrate && (function != FXN_NULL || gang || production)) {
+        cout << "Calibration runs alone, with no other operation and no --gang!" << endl;
+        exit(1);
+    }
+
+    if (plan && (function != FXN_WRITE || production || calibrate || gang)) {
+        cout << "--plan needs -w file.hex, no other operation and no --gang!" << endl;
+        exit(1);
+    }
+
+    if (function & FXN_SCRIPT && !script_parse(script)) {
+        cout << "Please specify a valid job script!" << endl;
+        exit(1);
+    }
+
     /* if not in log mode, disable stdout line buffering */
     if(!log){
         setvbuf(stdout, NULL, _IONBF, 1024);
@@ -216,6 +341,37 @@ int main(int argc, char *argv[])
         }
     }
     
+    /* Gang mode: PGD of each target, PGC and MCLR are shared */
+    if(gang != 0){
+#ifdef GANG_SUPPORTED
+        char *tok;
+
+        if(family == 0 || (strcmp(family,"dspic33e") && strcmp(family,"pic24fj"))){
+            cout << "Gang mode is only supported for dspic33e and pic24fj families!" << endl;
+            exit(1);
+        }
+        if(function & ~(FXN_WRITE | FXN_ERASE)){
+            cout << "Gang mode supports only -w and -e!" << endl;
+            exit(1);
+        }
+        for(tok = strtok(gang, ","); tok; tok = strtok(NULL, ",")){
+            if(gang_count == GANG_MAX || atoi(tok) < 0 || atoi(tok) > 31){
+                cout << "Gang mode supports up to " << GANG_MAX
+                     << " PGD lines on GPIO 0-31!" << endl;
+                exit(1);
+            }
+            gang_pins[gang_count] = atoi(tok);
+            gang_mask |= 1 << gang_pins[gang_count];
+            gang_count++;
+        }
+        if(gang_count)
+            pic_data = gang_pins[0];
+#else
+        cout << "Gang mode is not supported on this host!" << endl;
+        exit(1);
+#endif
+    }
+
     if(flags.debug){
         cout << "PGC <=> pin " << pic_clk_port << (pic_clk&0xFF)
              << endl;
@@ -225,61 +381,53 @@ int main(int argc, char *argv[])
              << endl;
     }
 
+    /* dry run: no I/O set up, no device touched */
+    if(plan)
+        return plan_mode(plan, infile) ? 0 : 1;
+
+    if(function == FXN_DAEMON){
+#ifdef DAEMON_SUPPORTED
+        if(!nchannels || gang){
+            cout << "Daemon mode needs at least one --channel and no --gang!" << endl;
+            exit(1);
+        }
+#else
+        cout << "Daemon mode is not supported on this host!" << endl;
+        exit(1);
+#endif
+    }
+
     /* Setup gpio pointer for direct register access */
     if(flags.debug) cout << "Setting up I/O..." << endl;
-    setup_io();
+    if(function == FXN_DAEMON)
+        map_io();       // each channel sets up its own pins
+    else
+        setup_io();
 
     if(function == FXN_RESET)
         pic_reset();
     else if(function == FXN_SERVER)
         server_mode(server_port);
+    else if(function == FXN_DAEMON)
+        daemon_mode(channels, nchannels);
     else{
 
-        Pic *pic = new dspic33f();
-
-        if(family == 0 || strcmp(family, "dspic33f") == 0);
-            //pic = new dspic33f(); default case, nothing to do
-        else if(strcmp(family,"dspic33e") == 0)
-            pic = new dspic33e(SF_DSPIC33E);
-        else if(strcmp(family,"pic24fj") == 0)
-            pic = new dspic33e(SF_PIC24FJ);
-        else if (strcmp(family, "dspic33ck") == 0)
-            pic = new dspic33ck();
-        else if(strcmp(family,"pic10f322") == 0)
-            pic = new pic10f322();
-        else if(strcmp(family,"pic18fj") == 0)
-            pic = new pic18fj();
-        else if(strcmp(family,"pic24fjxxxga0xx") == 0)
-            pic = new pic24fjxxxga0xx();
-        else if(strcmp(family,"pic24fjxxxga3xx") == 0)
-            pic = new pic24fjxxxga3xx();
-        else if(strcmp(family,"pic24fjxxga1xx") == 0)
-            pic = new pic24fjxxga1xx_gb0xx();
-        else if(strcmp(family,"pic24fjxxgb0xx") == 0)
-            pic = new pic24fjxxga1xx_gb0xx();
-        else if(strcmp(family,"pic24fjxxxga1xx") == 0)
-            pic = new pic24fjxxxga1_gb1();
-        else if(strcmp(family,"pic24fjxxxga2xx") == 0)
-            pic = new pic24fjxxxga2_gb2();
-        else if(strcmp(family,"pic24fjxxxgb1xx") == 0)
-            pic = new pic24fjxxxga1_gb1();
-        else if(strcmp(family,"pic24fjxxxgb2xx") == 0)
-            pic = new pic24fjxxxga2_gb2();
-	else if(strcmp(family,"pic24fxxka1xx") == 0)
-            pic = new pic24fxxka1xx();
-	else if(strcmp(family,"pic32mx1") == 0)
-            pic = new pic32(SF_PIC32MX1);
-        else if(strcmp(family,"pic32mx2") == 0)
-            pic = new pic32(SF_PIC32MX2);
-        else if(strcmp(family,"pic32mx3") == 0)
-            pic = new pic32(SF_PIC32MX3);
-        else if(strcmp(family,"pic32mz") == 0)
-            pic = new pic32(SF_PIC32MZ);
-        else if(strcmp(family,"pic32mk") == 0)
-            pic = new pic32(SF_PIC32MK);   
-        else{
+        Pic *pic;
+
+        if(family && strcmp(family, "auto") == 0){
+            pic = pic_autodetect();
+            if(!pic){
+                cerr << "ERROR: no known device answered the auto-detection probes." << endl;
+                goto clean;
+            }
+        }
+        else
+            pic = pic_create(family ? family : "dspic33f");
+
+        if(!pic){
             cerr << "ERROR: PIC family not correctly chosen." << endl;
             cerr << "Available families:" << endl
+                 << "- auto" << endl
                  << "- dspic33e" << endl
                  << "- dspic33ck" << endl
                  << "- pic24fj" << endl
@@ -302,6 +450,18 @@ int main(int argc, char *argv[])
             goto clean;
         }
 
+        /* the fixture runs at its calibrated speed from here on */
+        if(calibrate){
+            calibrate_mode(pic, family ? family : "dspic33f");
+            goto clean;
+        }
+        timing_load(family ? family : "dspic33f");
+
+        if(production){
+            production_mode(pic, infile);
+            goto clean;
+        }
+
         /* ENTER PROGRAM MODE */
         pic -> enter_program_mode();
         pic -> setup_pe();
@@ -321,8 +481,27 @@ int main(int argc, char *argv[])
                     cout << "DONE! " << endl;
                     break;
                 case FXN_WRITE:
+                    if(flags.config_only){
+                        cout << "Writing configuration..." << endl;
+                        pic->write_configuration(infile);
+                        cout << (pic->errors ? "FAILED!" : "DONE!") << endl;
+                        break;
+                    }
                     cout << "Writing chip...";
+                    if(flags.skip_identical || serial_active()){
+                        if(!pic->load_image(infile))
+                            break;
+                        infile = NULL;
+                        if(serial_active() && !serial_apply(pic))
+                            break;
+                        if(flags.skip_identical && pic->already_programmed()){
+                            cout << "already programmed." << endl;
+                            break;
+                        }
+                    }
                     pic->write(infile);
+                    if(!pic->errors)
+                        serial_commit(pic);
                     cout << "DONE! " << endl;
                     break;
                 case FXN_ERASE:
@@ -341,11 +520,21 @@ int main(int argc, char *argv[])
                 case FXN_REGDUMP:
                     pic->dump_configuration_registers();
                     break;
+                case FXN_SCRIPT:
+                    script_run(pic);
+                    break;
                 default:
                     cout << endl << endl << "Please select only one option" <<
-                    "between -d, -b, -r, -w, -e." << endl;
+                    "between -d, -b, -r, -w, -e, --script." << endl;
                     break;
             };
+
+            if(flags.stats)
+                pic->print_nvm_stats();
+            pic->print_retry_stats();
+
+            if(gang_count)
+                gang_report();
         }
         else{
 		    fprintf(stdout,"Device ID: 0x%x\n", pic ->device_id);
@@ -375,8 +564,112 @@ clean:
     return 0;
 }
 
-/* Set up a memory regions to access GPIO */
+#endif /* LIBPICBERRY */
+
+/* Create the driver for the given family name, NULL if unknown */
+Pic *pic_create(const char *family)
+{
+    if(strcmp(family,"dspic33f") == 0)
+        return new dspic33f();
+    else if(strcmp(family,"dspic33e") == 0)
+        return new dspic33e(SF_DSPIC33E);
+    else if(strcmp(family,"pic24fj") == 0)
+        return new dspic33e(SF_PIC24FJ);
+    else if(strcmp(family, "dspic33ck") == 0)
+        return new dspic33ck();
+    else if(strcmp(family,"pic10f322") == 0)
+        return new pic10f322();
+    else if(strcmp(family,"pic18fj") == 0)
+        return new pic18fj();
+    else if(strcmp(family,"pic24fjxxxga0xx") == 0)
+        return new pic24fjxxxga0xx();
+    else if(strcmp(family,"pic24fjxxxga3xx") == 0)
+        return new pic24fjxxxga3xx();
+    else if(strcmp(family,"pic24fjxxga1xx") == 0)
+        return new pic24fjxxga1xx_gb0xx();
+    else if(strcmp(family,"pic24fjxxgb0xx") == 0)
+        return new pic24fjxxga1xx_gb0xx();
+    else if(strcmp(family,"pic24fjxxxga1xx") == 0)
+        return new pic24fjxxxga1_gb1();
+    else if(strcmp(family,"pic24fjxxxga2xx") == 0)
+        return new pic24fjxxxga2_gb2();
+    else if(strcmp(family,"pic24fjxxxgb1xx") == 0)
+        return new pic24fjxxxga1_gb1();
+    else if(strcmp(family,"pic24fjxxxgb2xx") == 0)
+        return new pic24fjxxxga2_gb2();
+    else if(strcmp(family,"pic24fxxka1xx") == 0)
+        return new pic24fxxka1xx();
+    else if(strcmp(family,"pic32mx1") == 0)
+        return new pic32(SF_PIC32MX1);
+    else if(strcmp(family,"pic32mx2") == 0)
+        return new pic32(SF_PIC32MX2);
+    else if(strcmp(family,"pic32mx3") == 0)
+        return new pic32(SF_PIC32MX3);
+    else if(strcmp(family,"pic32mz") == 0)
+        return new pic32(SF_PIC32MZ);
+    else if(strcmp(family,"pic32mk") == 0)
+        return new pic32(SF_PIC32MK);
+
+    return NULL;
+}
+
+/*
+ * -f auto probes, cheapest protocol first. Each driver reads the device ID
+ * the same way as every family of its tables, so one program mode entry
+ * covers all of them; PIC32 comes last, being the only one with a TAP.
+ */
+static const struct{
+    const char  *family;
+    devdb       dbs[5];
+    int         ndbs;
+} probes[] = {
+    {"pic24fjxxxga1xx", {DB_PIC24FJXXXGA1_GB1, DB_PIC24FJXXXGA0XX,
+                         DB_PIC24FJXXGA1XX_GB0XX, DB_PIC24FXXKA1XX, DB_DSPIC33F}, 5},
+    {"pic24fjxxxga2xx", {DB_PIC24FJXXXGA2_GB2, DB_PIC24FJXXXGA3XX}, 2},
+    {"dspic33e",        {DB_DSPIC33E}, 1},
+    {"dspic33ck",       {DB_DSPIC33CK}, 1},
+    {"pic18fj",         {DB_PIC18FJ}, 1},
+    {"pic10f322",       {DB_PIC10F322}, 1},
+    {"pic32mx3",        {DB_PIC32}, 1}
+};
+
+/* Create the driver for the connected device, NULL if no probe knows it */
+Pic *pic_autodetect(void)
+{
+    const pic_device *dev = NULL;
+    const char *family = NULL;
+    Pic *pic;
+
+    for(unsigned int i = 0; i < sizeof(probes)/sizeof(probes[0]) && !dev; i++){
+        pic = pic_create(probes[i].family);
+        pic->enter_program_mode();
+        pic->probe_device_id();
+        pic->exit_program_mode();
+        for(int d = 0; d < probes[i].ndbs && !dev; d++)
+            dev = devdb_lookup(probes[i].dbs[d], pic->device_id, &family);
+        if(flags.debug)
+            fprintf(stderr, "%s probe: ID 0x%08x%s\n", probes[i].family,
+                    pic->device_id, dev ? "" : " (unknown)");
+        free(pic->mem.location);
+        free(pic->mem.filled);
+        delete pic;
+    }
+    if(!dev)
+        return NULL;
+
+    fprintf(stderr, "Detected %s, family %s\n", dev->name, family);
+    return pic_create(family);
+}
+
+/* Set up a memory regions to access GPIO and configure the PIC pins */
 void setup_io(void)
+{
+    map_io();
+    setup_pins();
+}
+
+/* Map the GPIO registers */
+void map_io(void)
 {
     /* open /dev/mem */
     mem_fd = open("/dev/mem", O_RDWR|O_SYNC);
@@ -395,21 +688,41 @@ void setup_io(void)
 
     /* Always use volatile pointer! */
     gpio = (volatile uint32_t *) gpio_map;
-        
+}
+
+/* Configure the PGC, PGD and MCLR pins of the calling thread */
+void setup_pins(void)
+{
     GPIO_IN(pic_clk);   // NOTE: MUST use GPIO_IN before GPIO_OUT
     GPIO_OUT(pic_clk);
     
-    GPIO_IN(pic_data);
-    GPIO_OUT(pic_data);
+    pgd_in();
+    pgd_out();
     
     GPIO_IN(pic_mclr);      // MCLR as input, puts the output driver in Hi-Z
 
     GPIO_CLR(pic_clk);
-    GPIO_CLR(pic_data);
+    PGD_CLR();
 
     delay_us(1);        // sleep for 1us after GPIO configuration
 }
 
+#ifdef DAEMON_SUPPORTED
+/* Change the direction of a pin; FSEL registers hold 10 pins each, so the
+ * read-modify-write must not interleave with other channels */
+void gpio_dir(int g, bool out)
+{
+    static pthread_mutex_t fsel_lock = PTHREAD_MUTEX_INITIALIZER;
+
+    pthread_mutex_lock(&fsel_lock);
+    if(out)
+        GPIO_FSEL_OUT(g);
+    else
+        GPIO_FSEL_IN(g);
+    pthread_mutex_unlock(&fsel_lock);
+}
+#endif
+
 /* Release GPIO memory region */
 void close_io(void)
 {
@@ -433,6 +746,53 @@ void close_io(void)
         }
 }
 
+/* Set PGD line(s) as input; in gang mode the lines of all the targets */
+void pgd_in(void)
+{
+    int i;
+
+    if(!gang_count)
+        GPIO_IN(pic_data);
+    for(i = 0; i < gang_count; i++)
+        GPIO_IN(gang_pins[i]);
+}
+
+/* Set PGD line(s) as output. Always use pgd_in() before pgd_out() */
+void pgd_out(void)
+{
+    int i;
+
+    if(!gang_count)
+        GPIO_OUT(pic_data);
+    for(i = 0; i < gang_count; i++)
+        GPIO_OUT(gang_pins[i]);
+}
+
+/* Turn bits samples of the level register (LSB first) into one data word
+ * per gang target */
+void gang_split(uint32_t *levels, uint8_t bits, uint16_t *words)
+{
+    int t, i;
+
+    for(t = 0; t < gang_count; t++){
+        words[t] = 0;
+        for(i = 0; i < bits; i++)
+            words[t] |= ((levels[i] >> gang_pins[t]) & 0x1) << i;
+    }
+}
+
+/* Print the result of every gang target and the failure mask */
+void gang_report(void)
+{
+    int t;
+
+    cout << endl << "Gang results:" << endl;
+    for(t = 0; t < gang_count; t++)
+        fprintf(stdout, " - target %2d (PGD on GPIO %2d): %s\n", t,
+                gang_pins[t], (gang_fail & (1 << t)) ? "FAILED" : "OK");
+    fprintf(stdout, "Failure mask: 0x%04X\n", gang_fail);
+}
+
 /* reset the device */
 void pic_reset(bool silent)
 {
@@ -449,6 +809,7 @@ void pic_reset(bool silent)
 }
 
 /* print the help */
+#ifndef LIBPICBERRY
 void usage(void)
 {
     cout <<
@@ -460,15 +821,31 @@ void usage(void)
             "       --server=port,      -S port           server mode, listening on given port\n"
             "       --log=[file],       -l [file]         redirect the output to log file(s)\n"
             "       --gpio=PGC,PGD,MCLR -g PGC,PGD,MCLR   GPIO selection in form [PORT:]NUM (optional)\n"
-            "       --family=[family],  -f [family]       PIC family [default: dspic33f]\n"
+            "       --gang=PGD1,PGD2,...                  gang mode, one PGD line per target (RPi, dspic33e/pic24fj)\n"
+            "       --daemon                              run jobs read from stdin on the given channels (RPi)\n"
+            "       --channel=PGC,PGD,MCLR,family         define a daemon channel (repeat for each one)\n"
+            "       --script=op[:file],...|@file          run erase, write, read, blankcheck, regdump in one session\n"
+            "       --production                          with -w, program every target connected, until Ctrl-C\n"
+            "       --calibrate                           find and save the fastest PGC speed of this fixture\n"
+            "       --timing=file                         timing profiles [default: " TIMING_PROFILE "]\n"
+            "       --family=[family],  -f [family]       PIC family, auto to detect it [default: dspic33f]\n"
             "       --read=[file.hex],  -r [file.hex]     read chip to file [defaults to ofile.hex]\n"
-            "       --write=file.hex,   -w file.hex       bulk erase and write chip\n"
+            "       --write=file.hex[@offset], -w ...     bulk erase and write chip; repeat to merge several images\n"
             "       --erase,            -e                bulk erase chip\n"
             "       --blankcheck,       -b                blank check of the chip\n"
             "       --regdump,          -d                read configuration registers\n"
             "       --noverify                            skip memory verification after writing\n"
+            "       --rowverify                           verify each row right after writing it (dsPIC33/PIC24)\n"
+            "       --retries=N                           attempts at recovering a row failing to verify [default: 2]\n"
+            "       --resume                              with -w, journal the write, go on with an interrupted one of the same image (dsPIC33E)\n"
+            "       --journal=dir                         journal writes in dir, for a later --resume [default: " JOURNAL_DIR "]\n"
+            "       --skip-identical                      with -w, check the image against the device first, write it only if it differs\n"
+            "       --config-only                         with -w, write only the configuration words which differ (dsPIC33E, PIC32)\n"
+            "       --serialize=rules                     with -w, patch per unit serial numbers into the image\n"
+            "       --plan=PART                           with -w, show what writing PART would do and how long, without a device\n"
             "       --debug                               turn ON debug\n"
             "       --fulldump                            don't detect empty sections, make complete dump (PIC32)\n"
+            "       --stats                               print erase/write timing statistics\n"
             "       --program-only                        read/write only program section (PIC32)\n"
             "       --boot-only                           read/write only boot section (PIC32)\n"
             "\n"
@@ -500,302 +877,4 @@ void usage(void)
             "       pic32mz     \n"
             "       pic32mk     \n";
 }
-
-#define BUFFSIZE 32
-
-enum srv_command : char{
-    SRV_PB_VER      = '0',
-    SRV_RESET       = '1',
-    SRV_ENTER       = '2',
-    SRV_EXIT        = '3',
-    SRV_DEV_ID      = '4',
-    SRV_ERASE       = '5',
-    SRV_READ        = '6',
-    SRV_WRITE       = '7',
-    SRV_BLANKCHECK  = '8',
-    SRV_REGDUMP     = '9',
-    SRV_SET_FAMILY  = 'A'
-};
-
-enum srv_families : char{
-    SRV_FAM_DSPIC33E = '0',
-    SRV_FAM_DSPIC33F = '1',
-    SRV_FAM_PIC18FJ  = '2',
-    SRV_FAM_PIC24FJ  = '3',
-    SRV_FAM_PIC32MX1 = '4',
-    SRV_FAM_PIC32MX2 = '5',
-    SRV_FAM_PIC32MX3 = '6',
-    SRV_FAM_PIC32MZ  = '7',
-    SRV_FAM_PIC32MK  = '8',
-    SRV_FAM_DSPIC33CK  = '9'
-};
-
-void server_mode(int port){
-    int serversock, clientsock;
-    struct sockaddr_in pbserver, pbclient;
-    char buffer[BUFFSIZE];
-    int received = -1;
-    bool program_mode = false;
-    char current_family = 0;
-    
-    /* Set picberry to work in "client" mode */
-    flags.client = 1;
-
-    /* Create the TCP socket */
-    if ((serversock = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP)) < 0) {
-        cerr << "Failed to create socket";
-        exit(1);
-    }
-    /* Construct the server sockaddr_in structure */
-    memset(&pbserver, 0, sizeof(pbserver));       /* Clear struct */
-    pbserver.sin_family = AF_INET;                /* Internet/IP */
-    pbserver.sin_addr.s_addr = htonl(INADDR_ANY); /* Incoming addr */
-    pbserver.sin_port = htons(port);              /* server port */
-    
-     /* Bind the server socket */      
-    if (bind(serversock, (struct sockaddr *) &pbserver, sizeof(pbserver)) < 0) {
-       cerr << "Failed to bind the server socket";
-       exit(1);
-    }
-    /* Listen on the server socket (single connection) */
-    if (listen(serversock, 1) < 0) {
-        cerr << "Failed to listen on server socket";
-        exit(1);
-    }
-    
-    /* Setup picberry operation */
-    Pic *pic = new dspic33f();
-    current_family = SRV_FAM_DSPIC33F;
-    
-    /* Run until cancelled */
-    while (1) {
-        unsigned int clientlen = sizeof(pbclient);
-        /* Wait for client connection */
-        if ((clientsock = accept(serversock, (struct sockaddr *) &pbclient,
-                                 &clientlen)) < 0) {
-            cerr << "Failed to accept client connection";
-            exit(1);
-        }
-        /* redirect stdout to socket */
-        setbuf(stdout, NULL);
-        dup2(clientsock, STDOUT_FILENO);
-        cerr << "Client connected: " << inet_ntoa(pbclient.sin_addr) << endl;
-        /* Receive message */
-        if ((received = recv(clientsock, buffer, BUFFSIZE, 0)) < 0)
-            cerr << "Failed to receive initial bytes from client";
-        /* Send bytes and check for more incoming data in loop */
-        while (received > 0) {
-            if(flags.debug){
-                buffer[received] = '\0';
-                cerr << "Command received: " << buffer;   
-            }
-                
-            switch(buffer[0]){
-                case SRV_PB_VER:
-                    cerr << "[CMD] Get picberry version" << endl;
-                    send(clientsock, VERSION, strlen(VERSION), 0);
-                    break;
-                case SRV_RESET:
-                    cerr << "[CMD] Reset" << endl;
-                    pic_reset();
-                    break;
-                case SRV_ENTER:
-                    if(!program_mode){
-                        cerr << "[CMD] Enter Program Mode" << endl;
-                        pic -> enter_program_mode();
-                        if(pic -> setup_pe())
-                            program_mode = true;
-                        else
-                            pic -> exit_program_mode();
-                    }
-                    break;
-                case SRV_EXIT:
-                    if(program_mode){
-                        cerr << "[CMD] Exit Program Mode" << endl;
-                        pic -> exit_program_mode();
-                        program_mode = false;   
-                    }
-                    break;
-                case SRV_SET_FAMILY:
-                    cerr << "[CMD] Set Family ";
-                    
-                    if(current_family != buffer[1]){
-                        current_family = buffer[1];
-                    
-                        switch(buffer[1]){
-                            case SRV_FAM_DSPIC33E:
-                                cerr << "DSPIC33E" << endl;
-                                pic = new dspic33e(SF_DSPIC33E);
-                                break;
-                            case SRV_FAM_DSPIC33F:
-                                cerr << "DSPIC33F" << endl;
-                                pic = new dspic33f();
-                                break;
-                            case SRV_FAM_DSPIC33CK:
-                                cerr << "DSPIC33CK" << endl;
-                                pic = new dspic33ck();
-                                break;
-                            case SRV_FAM_PIC18FJ:
-                                cerr << "PIC18FJ" << endl;
-                                pic = new pic18fj();
-                                break;
-                            case SRV_FAM_PIC24FJ:
-                                cerr << "PIC24FJ" << endl;
-                                pic = new dspic33e(SF_PIC24FJ);
-                                break;
-                            case SRV_FAM_PIC32MX1:
-                                cerr << "PIC32MX1" << endl;
-                                pic = new pic32(SF_PIC32MX1);
-                                break;
-                            case SRV_FAM_PIC32MX2:
-                                cerr << "PIC32MX2" << endl;
-                                pic = new pic32(SF_PIC32MX2);
-                                break;
-                            case SRV_FAM_PIC32MX3:
-                                cerr << "PIC32MX3" << endl;
-                                pic = new pic32(SF_PIC32MX3);
-                                break;
-                            case SRV_FAM_PIC32MZ:
-                                cerr << "PIC32MZ" << endl;
-                                pic = new pic32(SF_PIC32MZ);
-                                break;
-                            case SRV_FAM_PIC32MK:
-                                cerr << "PIC32MK" << endl;
-                                pic = new pic32(SF_PIC32MK);
-                                break;
-                        }
-                    }
-                    else{
-                        cerr << "not needed." << endl;
-                    }
-                    fprintf(stdout, "K%c", buffer[1]);
-                    break;
-                case SRV_DEV_ID:
-                    if(program_mode){
-                        if(flags.debug) cerr << "[CMD] Read Device ID" << endl;
-                        if(pic -> read_device_id())
-                            fprintf(stdout,
-                                    "{\"DevName\" : \"%s\", \"DevID\" : \"0x%08X\", \"DevRev\" : \"0x%08X\"}",
-                                    pic->name,
-                                    pic->device_id,
-                                    pic->device_rev);
-                        else{
-                            fprintf(stdout, "NC");
-                            pic -> exit_program_mode();
-                            program_mode = false;
-                        }
-                    }
-                    break;
-                case SRV_BLANKCHECK:
-                    if(program_mode){
-                        cerr << "[CMD] Blank Check" << endl;
-                        pic->blank_check();
-                    }
-                    break;
-                case SRV_READ:
-                    if(program_mode){
-                        cerr << "[CMD] Read" << endl;
-                        pic->read((char *)"/var/tmp/tmpr.hex", 0, 0);
-                        send_file((char *)"/var/tmp/tmpr.hex");
-                    }
-                    break;
-                case SRV_WRITE:
-                    if(program_mode){
-                        cerr << "[CMD] Write" << endl;
-                        if(receive_file(clientsock, (char *)"/var/tmp/tmpw.hex")){
-                            cerr << "File transfer failed!" << endl;
-                            fprintf(stdout, "@ERR");
-                            break;
-                        }
-                        pic->write((char *)"/var/tmp/tmpw.hex");
-                    }
-                    break;
-                case SRV_ERASE:
-                    if(program_mode){
-                        cerr << "[CMD] Erase" << endl;
-                        pic->bulk_erase();
-                    }
-                    break;
-                default:
-                    break;
-            }
-            
-            /* Check for more data */
-            if ((received = recv(clientsock, buffer, BUFFSIZE, 0)) < 0)
-                cerr << "Error." << endl;
-        }
-        cerr << "Client disconnected." << endl;
-        if(program_mode){
-            pic -> exit_program_mode();
-            program_mode = false;   
-        }
-        close(clientsock);
-    }
-}
-
-uint8_t send_file(char * filename){
-    
-    FILE *fp;
-    char line[256], *ptr;
-        
-    fp = fopen(filename, "r");
-    if (fp == NULL) {
-      	cerr << "Error: cannot open source file " << filename << "." << endl;
-       	return 1;
-    }
-    
-    while (1) {
-        ptr = fgets(line, 256, fp);
-
-        if (ptr != NULL) 
-            cout << line;
-        else
-            break;
-    }
-    fclose(fp);
-    
-    fprintf(stdout, "@FIN");
-    
-    return 0;
-}
-
-uint8_t receive_file(int sock, char * filename){
-    
-    FILE *fp;
-    char line[45];
-    char buffer;
-    bool need_reading = true;
-    int received = -1;
-    int k=0;
-        
-    fp = fopen(filename, "w");
-    if (fp == NULL) {
-      	cerr << "Error: cannot open destination file " << filename << "." << endl;
-       	return 1;
-    }
-    
-    while (need_reading) {
-        for(k=0; k<46; k++){
-            if ((received = recv(sock, &buffer, 1, 0)) < 0)
-                cerr << "Failed to receive bytes from client";
-            // Check if last line
-            if(!received || buffer == '@'){
-                need_reading = false;
-                break;
-            }    
-            else{
-                line[k] = buffer;
-                if(buffer == '\n')
-                break;
-            }
-        }
-        // If not last line...
-        if(need_reading){
-            line[k+1] = '\0';
-            fprintf(fp, line);
-        } 
-    }
-    fclose(fp);
-    
-    return 0;
-}
+#endif
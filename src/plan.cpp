@@ -0,0 +1,142 @@
+/*
+ * Raspberry Pi PIC Programmer using GPIO connector
+ * https://github.com/WallaceIT/picberry
+ * Copyright 2016 Francesco Valla
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <time.h>
+
+#include "common.h"
+
+/*
+ * Dry run of -w: what writing an image to a part would do and how long it
+ * would take, without touching the GPIOs. The driver describes its write()
+ * as PGC cycles, delay_us(1) calls and datasheet waits per row (see
+ * plan_model); the cost of a PGC cycle and of a delay_us(1) is measured on
+ * this host, at the PGC speed of the fixture's timing profile. GPIO register
+ * accesses are not counted, so the estimate is a lower bound on hosts where
+ * they are slow.
+ */
+
+#define PLAN_SAMPLES	2000
+
+/* Average ns taken by fn() on this host */
+static double measure_ns(void (*fn)(void))
+{
+	struct timespec t0, t1;
+	int i;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for(i = 0; i < PLAN_SAMPLES; i++)
+		fn();
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	return ((t1.tv_sec - t0.tv_sec)*1e9 + (t1.tv_nsec - t0.tv_nsec)) / PLAN_SAMPLES;
+}
+
+static void delay_one_us(void)
+{
+	delay_us(1);
+}
+
+/* Milliseconds taken by the given amount of clocks, delays and waits */
+static double plan_ms(double clocks, double delays, double us,
+					  double clk_ns, double us_ns)
+{
+	return (clocks*2*clk_ns + delays*us_ns + us*1000) / 1e6;
+}
+
+bool plan_mode(const char *part, char *infile)
+{
+	const pic_device *dev;
+	const char *family;
+	plan_model model;
+	Pic *pic;
+	uint32_t addr, k, rows = 0, configs = 0, total_rows;
+	double clk_ns, us_ns, erase_ms, program_ms, verify_ms, config_ms, fixed_ms;
+	bool empty;
+
+	dev = devdb_find(part, &family);
+	if(!dev){
+		fprintf(stderr, "Unknown part %s\n", part);
+		return false;
+	}
+
+	pic = pic_create(family);
+	if(!pic || !pic->plan_setup(dev, &model)){
+		fprintf(stderr, "No plan model for the %s family\n", family);
+		delete pic;
+		return false;
+	}
+	timing_load(family);
+
+	if(!pic->load_image(infile)){
+		delete pic;
+		return false;
+	}
+
+	/* rows write() programs and reads back */
+	total_rows = (pic->mem.code_memory_size + model.row_words - 1) / model.row_words;
+	for(addr = 0; addr < pic->mem.code_memory_size; addr += model.row_words){
+		empty = true;
+		for(k = addr; k < addr + model.row_words && k < pic->mem.code_memory_size; k++)
+			if(pic->mem.filled[k]){
+				empty = false;
+				break;
+			}
+		if(!empty || model.all_rows){
+			rows++;
+			if(flags.debug)
+				fprintf(stdout, "  row 0x%06X%s\n", pic->hex_offset + 2*addr,
+						empty ? " (empty)" : "");
+		}
+	}
+	for(k = 0; k < model.config_count; k++)
+		if(pic->mem.filled[model.config_addr + 2*k])
+			configs++;
+
+	clk_ns = measure_ns(delay_clk);
+	us_ns = measure_ns(delay_one_us);
+
+	erase_ms = model.erase_us / 1000.0;
+	program_ms = rows * plan_ms(model.row_clocks, model.row_delays, model.row_us, clk_ns, us_ns);
+	verify_ms = rows * plan_ms(model.verify_clocks, model.verify_delays, 0, clk_ns, us_ns);
+	config_ms = configs * plan_ms(model.config_clocks, model.config_delays, model.config_us,
+								  clk_ns, us_ns);
+	fixed_ms = model.fixed_us / 1000.0;
+
+	fprintf(stdout, "Part: %s (%s), %u words of program memory\n",
+			dev->name, family, pic->mem.code_memory_size);
+	fprintf(stdout, "PGC half period: %u ns, %.0f ns measured\n", clk_half_ns, clk_ns);
+	fprintf(stdout, "delay_us(1): %.0f ns measured\n", us_ns);
+	fprintf(stdout, "Erase: bulk erase, %.1f ms\n", erase_ms);
+	fprintf(stdout, "Program: %u of %u rows of %u words, %.1f ms\n",
+			rows, total_rows, model.row_words, program_ms);
+	if(model.verify_clocks)
+		fprintf(stdout, "Verify: %u rows read back, %.1f ms\n", rows, verify_ms);
+	else
+		fprintf(stdout, "Verify: skipped\n");
+	if(model.config_count)
+		fprintf(stdout, "Configuration: %u of %u words, %.1f ms\n",
+				configs, model.config_count, config_ms);
+	fprintf(stdout, "Program mode entry and settling: %.1f ms\n", fixed_ms);
+	fprintf(stdout, "Estimated total: %.1f s\n",
+			(erase_ms + program_ms + verify_ms + config_ms + fixed_ms) / 1000);
+
+	delete pic;
+	return true;
+}
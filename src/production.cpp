@@ -0,0 +1,146 @@
+/*
+ * Raspberry Pi PIC Programmer using GPIO connector
+ * https://github.com/WallaceIT/picberry
+ * Copyright 2016 Francesco Valla
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "common.h"
+
+/*
+ * Production mode: program board after board without restarting. The
+ * target is probed every PROD_PROBE_MS by entering program mode and reading
+ * the device ID; a board which answers is written (and verified, unless
+ * --noverify) from the image parsed once, the result is reported and the
+ * loop waits for the board to be removed before looking for the next one.
+ * Ctrl-C stops the loop and prints the totals.
+ */
+
+#define PROD_PROBE_MS	500
+
+static volatile sig_atomic_t prod_stop = 0;
+
+static void prod_sigint(int sig)
+{
+	(void) sig;
+	prod_stop = 1;
+}
+
+/* Enter program mode and read the device ID; on failure leave it again */
+static bool prod_probe(Pic *pic)
+{
+	pic->enter_program_mode();
+	if(pic->setup_pe() && pic->read_device_id())
+		return true;
+	pic->exit_program_mode();
+	return false;
+}
+
+void production_mode(Pic *pic, char *infile)
+{
+	struct timeval start, end;
+	memory image = {0, 0, NULL, NULL};
+	unsigned int board = 0, passed = 0, failed = 0;
+	uint32_t ms;
+
+	signal(SIGINT, prod_sigint);
+	fprintf(stdout, "Production mode: waiting for a target (Ctrl-C to stop)...\n");
+
+	while(!prod_stop){
+		if(!prod_probe(pic)){
+			usleep(PROD_PROBE_MS * 1000);
+			continue;
+		}
+
+		board++;
+		gettimeofday(&start, 0);
+		fprintf(stdout, "\nBoard %u: %s (ID 0x%08x, rev 0x%x)\n", board,
+				pic->name, pic->device_id, pic->device_rev);
+
+		if(pic->mem.program_memory_size == image.program_memory_size){
+			/* same part as before: program from the image parsed then */
+			free(pic->mem.location);
+			free(pic->mem.filled);
+			pic->mem.location = image.location;
+			pic->mem.filled = image.filled;
+		}
+		else{
+			if(image.location)
+				fprintf(stdout, "Different part, parsing %s again\n", infile);
+			free(image.location);
+			free(image.filled);
+			if(!pic->load_image(infile)){
+				fprintf(stderr, "Error: no data in %s\n", infile);
+				pic->exit_program_mode();
+				break;
+			}
+			image = pic->mem;
+		}
+
+		pic->errors = 0;
+		if(serial_active() && !serial_apply(pic)){
+			pic->exit_program_mode();
+			break;
+		}
+		if(flags.skip_identical && pic->already_programmed())
+			fprintf(stdout, "Already programmed\n");
+		else
+			pic->write(NULL);
+		pic->exit_program_mode();
+		if(!pic->errors && !serial_commit(pic))
+			break;
+
+		/* the image outlives read_device_id(), which frees mem */
+		pic->mem.location = NULL;
+		pic->mem.filled = NULL;
+
+		gettimeofday(&end, 0);
+		ms = (end.tv_sec - start.tv_sec) * 1000 + (end.tv_usec - start.tv_usec) / 1000;
+		if(pic->errors)
+			failed++;
+		else
+			passed++;
+		fprintf(stdout, "Board %u: %s in %u ms (%u passed, %u failed)\n", board,
+				pic->errors ? "FAIL" : "PASS", ms, passed, failed);
+
+		fprintf(stdout, "Remove the board...\n");
+		while(!prod_stop && prod_probe(pic)){
+			pic->exit_program_mode();
+			usleep(PROD_PROBE_MS * 1000);
+		}
+		if(!prod_stop)
+			fprintf(stdout, "Waiting for the next target...\n");
+	}
+
+	fprintf(stdout, "\nProduction stopped: %u boards, %u passed, %u failed\n",
+			board, passed, failed);
+
+	if(pic->mem.location != image.location){
+		free(pic->mem.location);
+		free(pic->mem.filled);
+	}
+	free(image.location);
+	free(image.filled);
+	pic->mem.location = NULL;
+	pic->mem.filled = NULL;
+	signal(SIGINT, SIG_DFL);
+}
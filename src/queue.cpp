@@ -0,0 +1,124 @@
+/*
+ * Raspberry Pi PIC Programmer using GPIO connector
+ * https://github.com/WallaceIT/picberry
+ * Copyright 2016 Francesco Valla
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include "common.h"
+
+struct queue_node{
+	void				*item;
+	struct queue_node	*next;
+};
+
+void queue_init(job_queue *q)
+{
+	pthread_mutex_init(&q->lock, NULL);
+	pthread_cond_init(&q->cond, NULL);
+	q->head = q->tail = NULL;
+	q->len = 0;
+}
+
+/* Append an item and wake up the consumer */
+void queue_push(job_queue *q, void *item)
+{
+	struct queue_node *n = (struct queue_node *) malloc(sizeof(struct queue_node));
+
+	n->item = item;
+	n->next = NULL;
+
+	pthread_mutex_lock(&q->lock);
+	if(q->tail)
+		q->tail->next = n;
+	else
+		q->head = n;
+	q->tail = n;
+	q->len++;
+	pthread_cond_signal(&q->cond);
+	pthread_mutex_unlock(&q->lock);
+}
+
+/* Remove the oldest item, waiting for one if the queue is empty */
+void *queue_pop(job_queue *q)
+{
+	struct queue_node *n;
+	void *item;
+
+	pthread_mutex_lock(&q->lock);
+	while(!q->head)
+		pthread_cond_wait(&q->cond, &q->lock);
+	n = q->head;
+	q->head = n->next;
+	if(!q->head)
+		q->tail = NULL;
+	q->len--;
+	pthread_mutex_unlock(&q->lock);
+
+	item = n->item;
+	free(n);
+	return item;
+}
+
+/* As queue_pop(), but give up and return NULL after ms milliseconds */
+void *queue_pop_timed(job_queue *q, unsigned int ms)
+{
+	struct queue_node *n;
+	struct timeval now;
+	struct timespec until;
+	void *item;
+
+	gettimeofday(&now, 0);
+	until.tv_sec = now.tv_sec + ms / 1000;
+	until.tv_nsec = (now.tv_usec + (ms % 1000) * 1000) * 1000;
+	if(until.tv_nsec >= 1000000000){
+		until.tv_sec++;
+		until.tv_nsec -= 1000000000;
+	}
+
+	pthread_mutex_lock(&q->lock);
+	while(!q->head){
+		if(pthread_cond_timedwait(&q->cond, &q->lock, &until) == ETIMEDOUT && !q->head){
+			pthread_mutex_unlock(&q->lock);
+			return NULL;
+		}
+	}
+	n = q->head;
+	q->head = n->next;
+	if(!q->head)
+		q->tail = NULL;
+	q->len--;
+	pthread_mutex_unlock(&q->lock);
+
+	item = n->item;
+	free(n);
+	return item;
+}
+
+unsigned int queue_len(job_queue *q)
+{
+	unsigned int len;
+
+	pthread_mutex_lock(&q->lock);
+	len = q->len;
+	pthread_mutex_unlock(&q->lock);
+
+	return len;
+}
@@ -0,0 +1,173 @@
+/*
+ * Raspberry Pi PIC Programmer using GPIO connector
+ * https://github.com/WallaceIT/picberry
+ * Copyright 2016 Francesco Valla
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "common.h"
+
+/*
+ * Job scripts: a list of operations run one after the other in a single
+ * program mode session, after a single device ID read. The script is given
+ * on the command line as "op[:file],op[:file],..." or, with a leading '@',
+ * read from a file holding one operation per line ('#' starts a comment).
+ */
+
+#define SCRIPT_MAX_STEPS	32
+
+enum script_op {STEP_ERASE, STEP_WRITE, STEP_READ, STEP_BLANKCHECK, STEP_REGDUMP};
+
+static const char *step_names[] = {"erase", "write", "read", "blankcheck", "regdump"};
+
+struct script_step{
+	script_op		op;
+	char			file[256];
+	uint32_t		ms;
+};
+
+static struct script_step steps[SCRIPT_MAX_STEPS];
+static int nsteps = 0;
+
+static bool script_add(char *tok)
+{
+	char *arg = strchr(tok, ':');
+	unsigned int op;
+
+	if(arg){
+		*arg++ = '\0';
+		arg += strspn(arg, " \t");
+		arg[strcspn(arg, " \t\r\n")] = '\0';
+	}
+	tok += strspn(tok, " \t");
+	tok[strcspn(tok, " \t\r\n")] = '\0';
+
+	for(op = 0; op < sizeof(step_names)/sizeof(step_names[0]); op++)
+		if(!strcmp(tok, step_names[op]))
+			break;
+	if(op == sizeof(step_names)/sizeof(step_names[0])){
+		fprintf(stderr, "Unknown script operation '%s'\n", tok);
+		return false;
+	}
+	if((op == STEP_WRITE || op == STEP_READ) && (!arg || !*arg)){
+		fprintf(stderr, "Script operation '%s' needs a file, as in %s:file.hex\n", tok, tok);
+		return false;
+	}
+	if(nsteps == SCRIPT_MAX_STEPS){
+		fprintf(stderr, "Too many script operations, max %d\n", SCRIPT_MAX_STEPS);
+		return false;
+	}
+
+	steps[nsteps].op = (script_op) op;
+	snprintf(steps[nsteps].file, sizeof(steps[nsteps].file), "%s", arg ? arg : "");
+	nsteps++;
+
+	return true;
+}
+
+/* Parse the script, before entering program mode; false on errors */
+bool script_parse(char *spec)
+{
+	char line[512], *tok;
+	FILE *fp;
+
+	if(spec[0] != '@'){
+		for(tok = strtok(spec, ","); tok; tok = strtok(NULL, ","))
+			if(!script_add(tok))
+				return false;
+		return nsteps > 0;
+	}
+
+	fp = fopen(spec + 1, "r");
+	if(fp == NULL){
+		fprintf(stderr, "Error: cannot open script file %s\n", spec + 1);
+		return false;
+	}
+	while(fgets(line, sizeof(line), fp)){
+		line[strcspn(line, "#\r\n")] = '\0';
+		if(line[strspn(line, " \t")] == '\0')
+			continue;
+		if(!script_add(line)){
+			fclose(fp);
+			return false;
+		}
+	}
+	fclose(fp);
+
+	return nsteps > 0;
+}
+
+/* Run the parsed script; a failed erase, write or blank check stops it */
+void script_run(Pic *pic)
+{
+	struct timeval start, end;
+	uint32_t total = 0, errors;
+	bool failed;
+	int i;
+
+	for(i = 0; i < nsteps; i++){
+		fprintf(stdout, "[%d/%d] %s %s...", i + 1, nsteps,
+				step_names[steps[i].op], steps[i].file);
+		gettimeofday(&start, 0);
+		errors = pic->errors;
+
+		switch(steps[i].op){
+			case STEP_ERASE:
+				pic->bulk_erase();
+				break;
+			case STEP_WRITE:
+				clear_image(&pic->mem);		// drop what a previous step read
+				pic->write(steps[i].file);
+				break;
+			case STEP_READ:
+				clear_image(&pic->mem);		// erased words are not read back
+				pic->read(steps[i].file);
+				break;
+			case STEP_BLANKCHECK:
+				if(pic->blank_check()){
+					fprintf(stdout, "chip is not blank, stopping.\n");
+					nsteps = i + 1;
+				}
+				break;
+			case STEP_REGDUMP:
+				pic->dump_configuration_registers();
+				break;
+		}
+
+		gettimeofday(&end, 0);
+		steps[i].ms = (end.tv_sec - start.tv_sec) * 1000 +
+					  (end.tv_usec - start.tv_usec) / 1000;
+		total += steps[i].ms;
+
+		failed = (steps[i].op == STEP_ERASE || steps[i].op == STEP_WRITE) &&
+				 pic->errors != errors;
+		fprintf(stdout, "%s (%u ms)\n", failed ? "FAILED!" : "DONE!", steps[i].ms);
+		if(failed){
+			fprintf(stdout, "Stopping.\n");
+			nsteps = i + 1;
+		}
+	}
+
+	fprintf(stdout, "\nStep timings:\n");
+	for(i = 0; i < nsteps; i++)
+		fprintf(stdout, "  %-10s %-30s %8u ms\n", step_names[steps[i].op],
+				steps[i].file, steps[i].ms);
+	fprintf(stdout, "  %-41s %8u ms\n", "total", total);
+}
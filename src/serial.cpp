@@ -0,0 +1,315 @@
+/*
+ * Raspberry Pi PIC Programmer using GPIO connector
+ * https://github.com/WallaceIT/picberry
+ * Copyright 2016 Francesco Valla
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <string>
+
+#include "common.h"
+
+/*
+ * Serialization: per unit values patched into the image in memory right
+ * before it is written. The rule file has one rule per line:
+ *
+ *	name address length format order source
+ *
+ * address and length are in bytes, as in the hex file; format is binary,
+ * bcd or ascii; order is big or little (ignored for ascii); source is
+ * counter:first or list:file, a file with one value per line. Only the
+ * words holding the values change, and the drivers build their rows and
+ * checksums from the image when writing, so nothing else is recomputed.
+ *
+ * The next value of each rule is kept in rules.state and advanced only
+ * once a unit has been written without errors; rules.log records which
+ * values went to which device.
+ */
+
+#define SERIAL_MAX_RULES	16
+#define SERIAL_MAX_LEN		64
+
+enum serial_format{SER_BINARY, SER_BCD, SER_ASCII};
+
+struct serial_rule{
+	char			name[32];
+	uint32_t		addr;
+	unsigned int	len;
+	serial_format	format;
+	bool			big;
+	bool			counter;
+	uint64_t		next;			// counter value, or line of the list
+	char			list[300];
+	char			value[SERIAL_MAX_LEN + 1];	// applied to the current unit
+};
+
+static serial_rule rules[SERIAL_MAX_RULES];
+static int nrules = 0;
+static std::string state_file, log_file;
+
+/* Apply the saved state, if any, to the rules just parsed */
+static void serial_load_state(void)
+{
+	FILE *fp;
+	char name[32];
+	unsigned long long next;
+	int i;
+
+	fp = fopen(state_file.c_str(), "r");
+	if(!fp)
+		return;
+	while(fscanf(fp, "%31s %llu", name, &next) == 2)
+		for(i = 0; i < nrules; i++)
+			if(!strcmp(rules[i].name, name))
+				rules[i].next = next;
+	fclose(fp);
+}
+
+static bool serial_save_state(void)
+{
+	FILE *fp;
+	std::string tmp = state_file + ".tmp";
+	int i;
+
+	fp = fopen(tmp.c_str(), "w");
+	if(!fp){
+		perror(tmp.c_str());
+		return false;
+	}
+	for(i = 0; i < nrules; i++)
+		fprintf(fp, "%s %llu\n", rules[i].name, (unsigned long long) rules[i].next);
+	if(fclose(fp) || rename(tmp.c_str(), state_file.c_str())){
+		perror(state_file.c_str());
+		return false;
+	}
+	return true;
+}
+
+bool serial_load(const char *rulefile)
+{
+	FILE *fp;
+	char line[512], address[24], format[16], order[16], source[300];
+	unsigned int len;
+	serial_rule *r;
+	int n, linenum = 0;
+
+	fp = fopen(rulefile, "r");
+	if(!fp){
+		perror(rulefile);
+		return false;
+	}
+
+	nrules = 0;
+	while(fgets(line, sizeof(line), fp)){
+		linenum++;
+		if(line[strspn(line, " \t\r\n")] == '\0' || line[strspn(line, " \t")] == '#')
+			continue;
+		if(nrules == SERIAL_MAX_RULES){
+			fprintf(stderr, "%s: too many rules, max %d\n", rulefile, SERIAL_MAX_RULES);
+			goto fail;
+		}
+
+		r = &rules[nrules];
+		memset(r, 0, sizeof(*r));
+		n = sscanf(line, "%31s %23s %u %15s %15s %299s", r->name, address,
+				   &len, format, order, source);
+		if(n != 6 || !len || len > SERIAL_MAX_LEN){
+			fprintf(stderr, "%s:%d: expected name address length format order source\n",
+					rulefile, linenum);
+			goto fail;
+		}
+		r->addr = strtoul(address, NULL, 0);
+		r->len = len;
+		r->big = !strcmp(order, "big");
+
+		if(!strcmp(format, "binary"))
+			r->format = SER_BINARY;
+		else if(!strcmp(format, "bcd"))
+			r->format = SER_BCD;
+		else if(!strcmp(format, "ascii"))
+			r->format = SER_ASCII;
+		else{
+			fprintf(stderr, "%s:%d: unknown format %s\n", rulefile, linenum, format);
+			goto fail;
+		}
+
+		if(!strncmp(source, "counter:", 8)){
+			r->counter = true;
+			r->next = strtoull(source + 8, NULL, 0);
+		}
+		else if(!strncmp(source, "list:", 5))
+			snprintf(r->list, sizeof(r->list), "%s", source + 5);
+		else{
+			fprintf(stderr, "%s:%d: unknown source %s\n", rulefile, linenum, source);
+			goto fail;
+		}
+		nrules++;
+	}
+	fclose(fp);
+
+	state_file = std::string(rulefile) + ".state";
+	log_file = std::string(rulefile) + ".log";
+	serial_load_state();
+	return true;
+
+fail:
+	fclose(fp);
+	nrules = 0;
+	return false;
+}
+
+/* Line number n of a list file */
+static bool list_value(const char *list, uint64_t n, char *value)
+{
+	FILE *fp;
+	char line[SERIAL_MAX_LEN + 2];
+	uint64_t i = 0;
+	bool found = false;
+
+	fp = fopen(list, "r");
+	if(!fp){
+		perror(list);
+		return false;
+	}
+	while(fgets(line, sizeof(line), fp))
+		if(i++ == n){
+			line[strcspn(line, "\r\n")] = '\0';
+			strcpy(value, line);
+			found = true;
+			break;
+		}
+	fclose(fp);
+
+	if(!found)
+		fprintf(stderr, "%s: no values left (%llu used)\n", list, (unsigned long long) n);
+	return found;
+}
+
+/* Bytes of a value, in the order they go to increasing addresses */
+static bool encode(serial_rule *r, uint8_t *bytes)
+{
+	uint64_t v;
+	unsigned int i, k;
+	char *end;
+
+	if(r->format == SER_ASCII){
+		if(strlen(r->value) > r->len){
+			fprintf(stderr, "%s: %s does not fit in %u bytes\n", r->name, r->value, r->len);
+			return false;
+		}
+		memset(bytes, 0, r->len);
+		memcpy(bytes, r->value, strlen(r->value));
+		return true;
+	}
+
+	v = strtoull(r->value, &end, 0);
+	if(*end){
+		fprintf(stderr, "%s: %s is not a number\n", r->name, r->value);
+		return false;
+	}
+	for(i = 0; i < r->len; i++){
+		k = r->big ? r->len - 1 - i : i;
+		if(r->format == SER_BCD){
+			bytes[k] = (v % 10) | ((v / 10 % 10) << 4);
+			v /= 100;
+		}
+		else{
+			bytes[k] = v & 0xFF;
+			v >>= 8;
+		}
+	}
+	if(v){
+		fprintf(stderr, "%s: %s does not fit in %u bytes\n", r->name, r->value, r->len);
+		return false;
+	}
+	return true;
+}
+
+/* Patch the values of the next unit into the image in pic->mem */
+bool serial_apply(Pic *pic)
+{
+	uint8_t bytes[SERIAL_MAX_LEN];
+	uint32_t byte, index;
+	serial_rule *r;
+	unsigned int j;
+	int i;
+
+	for(i = 0; i < nrules; i++){
+		r = &rules[i];
+		if(r->counter)
+			snprintf(r->value, sizeof(r->value), "%llu", (unsigned long long) r->next);
+		else if(!list_value(r->list, r->next, r->value))
+			return false;
+		if(!encode(r, bytes))
+			return false;
+
+		for(j = 0; j < r->len; j++){
+			byte = r->addr + j;
+			index = byte/2 - pic->hex_offset/2;
+			if(byte/2 < pic->hex_offset/2 || index >= pic->mem.program_memory_size){
+				fprintf(stderr, "%s: address 0x%08X is outside the device memory\n",
+						r->name, byte);
+				return false;
+			}
+			if(!pic->mem.filled[index])
+				pic->mem.location[index] = 0xFFFF;
+			if(byte & 1)
+				pic->mem.location[index] = (pic->mem.location[index] & 0x00FF) | (bytes[j] << 8);
+			else
+				pic->mem.location[index] = (pic->mem.location[index] & 0xFF00) | bytes[j];
+			pic->mem.filled[index] = 1;
+		}
+		fprintf(stdout, "%s: %s\n", r->name, r->value);
+	}
+	return true;
+}
+
+/* The unit was written: log its values and move on to the next ones */
+bool serial_commit(Pic *pic)
+{
+	FILE *fp;
+	char stamp[32];
+	time_t now = time(NULL);
+	int i;
+
+	if(!nrules)
+		return true;
+
+	fp = fopen(log_file.c_str(), "a");
+	if(!fp){
+		perror(log_file.c_str());
+		return false;
+	}
+	strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", localtime(&now));
+	fprintf(fp, "%s %s 0x%08x 0x%x", stamp, pic->name, pic->device_id, pic->device_rev);
+	for(i = 0; i < nrules; i++)
+		fprintf(fp, " %s=%s", rules[i].name, rules[i].value);
+	fprintf(fp, "\n");
+	fclose(fp);
+
+	for(i = 0; i < nrules; i++)
+		rules[i].next++;
+	return serial_save_state();
+}
+
+bool serial_active(void)
+{
+	return nrules > 0;
+}
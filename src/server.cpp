@@ -0,0 +1,1124 @@
+/*
+ * Raspberry Pi PIC Programmer using GPIO connector
+ * https://github.com/WallaceIT/picberry
+ * Copyright 2016 Francesco Valla
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "common.h"
+
+/*
+ * Server mode: a single epoll loop accepts clients and parses their
+ * commands, while the PIC is driven by a worker thread fed from a job
+ * queue. The first client is the controller; the others are observers,
+ * which can only ask for the version or the status. Everything the worker
+ * prints on stdout is captured through a pipe and sent to every client, so
+ * observers follow the progress of the controller's operations live. The
+ * loop never blocks on a client: output a socket does not take is kept and
+ * sent on EPOLLOUT, and a client falling too far behind is dropped.
+ *
+ * A client whose first byte is SRV_FRAME_MAGIC talks the binary protocol
+ * instead: frames made of an 8 byte header (magic, version, type, 0 and the
+ * payload length, 32 bit little endian) followed by the payload. Commands
+ * are the same characters as in the text protocol, carried by CMD frames;
+ * progress and markers are sent as their own frames, and images travel as
+ * IMAGE frames holding runs of filled words:
+ *
+ *	{uint32 first word, uint32 count, count x uint16 data} ...
+ *
+ * all little endian, the word index being the one of Pic::mem. A count
+ * with SRV_FILL_RUN set is followed by a single word, repeated count times.
+ * An image can also be uploaded compressed, as a sequence of IMAGE_LZ4
+ * frames, each one {uint32 raw length, LZ4 block} of at most SRV_LZ4_CHUNK
+ * bytes of the IMAGE payload, closed by an empty IMAGE_END frame. Every
+ * chunk is decompressed as soon as it has been received.
+ */
+
+#define BUFFSIZE		4096
+#define SRV_MAX_CLIENTS	8
+
+#define SRV_FRAME_MAGIC		0xB5
+#define SRV_FRAME_VERSION	1
+#define SRV_FRAME_HDR		8
+#define SRV_FRAME_MAX		(8*1024*1024)
+#define SRV_LZ4_CHUNK		65536
+#define SRV_FILL_RUN		0x80000000
+#define SRV_FILL_MIN		8
+#define SRV_SESSION_LINGER	5000	// ms a kept session waits for a job
+#define SRV_BACKLOG_MAX		(SRV_FRAME_MAX + 65536)	// unsent output a client may have
+
+enum srv_command : char{
+	SRV_PB_VER		= '0',
+	SRV_RESET		= '1',
+	SRV_ENTER		= '2',
+	SRV_EXIT		= '3',
+	SRV_DEV_ID		= '4',
+	SRV_ERASE		= '5',
+	SRV_READ		= '6',
+	SRV_WRITE		= '7',
+	SRV_BLANKCHECK	= '8',
+	SRV_REGDUMP		= '9',
+	SRV_SET_FAMILY	= 'A',
+	SRV_STATUS		= 'S',
+	SRV_RELEASE		= 'X'	// internal: exit and close the session
+};
+
+enum srv_families : char{
+	SRV_FAM_DSPIC33E = '0',
+	SRV_FAM_DSPIC33F = '1',
+	SRV_FAM_PIC18FJ  = '2',
+	SRV_FAM_PIC24FJ  = '3',
+	SRV_FAM_PIC32MX1 = '4',
+	SRV_FAM_PIC32MX2 = '5',
+	SRV_FAM_PIC32MX3 = '6',
+	SRV_FAM_PIC32MZ  = '7',
+	SRV_FAM_PIC32MK  = '8',
+	SRV_FAM_DSPIC33CK  = '9'
+};
+
+enum srv_frame : uint8_t{
+	FRAME_CMD		= 0x01,		// client: command characters
+	FRAME_IMAGE		= 0x02,		// client: image to write, server: image read
+	FRAME_IMAGE_LZ4	= 0x03,		// client: compressed chunk of an image
+	FRAME_IMAGE_END	= 0x04,		// client: write the decompressed image
+	FRAME_OUTPUT	= 0x10,		// text printed by the operation
+	FRAME_PROGRESS	= 0x11,		// one byte, percentage
+	FRAME_DONE		= 0x12,		// @FIN
+	FRAME_ERROR		= 0x13,		// @ERR
+	FRAME_STATUS	= 0x14		// status JSON
+};
+
+/* pic_create() names, indexed by srv_families - '0' */
+static const char *srv_family_names[] = {
+	"dspic33e", "dspic33f", "pic18fj", "pic24fj", "pic32mx1",
+	"pic32mx2", "pic32mx3", "pic32mz", "pic32mk", "dspic33ck"
+};
+
+struct srv_job{
+	char			cmd;
+	char			arg;
+	uint8_t			*image;		// SRV_WRITE: hex text, or IMAGE payload
+	uint32_t		image_len;
+	bool			binary;		// image and answers as frames
+};
+
+struct srv_client{
+	int				sock;
+	bool			controller;
+	bool			status;		// push status changes to this client
+	char			pending;	// command waiting for its argument
+	bool			upload;		// receiving a hex file, up to '@'
+	FILE			*fp;		// NULL when the upload is discarded
+	char			*upload_buf;	// memory stream behind fp
+	size_t			upload_len;
+	bool			known;		// protocol chosen by the first byte
+	bool			binary;
+	uint8_t			hdr[SRV_FRAME_HDR];
+	uint32_t		hdr_len;
+	uint8_t			*payload;	// frame being received, NULL in the header
+	uint32_t		payload_len, payload_got;
+	uint8_t			*unpacked;	// IMAGE_LZ4 chunks decoded so far
+	uint32_t		unpacked_len;
+	uint8_t			*out;		// output the socket did not take yet
+	uint32_t		out_off, out_len;
+	bool			polling_out;	// waiting for EPOLLOUT
+	bool			dead;		// to be dropped once the events are handled
+	char			addr[INET_ADDRSTRLEN];
+};
+
+struct srv_buf{
+	uint8_t			*data;
+	uint32_t		len;
+};
+
+static struct srv_client *clients[SRV_MAX_CLIENTS];
+static int nclients = 0;
+
+static int srv_efd;
+static job_queue jobs;
+static job_queue outbox;		// worker -> loop: IMAGE frames
+static int notify_fd;			// worker -> loop: status changed
+
+/* Worker state, read by the loop to answer SRV_STATUS */
+static pthread_mutex_t state_lock = PTHREAD_MUTEX_INITIALIZER;
+static char state_cmd = 0;		// command being run, 0 if idle
+static char state_family = SRV_FAM_DSPIC33F;
+
+struct srv_session{
+	Pic				*pic;
+	bool			program_mode;
+	bool			kept;		// still in programming mode after SRV_EXIT
+	unsigned int	clk_default;	// PGC speed of families without a profile
+};
+
+struct srv_pins{
+	int				clk, data, mclr;
+};
+
+static void set_state(char cmd)
+{
+	uint64_t one = 1;
+
+	pthread_mutex_lock(&state_lock);
+	state_cmd = cmd;
+	pthread_mutex_unlock(&state_lock);
+
+	if(write(notify_fd, &one, sizeof(one)) < 0)
+		fprintf(stderr, "Failed to notify status change\n");
+}
+
+static void put_le32(uint8_t *p, uint32_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+static uint32_t get_le32(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static void frame_header(uint8_t *p, uint8_t type, uint32_t len)
+{
+	p[0] = SRV_FRAME_MAGIC;
+	p[1] = SRV_FRAME_VERSION;
+	p[2] = type;
+	p[3] = 0;
+	put_le32(p + 4, len);
+}
+
+/* Store a run at p, if not NULL, and return its size */
+static uint32_t image_run(uint8_t *p, memory *mem, uint32_t start, uint32_t count, bool fill)
+{
+	uint32_t k;
+
+	if(p){
+		put_le32(p, start);
+		put_le32(p + 4, fill ? count | SRV_FILL_RUN : count);
+		p += 8;
+		for(k = start; k < start + (fill ? 1 : count); k++){
+			*p++ = mem->location[k];
+			*p++ = mem->location[k] >> 8;
+		}
+	}
+
+	return 8 + (fill ? 2 : count * 2);
+}
+
+/* Store (or, with p NULL, just size) the runs of the filled words of mem;
+ * SRV_FILL_MIN or more equal words become a fill run */
+static uint32_t image_runs(uint8_t *p, memory *mem)
+{
+	uint32_t i = 0, start, end, same, size = 0;
+
+	while(i < mem->program_memory_size){
+		if(!mem->filled[i]){
+			i++;
+			continue;
+		}
+		for(end = i; end < mem->program_memory_size && mem->filled[end]; end++);
+
+		for(start = i; i < end; i += same){
+			for(same = 1; i + same < end && mem->location[i+same] == mem->location[i]; same++);
+			if(same < SRV_FILL_MIN)
+				continue;
+			if(i > start)
+				size += image_run(p ? p + size : NULL, mem, start, i - start, false);
+			size += image_run(p ? p + size : NULL, mem, i, same, true);
+			start = i + same;
+		}
+		if(i > start)
+			size += image_run(p ? p + size : NULL, mem, start, i - start, false);
+	}
+
+	return size;
+}
+
+/* Encode the filled words of mem as an IMAGE frame, header included */
+static uint8_t *image_encode(memory *mem, uint32_t *len)
+{
+	uint32_t size = image_runs(NULL, mem);
+	uint8_t *buf;
+
+	buf = (uint8_t *) malloc(SRV_FRAME_HDR + size);
+	frame_header(buf, FRAME_IMAGE, size);
+	image_runs(buf + SRV_FRAME_HDR, mem);
+
+	*len = SRV_FRAME_HDR + size;
+	return buf;
+}
+
+/* Fill mem from an IMAGE payload, checking every run against its size */
+static bool image_decode(const uint8_t *p, uint32_t len, memory *mem)
+{
+	uint32_t start, count, i;
+	bool fill;
+
+	clear_image(mem);
+
+	while(len){
+		if(len < 8)
+			return false;
+		start = get_le32(p);
+		count = get_le32(p + 4) & ~SRV_FILL_RUN;
+		fill = get_le32(p + 4) & SRV_FILL_RUN;
+		p += 8;
+		len -= 8;
+		if((fill ? 1 : count) > len / 2 || start > mem->program_memory_size ||
+		   count > mem->program_memory_size - start)
+			return false;
+		for(i = 0; i < count; i++){
+			mem->location[start + i] = p[0] | (p[1] << 8);
+			mem->filled[start + i] = 1;
+			if(!fill)
+				p += 2;
+		}
+		if(fill)
+			p += 2;
+		len -= fill ? 2 : count * 2;
+	}
+
+	return true;
+}
+
+/* Send mem as Intel HEX, straight from memory */
+static void send_hex(memory *mem, uint32_t offset)
+{
+	FILE *fp;
+	char *buf = NULL;
+	size_t len = 0;
+
+	fp = open_memstream(&buf, &len);
+	if(fp == NULL){
+		fprintf(stdout, "@ERR");
+		return;
+	}
+	write_inhx_fp(mem, fp, offset);
+	fclose(fp);
+
+	fwrite(buf, 1, len, stdout);
+	free(buf);
+	fprintf(stdout, "@FIN");
+}
+
+/* Load an uploaded image, hex text or IMAGE payload, into mem */
+static bool load_upload(struct srv_job *j, Pic *pic)
+{
+	FILE *fp;
+	unsigned int filled;
+
+	if(!pic->mem.location)
+		return false;
+	if(j->binary)
+		return image_decode(j->image, j->image_len, &pic->mem);
+
+	fp = fmemopen(j->image, j->image_len, "r");
+	if(fp == NULL)
+		return false;
+	clear_image(&pic->mem);
+	filled = read_inhx_fp(fp, &pic->mem, pic->hex_offset);
+	fclose(fp);
+
+	return filled > 0;
+}
+
+/* Leave a session kept open by SRV_EXIT */
+static void session_close(struct srv_session *s)
+{
+	if(s->kept){
+		fprintf(stderr, "Closing the programming session\n");
+		s->pic->exit_program_mode();
+		s->kept = false;
+	}
+}
+
+/* Run one command, as the single-client server used to. On SRV_EXIT a
+ * device whose PE is still running is left in programming mode, so that
+ * the next SRV_ENTER finds it ready and skips the PE download. */
+static void run_command(struct srv_session *s, struct srv_job *j)
+{
+	switch(j->cmd){
+		case SRV_RESET:
+			fprintf(stderr, "[CMD] Reset\n");
+			session_close(s);
+			pic_reset();
+			break;
+		case SRV_ENTER:
+			if(!s->program_mode && s->kept && s->pic->pe_resident()){
+				fprintf(stderr, "[CMD] Enter Program Mode (session resumed)\n");
+				s->program_mode = true;
+				s->kept = false;
+			}
+			else if(!s->program_mode){
+				session_close(s);
+				fprintf(stderr, "[CMD] Enter Program Mode\n");
+				s->pic->enter_program_mode();
+				if(s->pic->setup_pe())
+					s->program_mode = true;
+				else
+					s->pic->exit_program_mode();
+			}
+			break;
+		case SRV_EXIT:
+		case SRV_RELEASE:
+			if(s->program_mode && j->cmd == SRV_EXIT && s->pic->pe_resident()){
+				fprintf(stderr, "[CMD] Exit Program Mode (session kept)\n");
+				s->program_mode = false;
+				s->kept = true;
+			}
+			else if(s->program_mode){
+				fprintf(stderr, "[CMD] Exit Program Mode\n");
+				s->pic->exit_program_mode();
+				s->program_mode = false;
+			}
+			if(j->cmd == SRV_RELEASE)
+				session_close(s);
+			break;
+		case SRV_SET_FAMILY:
+			fprintf(stderr, "[CMD] Set Family ");
+			if(j->arg < SRV_FAM_DSPIC33E || j->arg > SRV_FAM_DSPIC33CK)
+				fprintf(stderr, "unknown.\n");
+			else if(j->arg == state_family)
+				fprintf(stderr, "not needed.\n");
+			else{
+				fprintf(stderr, "%s\n", srv_family_names[j->arg - '0']);
+				session_close(s);
+				free(s->pic->mem.location);
+				free(s->pic->mem.filled);
+				delete s->pic;
+				s->pic = pic_create(srv_family_names[j->arg - '0']);
+				clk_half_ns = s->clk_default;
+				timing_load(srv_family_names[j->arg - '0']);
+				pthread_mutex_lock(&state_lock);
+				state_family = j->arg;
+				pthread_mutex_unlock(&state_lock);
+			}
+			fprintf(stdout, "K%c", j->arg);
+			break;
+		case SRV_DEV_ID:
+			if(s->program_mode){
+				if(flags.debug) fprintf(stderr, "[CMD] Read Device ID\n");
+				if(s->pic->read_device_id())
+					fprintf(stdout,
+							"{\"DevName\" : \"%s\", \"DevID\" : \"0x%08X\", \"DevRev\" : \"0x%08X\"}",
+							s->pic->name,
+							s->pic->device_id,
+							s->pic->device_rev);
+				else{
+					fprintf(stdout, "NC");
+					s->pic->exit_program_mode();
+					s->program_mode = false;
+				}
+			}
+			break;
+		case SRV_BLANKCHECK:
+			if(s->program_mode){
+				fprintf(stderr, "[CMD] Blank Check\n");
+				s->pic->blank_check();
+			}
+			break;
+		case SRV_READ:
+			if(s->program_mode){
+				fprintf(stderr, "[CMD] Read\n");
+				s->pic->read(NULL, 0, 0);
+				if(j->binary){
+					struct srv_buf *b = (struct srv_buf *) malloc(sizeof(struct srv_buf));
+					b->data = image_encode(&s->pic->mem, &b->len);
+					queue_push(&outbox, b);
+				}
+				else
+					send_hex(&s->pic->mem, s->pic->hex_offset);
+			}
+			break;
+		case SRV_WRITE:
+			if(s->program_mode){
+				fprintf(stderr, "[CMD] Write\n");
+				if(load_upload(j, s->pic))
+					s->pic->write(NULL);
+				else{
+					fprintf(stderr, "Invalid image, or device ID not read yet.\n");
+					fprintf(stdout, "@ERR");
+				}
+			}
+			free(j->image);
+			break;
+		case SRV_ERASE:
+			if(s->program_mode){
+				fprintf(stderr, "[CMD] Erase\n");
+				s->pic->bulk_erase();
+			}
+			break;
+		case SRV_REGDUMP:
+			if(s->program_mode){
+				fprintf(stderr, "[CMD] Register Dump\n");
+				s->pic->dump_configuration_registers();
+			}
+			break;
+		default:
+			break;
+	}
+}
+
+static void *srv_worker(void *arg)
+{
+	struct srv_pins *pins = (struct srv_pins *) arg;
+	struct srv_job *j;
+	struct srv_session s = {pic_create("dspic33f"), false, false, clk_half_ns};
+
+	/* the pins were parsed by the main thread */
+	pic_clk = pins->clk;
+	pic_data = pins->data;
+	pic_mclr = pins->mclr;
+	timing_load("dspic33f");
+
+	while(1){
+		if(s.kept){
+			/* release the target if no job comes in a while */
+			j = (struct srv_job *) queue_pop_timed(&jobs, SRV_SESSION_LINGER);
+			if(!j){
+				session_close(&s);
+				continue;
+			}
+		}
+		else
+			j = (struct srv_job *) queue_pop(&jobs);
+		set_state(j->cmd);
+		s.pic->errors = 0;		// each job reports its own failures
+		run_command(&s, j);
+		free(j);
+		set_state(0);
+	}
+
+	return NULL;
+}
+
+/* Queue a command; SRV_WRITE takes ownership of image */
+static void enqueue(struct srv_client *cl, char cmd, char arg,
+					uint8_t *image = NULL, uint32_t image_len = 0)
+{
+	struct srv_job *j = (struct srv_job *) calloc(1, sizeof(struct srv_job));
+
+	j->cmd = cmd;
+	j->arg = arg;
+	j->binary = cl->binary;
+	j->image = image;
+	j->image_len = image_len;
+	queue_push(&jobs, j);
+}
+
+/* Send as much of the backlog as the socket takes, wait for EPOLLOUT
+ * while some is left */
+static void client_flush(struct srv_client *cl)
+{
+	struct epoll_event ev;
+	ssize_t n;
+
+	while(cl->out_off < cl->out_len){
+		n = send(cl->sock, cl->out + cl->out_off, cl->out_len - cl->out_off,
+				 MSG_DONTWAIT | MSG_NOSIGNAL);
+		if(n < 0 && errno == EINTR)
+			continue;
+		if(n < 0){
+			if(errno != EAGAIN && errno != EWOULDBLOCK){
+				fprintf(stderr, "Failed to send to client %s\n", cl->addr);
+				cl->dead = true;
+			}
+			break;
+		}
+		cl->out_off += n;
+	}
+	if(cl->out_off == cl->out_len)
+		cl->out_off = cl->out_len = 0;
+
+	if(cl->polling_out != (cl->out_len > 0) && !cl->dead){
+		cl->polling_out = cl->out_len > 0;
+		ev.events = EPOLLIN | (cl->polling_out ? EPOLLOUT : 0);
+		ev.data.ptr = cl;
+		epoll_ctl(srv_efd, EPOLL_CTL_MOD, cl->sock, &ev);
+	}
+}
+
+/* Never blocks: what the client does not read is kept, and a client which
+ * falls more than SRV_BACKLOG_MAX behind is dropped, controller included */
+static void client_send(struct srv_client *cl, const void *buf, size_t len)
+{
+	uint8_t *out;
+	uint32_t backlog = cl->out_len - cl->out_off;
+
+	if(cl->dead || !len)
+		return;
+	if(backlog + len > SRV_BACKLOG_MAX){
+		fprintf(stderr, "Client %s is not reading its output\n", cl->addr);
+		cl->dead = true;
+		return;
+	}
+
+	if(cl->out_off){
+		memmove(cl->out, cl->out + cl->out_off, backlog);
+		cl->out_off = 0;
+		cl->out_len = backlog;
+	}
+	out = (uint8_t *) realloc(cl->out, cl->out_len + len);
+	if(!out){
+		cl->dead = true;
+		return;
+	}
+	cl->out = out;
+	memcpy(cl->out + cl->out_len, buf, len);
+	cl->out_len += len;
+
+	client_flush(cl);
+}
+
+/* Answer a single client, framed or as text */
+static void client_reply(struct srv_client *cl, uint8_t type, const char *buf, size_t len)
+{
+	uint8_t hdr[SRV_FRAME_HDR];
+
+	if(cl->binary){
+		frame_header(hdr, type, len);
+		client_send(cl, hdr, SRV_FRAME_HDR);
+		if(len)
+			client_send(cl, buf, len);
+	}
+	else if(type == FRAME_ERROR)
+		client_send(cl, "@ERR", 4);
+	else{
+		if(type == FRAME_STATUS)
+			client_send(cl, "@STA", 4);
+		client_send(cl, buf, len);
+	}
+}
+
+static void status_send(struct srv_client *cl)
+{
+	char buf[128];
+	int len;
+
+	pthread_mutex_lock(&state_lock);
+	len = snprintf(buf, sizeof(buf),
+			"{\"Busy\" : \"%c\", \"Queued\" : %u, \"Family\" : \"%c\", \"Clients\" : %d}",
+			state_cmd ? state_cmd : '-', queue_len(&jobs), state_family, nclients);
+	pthread_mutex_unlock(&state_lock);
+
+	client_reply(cl, FRAME_STATUS, buf, len);
+}
+
+static void client_drop(int efd, int idx)
+{
+	struct srv_client *cl = clients[idx];
+	int i;
+
+	fprintf(stderr, "Client disconnected: %s\n", cl->addr);
+	epoll_ctl(efd, EPOLL_CTL_DEL, cl->sock, NULL);
+	close(cl->sock);
+	if(cl->fp){
+		fclose(cl->fp);
+		free(cl->upload_buf);
+	}
+	free(cl->payload);
+	free(cl->unpacked);
+	free(cl->out);
+
+	for(i = idx; i < nclients - 1; i++)
+		clients[i] = clients[i+1];
+	nclients--;
+
+	if(cl->controller){
+		/* leave the target as the old server did on disconnect */
+		enqueue(cl, SRV_RELEASE, 0);
+		if(nclients){
+			clients[0]->controller = true;
+			fprintf(stderr, "Client %s is now the controller\n", clients[0]->addr);
+		}
+	}
+	free(cl);
+}
+
+/*
+ * Translate the worker output into frames: @NNN progress, @FIN, @ERR and
+ * runs of plain text. A marker split across two reads is kept for the next
+ * call. out must hold 4 * (len + 4) + SRV_FRAME_HDR bytes.
+ */
+static uint32_t frame_output(const char *in, uint32_t len, uint8_t *out)
+{
+	static char carry[4];
+	static uint32_t ncarry = 0;
+	char buf[BUFFSIZE + 4];
+	uint32_t i, text = 0, total, n = 0;
+	uint8_t type;
+
+	memcpy(buf, carry, ncarry);
+	memcpy(buf + ncarry, in, len);
+	total = ncarry + len;
+	ncarry = 0;
+
+	for(i = 0; i < total; i++){
+		if(buf[i] != '@')
+			continue;
+		if(total - i < 4){
+			ncarry = total - i;
+			memcpy(carry, buf + i, ncarry);
+			break;
+		}
+		if(!strncmp(buf + i + 1, "FIN", 3))
+			type = FRAME_DONE;
+		else if(!strncmp(buf + i + 1, "ERR", 3))
+			type = FRAME_ERROR;
+		else if(isdigit(buf[i+1]) && isdigit(buf[i+2]) && isdigit(buf[i+3]))
+			type = FRAME_PROGRESS;
+		else
+			continue;
+
+		if(i > text){
+			frame_header(out + n, FRAME_OUTPUT, i - text);
+			memcpy(out + n + SRV_FRAME_HDR, buf + text, i - text);
+			n += SRV_FRAME_HDR + i - text;
+		}
+		frame_header(out + n, type, type == FRAME_PROGRESS);
+		n += SRV_FRAME_HDR;
+		if(type == FRAME_PROGRESS)
+			out[n++] = (buf[i+1] - '0') * 100 + (buf[i+2] - '0') * 10 + buf[i+3] - '0';
+		i += 3;
+		text = i + 1;
+	}
+
+	/* i is at the end, or at the kept marker */
+	if(i > text){
+		frame_header(out + n, FRAME_OUTPUT, i - text);
+		memcpy(out + n + SRV_FRAME_HDR, buf + text, i - text);
+		n += SRV_FRAME_HDR + i - text;
+	}
+
+	return n;
+}
+
+/* Drop the clients which failed or fell too far behind */
+static void client_sweep(int efd)
+{
+	int i;
+
+	for(i = nclients - 1; i >= 0; i--)
+		if(clients[i]->dead)
+			client_drop(efd, i);
+}
+
+/* Send to every client (binary ones only if text is NULL). Sending never
+ * blocks, so a client which stops reading cannot stall the programming */
+static void deliver(const char *text, uint32_t text_len,
+					const uint8_t *frames, uint32_t frames_len)
+{
+	const void *buf;
+	size_t len;
+	int i;
+
+	for(i = nclients - 1; i >= 0; i--){
+		if(clients[i]->binary){
+			buf = frames;
+			len = frames_len;
+		}
+		else if(text){
+			buf = text;
+			len = text_len;
+		}
+		else
+			continue;
+		client_send(clients[i], buf, len);
+	}
+}
+
+static void broadcast(int pipefd)
+{
+	char buf[BUFFSIZE];
+	uint8_t frames[4 * (BUFFSIZE + 4) + SRV_FRAME_HDR];
+	ssize_t len;
+
+	while((len = read(pipefd, buf, sizeof(buf))) > 0)
+		deliver(buf, len, frames, frame_output(buf, len, frames));
+}
+
+/* Parse the bytes received from a client */
+static void client_input(struct srv_client *cl, char *buf, int len)
+{
+	char *end;
+	int i = 0;
+
+	while(i < len){
+		if(cl->upload){
+			end = (char *) memchr(buf + i, '@', len - i);
+			if(cl->fp)
+				fwrite(buf + i, 1, (end ? end : buf + len) - (buf + i), cl->fp);
+			if(!end)
+				return;
+			i = end - buf + 1;
+			cl->upload = false;
+			if(cl->fp){
+				fclose(cl->fp);
+				cl->fp = NULL;
+				enqueue(cl, SRV_WRITE, 0, (uint8_t *) cl->upload_buf, cl->upload_len);
+			}
+			continue;
+		}
+
+		char c = buf[i++];
+
+		if(flags.debug)
+			fprintf(stderr, "Command received: %c\n", c);
+
+		if(cl->pending){
+			if(cl->controller)
+				enqueue(cl, cl->pending, c);
+			cl->pending = 0;
+			continue;
+		}
+
+		switch(c){
+			case SRV_PB_VER:
+				fprintf(stderr, "[CMD] Get picberry version\n");
+				client_reply(cl, FRAME_OUTPUT, VERSION, strlen(VERSION));
+				break;
+			case SRV_STATUS:
+				cl->status = true;
+				status_send(cl);
+				break;
+			case SRV_SET_FAMILY:
+				cl->pending = c;
+				if(!cl->controller)
+					client_reply(cl, FRAME_ERROR, NULL, 0);
+				break;
+			case SRV_WRITE:
+				if(cl->binary){
+					/* the image comes in an IMAGE frame */
+					client_reply(cl, FRAME_ERROR, NULL, 0);
+					break;
+				}
+				cl->upload = true;
+				if(!cl->controller){
+					client_send(cl, "@ERR", 4);
+					break;
+				}
+				cl->fp = open_memstream(&cl->upload_buf, &cl->upload_len);
+				if(cl->fp == NULL)
+					client_send(cl, "@ERR", 4);
+				break;
+			case SRV_RESET:
+			case SRV_ENTER:
+			case SRV_EXIT:
+			case SRV_DEV_ID:
+			case SRV_ERASE:
+			case SRV_READ:
+			case SRV_BLANKCHECK:
+			case SRV_REGDUMP:
+				if(cl->controller)
+					enqueue(cl, c, 0);
+				else
+					client_reply(cl, FRAME_ERROR, NULL, 0);
+				break;
+			default:
+				break;
+		}
+	}
+}
+
+/* Decompress an IMAGE_LZ4 chunk at the end of the image being received */
+static bool unpack_chunk(struct srv_client *cl)
+{
+	uint32_t raw_len;
+	uint8_t *buf;
+
+	if(cl->payload_len < 4)
+		return false;
+	raw_len = get_le32(cl->payload);
+	if(raw_len > SRV_LZ4_CHUNK || cl->unpacked_len + raw_len > SRV_FRAME_MAX)
+		return false;
+
+	buf = (uint8_t *) realloc(cl->unpacked, cl->unpacked_len + raw_len + 1);
+	if(!buf)
+		return false;
+	cl->unpacked = buf;
+
+	if(lz4_decode(cl->payload + 4, cl->payload_len - 4,
+				  cl->unpacked + cl->unpacked_len, raw_len) != (int) raw_len)
+		return false;
+	cl->unpacked_len += raw_len;
+
+	return true;
+}
+
+/* A whole frame has been received from a binary client */
+static void frame_done(struct srv_client *cl)
+{
+	switch(cl->hdr[2]){
+		case FRAME_CMD:
+			client_input(cl, (char *) cl->payload, cl->payload_len);
+			break;
+		case FRAME_IMAGE:
+			if(cl->controller){
+				enqueue(cl, SRV_WRITE, 0, cl->payload, cl->payload_len);
+				cl->payload = NULL;
+			}
+			else
+				client_reply(cl, FRAME_ERROR, NULL, 0);
+			break;
+		case FRAME_IMAGE_LZ4:
+			if(!cl->controller || !unpack_chunk(cl)){
+				free(cl->unpacked);
+				cl->unpacked = NULL;
+				cl->unpacked_len = 0;
+				client_reply(cl, FRAME_ERROR, NULL, 0);
+			}
+			break;
+		case FRAME_IMAGE_END:
+			if(cl->controller && cl->unpacked)
+				enqueue(cl, SRV_WRITE, 0, cl->unpacked, cl->unpacked_len);
+			else
+				client_reply(cl, FRAME_ERROR, NULL, 0);
+			cl->unpacked = NULL;
+			cl->unpacked_len = 0;
+			break;
+		default:
+			client_reply(cl, FRAME_ERROR, NULL, 0);
+			break;
+	}
+
+	free(cl->payload);
+	cl->payload = NULL;
+	cl->hdr_len = 0;
+}
+
+/* Collect the frames of a binary client; false if it has to be dropped */
+static bool frame_input(struct srv_client *cl, const uint8_t *buf, uint32_t len)
+{
+	uint32_t n;
+
+	while(len){
+		if(!cl->payload){
+			n = SRV_FRAME_HDR - cl->hdr_len;
+			if(n > len)
+				n = len;
+			memcpy(cl->hdr + cl->hdr_len, buf, n);
+			cl->hdr_len += n;
+			buf += n;
+			len -= n;
+			if(cl->hdr_len < SRV_FRAME_HDR)
+				return true;
+
+			cl->payload_len = get_le32(cl->hdr + 4);
+			if(cl->hdr[0] != SRV_FRAME_MAGIC || cl->hdr[1] != SRV_FRAME_VERSION ||
+			   cl->payload_len > SRV_FRAME_MAX){
+				fprintf(stderr, "Bad frame from client %s\n", cl->addr);
+				client_reply(cl, FRAME_ERROR, NULL, 0);
+				return false;
+			}
+			cl->payload = (uint8_t *) malloc(cl->payload_len + 1);
+			cl->payload_got = 0;
+		}
+
+		n = cl->payload_len - cl->payload_got;
+		if(n > len)
+			n = len;
+		memcpy(cl->payload + cl->payload_got, buf, n);
+		cl->payload_got += n;
+		buf += n;
+		len -= n;
+		if(cl->payload_got == cl->payload_len)
+			frame_done(cl);
+	}
+
+	return true;
+}
+
+static void client_accept(int efd, int serversock)
+{
+	struct sockaddr_in pbclient;
+	socklen_t clientlen = sizeof(pbclient);
+	struct epoll_event ev;
+	struct srv_client *cl;
+	int sock;
+
+	if ((sock = accept(serversock, (struct sockaddr *) &pbclient, &clientlen)) < 0) {
+		fprintf(stderr, "Failed to accept client connection\n");
+		return;
+	}
+	if (nclients == SRV_MAX_CLIENTS) {
+		fprintf(stderr, "Too many clients, refusing %s\n", inet_ntoa(pbclient.sin_addr));
+		close(sock);
+		return;
+	}
+
+	cl = (struct srv_client *) calloc(1, sizeof(struct srv_client));
+	cl->sock = sock;
+	cl->controller = (nclients == 0);
+	inet_ntop(AF_INET, &pbclient.sin_addr, cl->addr, sizeof(cl->addr));
+	clients[nclients++] = cl;
+
+	ev.events = EPOLLIN;
+	ev.data.ptr = cl;
+	epoll_ctl(efd, EPOLL_CTL_ADD, sock, &ev);
+
+	fprintf(stderr, "Client connected: %s (%s)\n", cl->addr,
+			cl->controller ? "controller" : "observer");
+}
+
+void server_mode(int port)
+{
+	int serversock, efd, outpipe[2], i, n;
+	struct sockaddr_in pbserver;
+	struct epoll_event ev, events[SRV_MAX_CLIENTS + 3];
+	struct srv_pins pins = {pic_clk, pic_data, pic_mclr};
+	pthread_t worker;
+	char buffer[BUFFSIZE];
+	uint64_t changes;
+
+	/* Set picberry to work in "client" mode */
+	flags.client = 1;
+
+	/* Create the TCP socket */
+	if ((serversock = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP)) < 0) {
+		fprintf(stderr, "Failed to create socket\n");
+		exit(1);
+	}
+	/* Construct the server sockaddr_in structure */
+	memset(&pbserver, 0, sizeof(pbserver));			/* Clear struct */
+	pbserver.sin_family = AF_INET;					/* Internet/IP */
+	pbserver.sin_addr.s_addr = htonl(INADDR_ANY);	/* Incoming addr */
+	pbserver.sin_port = htons(port);				/* server port */
+
+	/* Bind the server socket */
+	if (bind(serversock, (struct sockaddr *) &pbserver, sizeof(pbserver)) < 0) {
+		fprintf(stderr, "Failed to bind the server socket\n");
+		exit(1);
+	}
+	if (listen(serversock, SRV_MAX_CLIENTS) < 0) {
+		fprintf(stderr, "Failed to listen on server socket\n");
+		exit(1);
+	}
+
+	/* capture the operations output, to be sent to the clients */
+	if (pipe(outpipe) < 0 || (notify_fd = eventfd(0, EFD_NONBLOCK)) < 0) {
+		fprintf(stderr, "Failed to create the output pipe\n");
+		exit(1);
+	}
+	fcntl(outpipe[0], F_SETFL, O_NONBLOCK);
+	setbuf(stdout, NULL);
+	dup2(outpipe[1], STDOUT_FILENO);
+
+	efd = srv_efd = epoll_create1(0);
+	ev.events = EPOLLIN;
+	ev.data.ptr = &serversock;
+	epoll_ctl(efd, EPOLL_CTL_ADD, serversock, &ev);
+	ev.data.ptr = &outpipe[0];
+	epoll_ctl(efd, EPOLL_CTL_ADD, outpipe[0], &ev);
+	ev.data.ptr = &notify_fd;
+	epoll_ctl(efd, EPOLL_CTL_ADD, notify_fd, &ev);
+
+	queue_init(&jobs);
+	queue_init(&outbox);
+	pthread_create(&worker, NULL, srv_worker, &pins);
+
+	/* Run until cancelled */
+	while (1) {
+		n = epoll_wait(efd, events, SRV_MAX_CLIENTS + 3, -1);
+		if (n < 0 && errno != EINTR) {
+			fprintf(stderr, "Failed to wait for events\n");
+			exit(1);
+		}
+
+		for (i = 0; i < n; i++) {
+			void *src = events[i].data.ptr;
+
+			if (src == &serversock)
+				client_accept(efd, serversock);
+			else if (src == &outpipe[0])
+				broadcast(outpipe[0]);
+			else if (src == &notify_fd) {
+				if (read(notify_fd, &changes, sizeof(changes)) < 0)
+					continue;
+				/* keep the status after the output it refers to */
+				broadcast(outpipe[0]);
+				while (queue_len(&outbox)) {
+					struct srv_buf *b = (struct srv_buf *) queue_pop(&outbox);
+					deliver(NULL, 0, b->data, b->len);
+					free(b->data);
+					free(b);
+				}
+				for (int k = 0; k < nclients; k++)
+					if (clients[k]->status)
+						status_send(clients[k]);
+			}
+			else {
+				struct srv_client *cl = (struct srv_client *) src;
+				int k, received;
+
+				/* it may have been dropped while handling a previous event */
+				for (k = 0; k < nclients && clients[k] != cl; k++);
+				if (k == nclients || cl->dead)
+					continue;
+
+				if (events[i].events & EPOLLOUT)
+					client_flush(cl);
+				if (!(events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)))
+					continue;
+
+				/* frame payloads are received in place, in big chunks */
+				if (cl->payload) {
+					received = recv(cl->sock, cl->payload + cl->payload_got,
+									cl->payload_len - cl->payload_got, MSG_DONTWAIT);
+					if (received > 0) {
+						cl->payload_got += received;
+						if (cl->payload_got == cl->payload_len)
+							frame_done(cl);
+						continue;
+					}
+				}
+				else {
+					received = recv(cl->sock, buffer, BUFFSIZE, MSG_DONTWAIT);
+					if (received > 0) {
+						if (!cl->known) {
+							cl->known = true;
+							cl->binary = ((uint8_t) buffer[0] == SRV_FRAME_MAGIC);
+						}
+						if (!cl->binary)
+							client_input(cl, buffer, received);
+						else if (!frame_input(cl, (uint8_t *) buffer, received))
+							client_drop(efd, k);
+						continue;
+					}
+				}
+				if (received < 0 && (errno == EAGAIN || errno == EINTR))
+					continue;
+				client_drop(efd, k);
+			}
+		}
+		client_sweep(efd);
+	}
+}
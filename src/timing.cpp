@@ -0,0 +1,205 @@
+/*
+ * Raspberry Pi PIC Programmer using GPIO connector
+ * https://github.com/WallaceIT/picberry
+ * Copyright 2016 Francesco Valla
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+
+#include "common.h"
+
+/*
+ * Timing profiles: how fast PGC can be clocked on a given fixture. The file
+ * has one line per fixture, keyed by the pins and the -f family:
+ *
+ *	PGC,PGD,MCLR family half_period_ns
+ *
+ * --calibrate reads the device ID and the first CALIB_WORDS of program
+ * memory at the default speed, then again at each shorter half period,
+ * CALIB_READS times, re-entering program mode every time. The fastest step
+ * which still reads the same data is backed off by one step and saved.
+ * Erased words read as all ones whatever the speed, so the sample must hold
+ * at least CALIB_DATA programmed words: calibrate on a programmed device.
+ */
+
+#define CALIB_WORDS	256
+#define CALIB_READS	2
+#define CALIB_DATA	(CALIB_WORDS/4)
+
+static const unsigned int calib_steps[] = {1000, 500, 250, 120, 60, 30, 0};
+#define CALIB_NSTEPS	(sizeof(calib_steps)/sizeof(calib_steps[0]))
+
+const char *timing_file = TIMING_PROFILE;
+
+/* Profile key of the fixture driven by the calling thread */
+static void timing_key(char *key, size_t len, const char *family)
+{
+	snprintf(key, len, "%d,%d,%d %s ", pic_clk, pic_data, pic_mclr, family);
+}
+
+/* Apply the profile of this fixture, if there is one */
+bool timing_load(const char *family)
+{
+	FILE *fp;
+	char key[64], line[128];
+	unsigned int ns;
+	bool found = false;
+
+	fp = fopen(timing_file, "r");
+	if(!fp)
+		return false;
+
+	timing_key(key, sizeof(key), family);
+	while(fgets(line, sizeof(line), fp))
+		if(strncmp(line, key, strlen(key)) == 0 &&
+		   sscanf(line + strlen(key), "%u", &ns) == 1){
+			clk_half_ns = ns;
+			found = true;
+		}
+	fclose(fp);
+
+	if(found && flags.debug)
+		fprintf(stderr, "Timing profile: PGC half period %u ns\n", clk_half_ns);
+	return found;
+}
+
+/* Replace the line of this fixture, keeping the others */
+static bool timing_save(const char *family, unsigned int ns)
+{
+	FILE *fp;
+	char key[64], line[128];
+	std::string tmp, kept;
+
+	timing_key(key, sizeof(key), family);
+	fp = fopen(timing_file, "r");
+	if(fp){
+		while(fgets(line, sizeof(line), fp))
+			if(strncmp(line, key, strlen(key)))
+				kept += line;
+		fclose(fp);
+	}
+
+	tmp = std::string(timing_file) + ".tmp";
+	fp = fopen(tmp.c_str(), "w");
+	if(!fp){
+		perror(tmp.c_str());
+		return false;
+	}
+	fprintf(fp, "%s%s%u\n", kept.c_str(), key, ns);
+	if(fclose(fp) || rename(tmp.c_str(), timing_file)){
+		perror(timing_file);
+		return false;
+	}
+	return true;
+}
+
+static void calib_quiet(int percent, void *ctx)
+{
+}
+
+/* One read of the sample at the current speed; false if the ID differs.
+ * Every word is hashed, erased ones included; data: the programmed ones */
+static bool calib_sample(Pic *pic, uint32_t id, uint16_t rev, uint32_t *sum,
+						 uint32_t *data = NULL)
+{
+	uint32_t i, word, n = 0;
+
+	pic->exit_program_mode();
+	pic->enter_program_mode();
+	pic->setup_pe();
+	if(!pic->read_device_id() || pic->device_id != id || pic->device_rev != rev)
+		return false;
+
+	clear_image(&pic->mem);
+	pic->read(NULL, 0, CALIB_WORDS);
+
+	*sum = 0;
+	for(i = 0; i < pic->mem.program_memory_size; i++){
+		word = pic->mem.filled[i] ? pic->mem.location[i] : pic->erased_value(i);
+		if(pic->mem.filled[i])
+			n++;
+		*sum = *sum * 31 + (i ^ word);
+	}
+	if(data)
+		*data = n;
+	return true;
+}
+
+/* Find the fastest PGC this fixture reads reliably at and save it */
+void calibrate_mode(Pic *pic, const char *family)
+{
+	uint32_t id, ref, sum, data;
+	uint16_t rev;
+	unsigned int i, r, best = 0;
+	bool ok;
+
+	pic->progress_cb = calib_quiet;
+	clk_half_ns = calib_steps[0];
+
+	pic->enter_program_mode();
+	pic->setup_pe();
+	if(!pic->read_device_id()){
+		fprintf(stderr, "Calibration needs a known device, read 0x%08x\n", pic->device_id);
+		pic->exit_program_mode();
+		goto out;
+	}
+	id = pic->device_id;
+	rev = pic->device_rev;
+	fprintf(stdout, "Calibrating on %s\n", pic->name);
+
+	if(!calib_sample(pic, id, rev, &ref, &data)){
+		fprintf(stderr, "Device does not answer again at %u ns\n", calib_steps[0]);
+		pic->exit_program_mode();
+		goto out;
+	}
+	if(data < CALIB_DATA){
+		fprintf(stderr, "Only %u of the first %u words are programmed, at least %u are needed:\n"
+				"write an image first, a blank device reads the same at any speed\n",
+				data, CALIB_WORDS, CALIB_DATA);
+		pic->exit_program_mode();
+		goto out;
+	}
+
+	for(i = 1; i < CALIB_NSTEPS; i++){
+		clk_half_ns = calib_steps[i];
+		ok = true;
+		for(r = 0; r < CALIB_READS && ok; r++)
+			ok = calib_sample(pic, id, rev, &sum) && sum == ref;
+		fprintf(stdout, "%4u ns: %s\n", calib_steps[i], ok ? "ok" : "FAIL");
+		if(!ok)
+			break;
+		best = i;
+	}
+	clk_half_ns = calib_steps[0];
+	pic->exit_program_mode();
+
+	/* safety margin: one step slower than the fastest which passed */
+	clk_half_ns = calib_steps[best ? best - 1 : 0];
+	fprintf(stdout, "PGC half period: %u ns\n", clk_half_ns);
+	if(timing_save(family, clk_half_ns))
+		fprintf(stdout, "Saved to %s\n", timing_file);
+
+out:
+	pic->progress_cb = NULL;
+	free(pic->mem.location);
+	free(pic->mem.filled);
+	pic->mem.location = NULL;
+	pic->mem.filled = NULL;
+}